@@ -19,9 +19,9 @@ while g_idx != 0
   c_code, g_idx = face.next_char c_code
 end
 
-puts 'listing charcodes with current_charmap'
+puts 'listing charcodes with charmap_pairs'
 
-cmap = face.current_charmap
-cmap.keys.sort.each { |c_code| 
-  puts "#{c_code} => " << face.glyph_name(cmap[c_code])
+codes, glyphs = face.charmap_pairs
+codes.unpack('L*').zip(glyphs.unpack('L*')) { |c_code, g_idx|
+  puts "#{c_code} => " << face.glyph_name(g_idx)
 }
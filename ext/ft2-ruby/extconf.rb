@@ -5,5 +5,9 @@ ft2_config = with_config("freetype-config", "freetype-config")
 $CFLAGS << ' ' << `#{ft2_config} --cflags`.chomp
 $LDFLAGS << ' ' << `#{ft2_config} --libs`.chomp
 
+have_header("ruby/io/buffer.h")
+have_header("ruby/ractor.h")
+have_func("rb_nogvl", "ruby/thread.h")
+
 have_library("freetype", "FT_Init_FreeType") and
   create_makefile("ft2")
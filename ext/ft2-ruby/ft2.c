@@ -25,9 +25,34 @@
 /************************************************************************/
 
 #include <ruby.h>
+#include <ruby/thread.h>
+#include <ruby/encoding.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_RUBY_IO_BUFFER_H
+#include <ruby/io/buffer.h>
+#endif /* HAVE_RUBY_IO_BUFFER_H */
+#ifdef HAVE_RUBY_RACTOR_H
+#include <ruby/ractor.h>
+#endif /* HAVE_RUBY_RACTOR_H */
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_GLYPH_H
+#include FT_ADVANCES_H
+#include FT_CACHE_H
+#include FT_MODULE_H
+#include FT_SIZES_H
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
 
 #define UNUSED(a) ((void) (a))
 #define ABS(a) (((a) < 0) ? -(a) : (a))
@@ -36,7 +61,13 @@
 #define FTFIX2DBL(a) ((double) (a) / 0x10000)
 #define DBL2FTFIX(a) ((double) (a) * 0x10000)
 
+/* Ractors (and the flag marking objects shareable when frozen) are new in Ruby 3.0 */
+#ifndef RUBY_TYPED_FROZEN_SHAREABLE
+#define RUBY_TYPED_FROZEN_SHAREABLE 0
+#endif /* RUBY_TYPED_FROZEN_SHAREABLE */
+
 static FT_Library library;
+static VALUE library_thread = Qnil;  /* the thread using `library' */
 static VALUE mFt2,
              mBBox,         /* GlyphBBox */
              mEnc,          /* encoding */
@@ -51,9 +82,14 @@ static VALUE mFt2,
 
              cBitmap,
              cBitmapGlyph,
+             cCache,
+             cCatalog,
              cCharMap,
              cFace,
+             cFaceCache,
+             cFontStack,
              cGlyph,
+             cGlyphCache,
              cGlyphClass,
              cGlyphSlot,
              cGlyphMetrics,
@@ -66,10 +102,127 @@ static VALUE mFt2,
              cSize,
              cSizeMetrics;
 
+/*
+ * The data of every FT2::Face object.  The FT_Face comes first, so the
+ * data pointer can also be used as a FT_Face *.
+ */
+typedef struct {
+  FT_Face    face;
+  FT_Library library;   /* referenced for as long as the face lives */
+  FT_Size    size,      /* used by this object; NULL for the default */
+             own_size;  /* created for this object by FT2::Face#share */
+  VALUE      views[3];  /* cached glyph slot, size and charmap views */
+} Face;
+
+enum { FACE_VIEW_GLYPH, FACE_VIEW_SIZE, FACE_VIEW_CHARMAP };
+
+/*
+ * The data of every FT2::Glyph object.  The FT_Glyph comes first, so
+ * the data pointer can also be used as a FT_Glyph *.
+ */
+typedef struct {
+  FT_Glyph   glyph;
+  FT_Library library;   /* referenced, the glyph is freed through it */
+} Glyph;
+
 static void face_free(void *ptr);
-static void glyph_free(void *ptr);
+static VALUE glyph_wrap(VALUE klass, FT_Glyph ft_glyph);
+static void io_stream_check(FT_Face face);
+static void cache_atfork_child(void);
+
+/*
+ * The data of the objects viewing a FreeType structure owned by another
+ * object (a face's glyph slot, a glyph's bitmap, and so on).  The
+ * pointer comes first, so the data pointer of views of a handle (e.g.
+ * a FT_GlyphSlot) can also be used as a pointer to that handle.  The
+ * owner is marked, so the structure can't be freed under the view.
+ */
+typedef struct {
+  void  *ptr;
+  VALUE  owner;
+  VALUE  views[3];  /* cached views of parts of `ptr' (see view_cached) */
+} View;
+
+/* the views a GlyphSlot caches; a Size only caches its metrics */
+enum { VIEW_METRICS, VIEW_BITMAP, VIEW_OUTLINE };
+
+static void view_mark(void *ptr) {
+  View *view = (View *) ptr;
+  int i;
+
+  rb_gc_mark_movable(view->owner);
+  for (i = 0; i < 3; i++)
+    rb_gc_mark_movable(view->views[i]);
+}
+
+static size_t view_memsize(const void *ptr) {
+  UNUSED(ptr);
+  return sizeof(View);
+}
+
+static void view_compact(void *ptr) {
+  View *view = (View *) ptr;
+  int i;
+
+  view->owner = rb_gc_location(view->owner);
+  for (i = 0; i < 3; i++)
+    view->views[i] = rb_gc_location(view->views[i]);
+}
+
+#define VIEW_DATA_TYPE(name) { \
+  (name), \
+  { view_mark, RUBY_TYPED_DEFAULT_FREE, view_memsize, view_compact, }, \
+  0, 0, \
+  RUBY_TYPED_FROZEN_SHAREABLE | RUBY_TYPED_FREE_IMMEDIATELY | \
+  RUBY_TYPED_WB_PROTECTED, \
+}
+
+static const rb_data_type_t glyphslot_type = VIEW_DATA_TYPE("FT2::GlyphSlot");
+static const rb_data_type_t size_type = VIEW_DATA_TYPE("FT2::Size");
+static const rb_data_type_t charmap_type = VIEW_DATA_TYPE("FT2::CharMap");
+static const rb_data_type_t bitmap_type = VIEW_DATA_TYPE("FT2::Bitmap");
+static const rb_data_type_t outline_type = VIEW_DATA_TYPE("FT2::Outline");
+static const rb_data_type_t glyph_metrics_type = VIEW_DATA_TYPE("FT2::GlyphMetrics");
+static const rb_data_type_t size_metrics_type = VIEW_DATA_TYPE("FT2::SizeMetrics");
+static const rb_data_type_t glyph_class_type = VIEW_DATA_TYPE("FT2::GlyphClass");
+
+/* wrap `ptr' in a new view of class `klass', kept valid by `owner' */
+static VALUE view_wrap(VALUE klass, const rb_data_type_t *type, void *ptr, VALUE owner) {
+  View *view;
+  VALUE self;
+
+  self = TypedData_Make_Struct(klass, View, type, view);
+  view->ptr = ptr;
+  RB_OBJ_WRITE(self, &view->owner, owner);
+
+  return self;
+}
+
+static View *view_get(VALUE self, const rb_data_type_t *type) {
+  View *view;
+  TypedData_Get_Struct(self, View, type, view);
+  return view;
+}
 
-static void dont_free(void *ptr) { UNUSED(ptr); }
+/*
+ * Return the view of `ptr' that `holder' caches in `*cache', creating
+ * it first if there's none yet or the cached one views something else
+ * (e.g. after the active size changed).  Frozen holders may be shared
+ * between Ractors, so they hand out a new view every time instead.
+ */
+static VALUE view_cached(VALUE holder, VALUE *cache, VALUE klass,
+                         const rb_data_type_t *type, void *ptr, VALUE owner) {
+  VALUE view;
+
+  if (RTEST(*cache) && ((View *) RTYPEDDATA_DATA(*cache))->ptr == ptr)
+    return *cache;
+
+  view = view_wrap(klass, type, ptr, owner);
+  if (!RB_OBJ_FROZEN(holder))
+    RB_OBJ_WRITE(holder, cache, view);
+
+  return view;
+}
 
 static void handle_error(FT_Error err) {
 #undef __FTERRORS_H__
@@ -106,1521 +259,7679 @@ static VALUE ft_version(VALUE klass) {
   return rb_str_new2(buf);
 }
 
-
 /***********************/
-/* FT2::Bitmap methods */
+/* FT2::Memory methods */
 /***********************/
 
 /*
- * Constructor for FT2::Bitmap.
- *
- * This method is currently empty.  You should never call this method
- * directly unless you're instantiating a derived class (ie, you know
- * what you're doing).
- *
+ * FT_Memory allocators for FreeType libraries.  Every block carries a
+ * small header recording its size, since FreeType's free callback
+ * isn't told the size of the block it frees.
+ *
+ * A plain allocator uses malloc(3), and only keeps count.  An arena
+ * allocator bumps through large chunks instead.  Freeing the last
+ * block of a chunk gives its space back, and a chunk whose blocks have
+ * all been freed is recycled as a whole, so scratch memory (a glyph
+ * being rendered, a face opened for one job) is reused rather than
+ * returned to malloc.
+ *
+ * Allocations happen without the GVL, so changes in the native memory
+ * held are collected in memory_gc_pending and reported to the GC with
+ * rb_gc_adjust_memory_usage() the next time the GVL is held (see
+ * memory_gc_flush).  The counters are updated atomically, so a plain
+ * allocator takes no lock; the lock only guards the chunks of an
+ * arena.
  */
-static VALUE ft_bitmap_init(VALUE self) {
+typedef struct MemoryChunk {
+  struct MemoryChunk *next;
+  size_t  size,
+          used;
+  long    live;     /* blocks not yet freed */
+} MemoryChunk;
+
+typedef struct {
+  size_t       size;
+  MemoryChunk *chunk;   /* NULL for a plain allocator */
+} MemoryBlock;
+
+typedef struct Memory {
+  struct FT_MemoryRec_  memory;       /* memory.user points back here */
+  pthread_mutex_t       lock;         /* for the arena */
+  size_t                chunk_size;   /* 0 for a plain allocator */
+  MemoryChunk          *chunks,       /* current chunk first */
+                       *spare;        /* an empty chunk, for reuse */
+  size_t                arena_bytes;
+  size_t                bytes,        /* atomic */
+                        peak_bytes;   /* atomic */
+  unsigned long         allocations;  /* atomic */
+  long                  refs;         /* atomic: blocks not yet freed, plus
+                                         one for the FT2::Memory object */
+  struct Memory        *next;         /* in the list of all allocators */
+} Memory;
+
+#define MEMORY_ALIGN        16
+#define MEMORY_ROUND(n)     (((n) + MEMORY_ALIGN - 1) & ~((size_t) MEMORY_ALIGN - 1))
+#define MEMORY_HEADER       MEMORY_ROUND(sizeof(MemoryBlock))
+#define MEMORY_CHUNK_START  MEMORY_ROUND(sizeof(MemoryChunk))
+
+static long memory_gc_pending = 0;
+static Memory *default_memory;
+static Memory *memories = NULL;     /* every live allocator, for fork */
+static pthread_mutex_t memories_lock = PTHREAD_MUTEX_INITIALIZER;
+static VALUE default_memory_object = Qnil;
+
+static void memory_gc_account(long diff) {
+  __atomic_add_fetch(&memory_gc_pending, diff, __ATOMIC_RELAXED);
+}
+
+/* report native memory changes to the GC; requires the GVL */
+static void memory_gc_flush(void) {
+  long diff = __atomic_exchange_n(&memory_gc_pending, 0, __ATOMIC_RELAXED);
+
+  if (diff)
+    rb_gc_adjust_memory_usage(diff);
+}
+
+static void memory_chunk_free(Memory *mem, MemoryChunk *chunk) {
+  mem->arena_bytes -= chunk->size;
+  memory_gc_account(-(long) chunk->size);
+  free(chunk);
+}
+
+static void memory_destroy(Memory *mem) {
+  MemoryChunk *chunk;
+  Memory **p;
+
+  pthread_mutex_lock(&memories_lock);
+  for (p = &memories; *p; p = &(*p)->next) {
+    if (*p == mem) {
+      *p = mem->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&memories_lock);
+
+  while ((chunk = mem->chunks) != NULL) {
+    mem->chunks = chunk->next;
+    memory_chunk_free(mem, chunk);
+  }
+  if (mem->spare)
+    memory_chunk_free(mem, mem->spare);
+  pthread_mutex_destroy(&mem->lock);
+  free(mem);
+}
+
+/* carve a block out of the arena; call with the lock held */
+static MemoryBlock *memory_arena_alloc(Memory *mem, size_t need) {
+  MemoryChunk *chunk = mem->chunks;
+  size_t size;
+
+  if (!chunk || chunk->size - chunk->used < need) {
+    size = MEMORY_CHUNK_START + need;
+    if (size < mem->chunk_size)
+      size = mem->chunk_size;
+
+    if (mem->spare && mem->spare->size >= size) {
+      chunk = mem->spare;
+      mem->spare = NULL;
+    } else if ((chunk = malloc(size)) != NULL) {
+      chunk->size = size;
+      mem->arena_bytes += size;
+      memory_gc_account(size);
+    } else {
+      return NULL;
+    }
+
+    chunk->used = MEMORY_CHUNK_START;
+    chunk->live = 0;
+    chunk->next = mem->chunks;
+    mem->chunks = chunk;
+  }
+
+  chunk->used += need;
+  chunk->live++;
+  ((MemoryBlock *) ((char *) chunk + chunk->used - need))->chunk = chunk;
+
+  return (MemoryBlock *) ((char *) chunk + chunk->used - need);
+}
+
+/* give a block back to the arena; call with the lock held */
+static void memory_arena_release(Memory *mem, MemoryBlock *block, size_t need) {
+  MemoryChunk *chunk = block->chunk, **p;
+
+  if ((char *) block + need == (char *) chunk + chunk->used)
+    chunk->used -= need;
+  if (--chunk->live > 0)
+    return;
+
+  if (chunk == mem->chunks) {
+    chunk->used = MEMORY_CHUNK_START;
+    return;
+  }
+
+  for (p = &mem->chunks; *p != chunk; p = &(*p)->next)
+    ;
+  *p = chunk->next;
+
+  if (!mem->spare) {
+    mem->spare = chunk;
+  } else if (chunk->size > mem->spare->size) {
+    memory_chunk_free(mem, mem->spare);
+    mem->spare = chunk;
+  } else {
+    memory_chunk_free(mem, chunk);
+  }
+}
+
+static void memory_count(Memory *mem, long diff) {
+  size_t bytes = __atomic_add_fetch(&mem->bytes, (size_t) diff, __ATOMIC_RELAXED),
+         peak = __atomic_load_n(&mem->peak_bytes, __ATOMIC_RELAXED);
+
+  while (bytes > peak &&
+         !__atomic_compare_exchange_n(&mem->peak_bytes, &peak, bytes, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/* drop a reference; the last one (a block or the object) destroys `mem' */
+static void memory_unref(Memory *mem) {
+  if (__atomic_sub_fetch(&mem->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    memory_destroy(mem);
+}
+
+static void *memory_alloc(FT_Memory memory, long size) {
+  Memory *mem = (Memory *) memory->user;
+  size_t need = MEMORY_HEADER + MEMORY_ROUND((size_t) size);
+  MemoryBlock *block;
+
+  if (mem->chunk_size) {
+    pthread_mutex_lock(&mem->lock);
+    block = memory_arena_alloc(mem, need);
+    pthread_mutex_unlock(&mem->lock);
+  } else if ((block = malloc(need)) != NULL) {
+    block->chunk = NULL;
+    memory_gc_account(need);
+  }
+  if (block) {
+    block->size = size;
+    memory_count(mem, size);
+    __atomic_add_fetch(&mem->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mem->refs, 1, __ATOMIC_RELAXED);
+  }
+
+  return block ? (char *) block + MEMORY_HEADER : NULL;
+}
+
+static void memory_free(FT_Memory memory, void *ptr) {
+  Memory *mem = (Memory *) memory->user;
+  MemoryBlock *block = (MemoryBlock *) ((char *) ptr - MEMORY_HEADER);
+  size_t need = MEMORY_HEADER + MEMORY_ROUND(block->size);
+
+  memory_count(mem, -(long) block->size);
+  if (block->chunk) {
+    pthread_mutex_lock(&mem->lock);
+    memory_arena_release(mem, block, need);
+    pthread_mutex_unlock(&mem->lock);
+  } else {
+    memory_gc_account(-(long) need);
+    free(block);
+  }
+
+  /* the last library using an unreferenced allocator may be gone */
+  memory_unref(mem);
+}
+
+static void *memory_realloc(FT_Memory memory, long cur_size, long new_size, void *ptr) {
+  Memory *mem = (Memory *) memory->user;
+  MemoryBlock *block = (MemoryBlock *) ((char *) ptr - MEMORY_HEADER), *new_block;
+  MemoryChunk *chunk = block->chunk;
+  size_t cur_need = MEMORY_HEADER + MEMORY_ROUND((size_t) cur_size),
+         new_need = MEMORY_HEADER + MEMORY_ROUND((size_t) new_size);
+
+  if (!chunk) {
+    if ((new_block = realloc(block, new_need)) != NULL)
+      memory_gc_account((long) new_need - (long) cur_need);
+  } else {
+    pthread_mutex_lock(&mem->lock);
+    if (new_need <= cur_need) {
+      new_block = block;
+    } else if ((char *) block + cur_need == (char *) chunk + chunk->used &&
+               chunk->size - chunk->used >= new_need - cur_need) {
+      /* the last block of a chunk can simply grow */
+      chunk->used += new_need - cur_need;
+      new_block = block;
+    } else if ((new_block = memory_arena_alloc(mem, new_need)) != NULL) {
+      memcpy((char *) new_block + MEMORY_HEADER, ptr, cur_size);
+      memory_arena_release(mem, block, cur_need);
+    }
+    pthread_mutex_unlock(&mem->lock);
+  }
+
+  if (new_block) {
+    new_block->size = new_size;
+    memory_count(mem, new_size - cur_size);
+  }
+
+  return new_block ? (char *) new_block + MEMORY_HEADER : NULL;
+}
+
+static Memory *memory_new(size_t chunk_size) {
+  Memory *mem;
+
+  if ((mem = malloc(sizeof(Memory))) == NULL)
+    rb_memerror();
+  memset(mem, 0, sizeof(Memory));
+  mem->memory.user = mem;
+  mem->memory.alloc = memory_alloc;
+  mem->memory.free = memory_free;
+  mem->memory.realloc = memory_realloc;
+  mem->chunk_size = chunk_size;
+  mem->refs = 1;
+  pthread_mutex_init(&mem->lock, NULL);
+
+  pthread_mutex_lock(&memories_lock);
+  mem->next = memories;
+  memories = mem;
+  pthread_mutex_unlock(&memories_lock);
+
+  return mem;
+}
+
+/* create a FreeType library allocating from `mem' */
+static FT_Error memory_new_library(Memory *mem, FT_Library *lib) {
+  FT_Error err;
+
+  if ((err = FT_New_Library(&mem->memory, lib)) != FT_Err_Ok)
+    return err;
+  FT_Add_Default_Modules(*lib);
+  FT_Set_Default_Properties(*lib);
+
+  return FT_Err_Ok;
+}
+
+static void ft_memory_free(void *ptr) {
+  Memory *mem = *((Memory **) ptr);
+
+  /* libraries created with it may still be alive */
+  if (mem && mem != default_memory)
+    memory_unref(mem);
+  xfree(ptr);
+}
+
+/* the blocks themselves are reported through rb_gc_adjust_memory_usage */
+static size_t ft_memory_memsize(const void *ptr) {
+  UNUSED(ptr);
+  return sizeof(Memory *) + sizeof(Memory);
+}
+
+/* frozen allocators may be shared between Ractors; they're read only */
+static const rb_data_type_t memory_type = {
+  "FT2::Memory",
+  { 0, ft_memory_free, ft_memory_memsize, },
+  0, 0,
+  RUBY_TYPED_FROZEN_SHAREABLE | RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
+
+static VALUE ft_memory_alloc(VALUE klass) {
+  Memory **mem;
+  VALUE self;
+
+  self = TypedData_Make_Struct(klass, Memory *, &memory_type, mem);
+  *mem = NULL;
+
   return self;
 }
 
+static Memory *memory_get(VALUE self) {
+  Memory **mem;
+
+  TypedData_Get_Struct(self, Memory *, &memory_type, mem);
+  if (!*mem)
+    rb_raise(eFt2Error, "Uninitialized FT2::Memory.");
+  return *mem;
+}
+
 /*
- * Return the number of rows in a FT2::Bitmap object.
+ * Constructor for FT2::Memory.
+ *
+ * Description:
+ *   Creates a new allocator for FreeType libraries (see
+ *   FT2::Library.new).  Every allocator keeps track of the memory
+ *   used by its libraries, and of their faces, glyphs and so on, and
+ *   reports it to Ruby's garbage collector.
+ *
+ *   By default blocks are allocated with malloc(3).  With the `arena'
+ *   option, blocks are carved out of chunks of (at least) `arena'
+ *   bytes instead, which are reused rather than returned to malloc
+ *   once every block has been freed.  This suits short-lived
+ *   libraries, e.g. one per rendering job, which allocate and free a
+ *   lot of scratch memory.
+ *
+ * Note:
+ *   Memory freed in an arena is only reused once all of it has been
+ *   freed (except for the most recent block), so an arena is a poor
+ *   fit for a library which lives for the whole process.
  *
  * Examples:
- *   rows = bitmap.rows
+ *   mem = FT2::Memory.new
+ *   mem = FT2::Memory.new arena: 256 * 1024
+ *   lib = FT2::Library.new memory: mem
  *
  */
-static VALUE ft_bitmap_rows(VALUE self) {
-  FT_Bitmap *bitmap;
-  Data_Get_Struct(self, FT_Bitmap, bitmap);
-  return INT2FIX(bitmap->rows);
+static VALUE ft_memory_init(int argc, VALUE *argv, VALUE self) {
+  VALUE opts, arena = Qundef;
+  ID kw_arena;
+  Memory **mem;
+  long chunk_size = 0;
+
+  rb_scan_args(argc, argv, ":", &opts);
+  if (opts != Qnil) {
+    kw_arena = rb_intern("arena");
+    rb_get_kwargs(opts, &kw_arena, 0, 1, &arena);
+  }
+  if (arena != Qundef && arena != Qnil) {
+    if ((chunk_size = NUM2LONG(arena)) < 1024)
+      rb_raise(rb_eArgError, "Invalid arena size: %ld.", chunk_size);
+  }
+
+  TypedData_Get_Struct(self, Memory *, &memory_type, mem);
+  if (*mem)
+    rb_raise(eFt2Error, "FT2::Memory already initialized.");
+  *mem = memory_new(chunk_size);
+
+  return self;
 }
 
 /*
- * Return the width of an FT2::Bitmap object.
+ * Return the allocator used by default FT2::Library instances.
  *
  * Examples:
- *   width = bitmap.width
+ *   puts FT2::Memory.default.bytes
  *
  */
-static VALUE ft_bitmap_width(VALUE self) {
-  FT_Bitmap *bitmap;
-  Data_Get_Struct(self, FT_Bitmap, bitmap);
-  return INT2FIX(bitmap->width);
+static VALUE ft_memory_default(VALUE klass) {
+  UNUSED(klass);
+  return default_memory_object;
 }
 
 /*
- * Return the pitch (bytes per row) of an FT2::Bitmap object.
- *
- * Return the pitch (bytes per row, including alignment padding) of an
- * FT2::Bitmap object.
+ * Return the number of bytes allocated and not yet freed.
  *
  * Examples:
- *   width = bitmap.width
+ *   puts mem.bytes
  *
  */
-static VALUE ft_bitmap_pitch(VALUE self) {
-  FT_Bitmap *bitmap;
-  Data_Get_Struct(self, FT_Bitmap, bitmap);
-  return INT2FIX(bitmap->pitch);
+static VALUE ft_memory_bytes(VALUE self) {
+  Memory *mem = memory_get(self);
+  return SIZET2NUM(__atomic_load_n(&mem->bytes, __ATOMIC_RELAXED));
 }
 
 /*
- * Return the buffer (e.g. raw pixel data) of an FT2::Bitmap object.
+ * Return the largest number of bytes ever allocated at once.
  *
  * Examples:
- *   # return the rendered pixels as a binary string
- *   buffer = bitmap.buffer
- *
- *   # assume a render method called render_font(buffer, width, height)
- *   render_font(bitmap.buffer, bitmap.width, bitmap.rows)
+ *   puts mem.peak_bytes
  *
  */
-static VALUE ft_bitmap_buffer(VALUE self) {
-  FT_Bitmap *bitmap;
-  Data_Get_Struct(self, FT_Bitmap, bitmap);
-  return rb_str_new((char*) bitmap->buffer, ABS(bitmap->pitch) * bitmap->rows);
+static VALUE ft_memory_peak_bytes(VALUE self) {
+  Memory *mem = memory_get(self);
+  return SIZET2NUM(__atomic_load_n(&mem->peak_bytes, __ATOMIC_RELAXED));
 }
 
 /*
- * Return the number of grays in an FT2::Bitmap object.
- *
- * Note:
- *   Only used if Ft2::Bitmap#pixel_mode is FT2::PixelMode::GRAYS.
+ * Return the number of blocks allocated and not yet freed.
  *
  * Examples:
- *   depth = bitmap.num_grays
+ *   puts mem.blocks
  *
  */
-static VALUE ft_bitmap_num_grays(VALUE self) {
-  FT_Bitmap *bitmap;
-  Data_Get_Struct(self, FT_Bitmap, bitmap);
-  return INT2FIX(bitmap->num_grays);
+static VALUE ft_memory_blocks(VALUE self) {
+  Memory *mem = memory_get(self);
+  /* less the reference of the object itself */
+  return LONG2NUM(__atomic_load_n(&mem->refs, __ATOMIC_RELAXED) - 1);
 }
 
 /*
- * Return the pixel mode (e.g. bit depth) of an FT2::Bitmap object.
- *
- * Note:
- *   Always returns one of the values avaiable in FT2::PixelMode (for a
- *   full list, try the following code: "p FT2::PixelMode.constants.sort")
+ * Return the total number of allocations made.
  *
  * Examples:
- *   case bitmap.pixel_mode
- *   when FT2::PixelMode::RGB32
- *     puts "wow that's a lot of colors!"
- *   when FT2::PixelMode::MONO
- *     puts "time to get a better monitor..."
- *   end
+ *   puts mem.allocations
  *
  */
-static VALUE ft_bitmap_pixel_mode(VALUE self) {
-  FT_Bitmap *bitmap;
-  Data_Get_Struct(self, FT_Bitmap, bitmap);
-  return INT2FIX(bitmap->pixel_mode);
+static VALUE ft_memory_allocations(VALUE self) {
+  Memory *mem = memory_get(self);
+  return ULONG2NUM(__atomic_load_n(&mem->allocations, __ATOMIC_RELAXED));
 }
 
 /*
- * Return the palette mode of an FT2::Bitmap object.
- *
- * Note:
- *   Always returns one of the values avaiable in FT2::PaletteMode.
+ * Return the number of bytes reserved by an arena allocator, or nil
+ * for a plain allocator.
  *
  * Examples:
- *   case bitmap.palette_mode
- *   when FT2::PaletteMode::RGBA
- *     puts "we have an alpha channel!"
- *   when FT2::PaletteMode::RGB
- *     puts "no alpha channel for you"
- *   end
+ *   puts mem.arena_bytes
  *
  */
-static VALUE ft_bitmap_palette_mode(VALUE self) {
-  FT_Bitmap *bitmap;
-  Data_Get_Struct(self, FT_Bitmap, bitmap);
-  return INT2FIX(bitmap->palette_mode);
+static VALUE ft_memory_arena_bytes(VALUE self) {
+  Memory *mem = memory_get(self);
+  size_t bytes;
+
+  if (!mem->chunk_size)
+    return Qnil;
+
+  pthread_mutex_lock(&mem->lock);
+  bytes = mem->arena_bytes;
+  pthread_mutex_unlock(&mem->lock);
+
+  return SIZET2NUM(bytes);
 }
 
+/***********/
+/* Locking */
+/***********/
+
 /*
- * Return the palette of an FT2::Bitmap object.
- *
- * Note:
- *   Returns a binary string of RGB or RGBA elements (check
- *   FT2::Bitmap#palette_mode to determine which).
- *
- * Examples:
- *   case bitmap.palette_mode
- *   when FT2::PaletteMode::RGBA
- *     rgba_palette_string = bitmap.palette
- *   when FT2::PaletteMode::RGB
- *     rgb_palette_string = bitmap.palette
- *   end
- *
+ * FreeType allows a FT_Face to be used by only one thread at a time,
+ * and calls creating or destroying faces (FT_Open_Face, FT_Done_Face)
+ * must be serialized per library.  Slow FreeType calls run without the
+ * GVL, so the GVL no longer provides either guarantee.
+ *
+ * Faces and libraries are shared by several Ruby objects (see
+ * FT2::FaceCache and FT2::GlyphSlot#face), so the locks can't live in
+ * the wrappers; instead each face or library maps onto one of a fixed
+ * set of mutexes by address.  The reference counts of faces and
+ * libraries aren't atomic either, so they too are only changed with
+ * the library lock held; this is also what makes sharing faces and
+ * libraries between Ractors (which run in parallel) safe.
+ *
+ * A thread must never wait for one of these locks while holding the
+ * GVL: the holder may need the GVL to finish (a FT2::Face.from_io face
+ * reads its IO through Ruby).  Locks are tried first, and waited for
+ * with the GVL released if that fails.  Faces and libraries freed by
+ * the GC can't wait at all; if the library is busy, they are queued
+ * and released by the next thread opening or freeing a face under it.
+ * Destroying a size (see FT2::Face#share) also needs the face lock,
+ * which is taken after the library lock, and only ever tried.
  */
-static VALUE ft_bitmap_palette(VALUE self) {
-  FT_Bitmap *bitmap;
-  /* int size; */
-  Data_Get_Struct(self, FT_Bitmap, bitmap);
+#define LOCK_STRIPES 64
+
+static pthread_mutex_t face_locks[LOCK_STRIPES],
+                       library_locks[LOCK_STRIPES],
+                       pending_faces_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct PendingFace {
+  FT_Face     face;       /* NULL to release only the library */
+  FT_Size     size;       /* a size of `face' to destroy, or NULL */
+  FT_Library  library;
+  struct PendingFace *next;
+} PendingFace;
+
+static PendingFace *pending_faces = NULL;
+
+static void pending_faces_push(PendingFace *pending) {
+  pthread_mutex_lock(&pending_faces_lock);
+  pending->next = pending_faces;
+  pending_faces = pending;
+  pthread_mutex_unlock(&pending_faces_lock);
+}
 
-  return Qnil;
-  /* FIXME i don't know how big the palette memory is, so i'll just
-   * assume it's 256 entries :/
-   *
-   * none of this shit compiles, so I'm disabling it for now.
-  if (bitmap->palette_mode == ft_palette_mode_rgb)
-    size = 3 * 256;
-  else if (bitmap->palette_mode == ft_palette_mode_rgba)
-    size = 4 * 256;
-  else
-    rb_raise(rb_eException, "Unknown palette mode: %d.",
-             INT2FIX(bitmap->palette_mode));
+static unsigned int lock_stripe(const void *ptr) {
+  uintptr_t addr = (uintptr_t) ptr;
+  /* FreeType objects are heap allocated, so the low bits carry little */
+  return (unsigned int) ((addr >> 4) ^ (addr >> 12)) % LOCK_STRIPES;
+}
 
-  return rb_str_new(bitmap->palette, size); */
+typedef struct {
+  void *(*func)(void *);
+  void   *data,
+         *rtn;
+  int     done;
+} NoGVLCall;
+
+static void *nogvl_call_func(void *ptr) {
+  NoGVLCall *call = (NoGVLCall *) ptr;
+  call->rtn = call->func(call->data);
+  call->done = 1;
+  return NULL;
 }
 
-/*********************/
-/* FT2::Face methods */
-/*********************/
-static void face_free(void *ptr) {
-  FT_Face  face = *((FT_Face *) ptr);
-  FT_Error err;
+/*
+ * Call `func' without the GVL.  Unlike rb_thread_call_without_gvl(),
+ * pending interrupts (Thread#raise, etc) are handled before `func'
+ * runs and never after, so a lock taken or a face opened by `func' is
+ * never lost to an exception.
+ */
+static void *nogvl_call(void *(*func)(void *), void *data) {
+  NoGVLCall call;
+
+  call.func = func;
+  call.data = data;
+  call.rtn = NULL;
+  call.done = 0;
+
+  for (;;) {
+#ifdef HAVE_RB_NOGVL
+    rb_nogvl(nogvl_call_func, &call, NULL, NULL, RB_NOGVL_INTR_FAIL);
+#else
+    /* the same, before Ruby 2.6: returns without calling func if interrupted */
+    rb_thread_call_without_gvl2(nogvl_call_func, &call, NULL, NULL);
+#endif /* HAVE_RB_NOGVL */
+    if (call.done) {
+      memory_gc_flush();
+      return call.rtn;
+    }
+    rb_thread_check_ints();
+  }
+}
 
-  if ((err = FT_Done_Face(face)) != FT_Err_Ok)
-    handle_error(err);
-  free(ptr);
+static void *lock_wait(void *mutex) {
+  pthread_mutex_lock((pthread_mutex_t *) mutex);
+  return NULL;
 }
 
+/* lock `mutex', releasing the GVL while waiting for it */
+static void lock_acquire(pthread_mutex_t *mutex) {
+  if (pthread_mutex_trylock(mutex) != 0)
+    nogvl_call(lock_wait, mutex);
+}
+
+#define face_lock(face)      (&face_locks[lock_stripe(face)])
+#define library_lock(lib)    (&library_locks[lock_stripe(lib)])
+
 /*
- * Allocate and initialize a new FT2::Face object.
- *
- * Note:
- *   FreeType2-Ruby creates a new (hidden) FT2::Library instance at
- *   runtime, which FT2::Face objects are automatically initialized with
- *   if an a library is not specified.
- *
- * Aliases:
- *   FT2::Face.load
- *
- * Examples:
- *   # load font from file "yudit.ttf"
- *   face = FT2::Face.new 'yudit.ttf'
- *
- *   # load second face from from file "yudit.ttf"
- *   face = FT2::Face.new 'yudit.ttf', 1
- *
- *   # load font from file "yudit.ttf" under FT2::Library instance lib
- *   face = FT2::Face.new lib, 'yudit.ttf'
- *
- *   # load second face from file "yudit.ttf" under FT2::Library instance lib
- *   face = FT2::Face.new lib, 'yudit.ttf', 1
+ * Release the queued faces whose library maps to the (held) library
+ * lock `stripe'.  Requires the GVL, as face finalizers may call Ruby
+ * (see pinned_object_release).
  */
-VALUE ft_face_new(int argc, VALUE *argv, VALUE klass) {
-  VALUE self, path;
-  FT_Library *lib;
-  FT_Face *face;
-  FT_Error err;
-  FT_Long face_index;
-
-  lib = &library;
-  switch (argc) {
-    case 1:
-      path = argv[0];
-      face_index = 0;
-      break;
-    case 2:
-      if (rb_obj_is_kind_of(argv[0], rb_cString)) {
-        path = argv[0];
-        face_index = NUM2INT(argv[1]);
-      } else if (rb_obj_is_kind_of(argv[0], cLibrary)) {
-        Data_Get_Struct(argv[0], FT_Library, lib);
-        path = argv[0];
-        face_index = 0;
-      } else {
-        rb_raise(rb_eArgError, "Invalid first argument.");
+static void pending_faces_drain(unsigned int stripe) {
+  PendingFace **p, *pending, *done = NULL;
+
+  pthread_mutex_lock(&pending_faces_lock);
+  for (p = &pending_faces; *p; ) {
+    pending = *p;
+    if (lock_stripe(pending->library) == stripe) {
+      *p = pending->next;
+      pending->next = done;
+      done = pending;
+    } else {
+      p = &pending->next;
+    }
+  }
+  pthread_mutex_unlock(&pending_faces_lock);
+
+  while (done) {
+    pending = done;
+    done = done->next;
+    if (pending->size) {
+      if (pthread_mutex_trylock(face_lock(pending->face)) != 0) {
+        /* the face is busy; leave it to the next drain */
+        pending_faces_push(pending);
+        continue;
       }
-      break;
-    case 3:
-      Data_Get_Struct(argv[0], FT_Library, lib);
-      path = argv[1];
-      face_index = NUM2INT(argv[1]);
-      break;
-    default:
-      rb_raise(rb_eArgError, "Invalid argument count: %d.", argc);
+      FT_Done_Size(pending->size);
+      pthread_mutex_unlock(face_lock(pending->face));
+    }
+    if (pending->face)
+      FT_Done_Face(pending->face);
+    FT_Done_Library(pending->library);
+    free(pending);
   }
+}
 
-  face = malloc(sizeof(FT_Face));
-  err = FT_New_Face(*lib, RSTRING_PTR(path), face_index, face);
-  if (err != FT_Err_Ok)
-    handle_error(err);
-
-  self = Data_Wrap_Struct(klass, 0, face_free, face);
-  rb_obj_call_init(self, 0, NULL);
+/* unlock a library lock, first destroying any faces queued on it */
+static void library_unlock(FT_Library lib) {
+  pending_faces_drain(lock_stripe(lib));
+  pthread_mutex_unlock(library_lock(lib));
+}
 
-  return self;
+/* destroy queued faces of `lib', unless another thread will */
+static void library_flush(FT_Library lib) {
+  if (pthread_mutex_trylock(library_lock(lib)) == 0)
+    library_unlock(lib);
 }
 
 /*
- * Allocate and initialize a new FT2::Face object from in-memory buffer.
- *
- * Note:
- *   FreeType2-Ruby creates a new (hidden) FT2::Library instance at
- *   runtime, which FT2::Face objects are automatically initialized with
- *   if an a library is not specified.
- *
- * Examples:
- *   # load font from string _buffer_
- *   face = FT2::Face.new buffer, buffer_size
- *
- *   # load second face from string _buffer_
- *   face = FT2::Face.new buffer, buffer_size, 1
- *
- *   # load font from string _buffer_ under FT2::Library instance _lib_
- *   face = FT2::Face.new lib, buffer, buffer_size
- *
- *   # load second face from string _buffer_ under FT2::Library instance _lib_
- *   face = FT2::Face.new lib, buffer, buffer_size, 1
+ * Take a reference to `face' (unless NULL) and one to its library
+ * `lib'.  May raise (while waiting for the lock) before taking them.
  */
-VALUE ft_face_new_from_memory(int argc, VALUE *argv, VALUE klass) {
-  VALUE self;
-  FT_Library *lib;
-  FT_Face *face;
-  FT_Error err;
-  FT_Long face_index;
-  void *mem;
-  int len;
+static void face_reference(FT_Face face, FT_Library lib) {
+  lock_acquire(library_lock(lib));
+  if (face)
+    FT_Reference_Face(face);
+  FT_Reference_Library(lib);
+  library_unlock(lib);
+}
 
-  lib = &library;
-  switch (argc) {
-    case 2:
-      mem = RSTRING_PTR(argv[0]);
-      len = NUM2INT(argv[1]);
-      face_index = 0;
-      break;
-    case 3:
-      if (rb_obj_is_kind_of(argv[0], rb_cString)) {
-        mem = RSTRING_PTR(argv[0]);
-        len = NUM2INT(argv[1]);
-        face_index = NUM2INT(argv[2]);
-      } else if (rb_obj_is_kind_of(argv[0], cLibrary)) {
-        Data_Get_Struct(argv[0], FT_Library, lib);
-        mem = RSTRING_PTR(argv[1]);
-        len = NUM2INT(argv[2]);
-        face_index = 0;
-      } else {
-        rb_raise(rb_eArgError, "Invalid first argument.");
+/*
+ * Destroy `size' (unless NULL), then drop one reference to `face'
+ * (unless NULL) and one to its library `lib'.  Safe to call from a
+ * free function.
+ */
+static FT_Error face_release(FT_Face face, FT_Size size, FT_Library lib) {
+  PendingFace *pending;
+  FT_Error err = FT_Err_Ok;
+
+  if (pthread_mutex_trylock(library_lock(lib)) == 0) {
+    if (!size || pthread_mutex_trylock(face_lock(face)) == 0) {
+      if (size) {
+        FT_Done_Size(size);
+        pthread_mutex_unlock(face_lock(face));
       }
-      break;
-    case 4:
-      Data_Get_Struct(argv[0], FT_Library, lib);
-      mem = RSTRING_PTR(argv[1]);
-      len = NUM2INT(argv[2]);
-      face_index = NUM2INT(argv[3]);
-      break;
-    default:
-      rb_raise(rb_eArgError, "Invalid argument count: %d.", argc);
+      if (face)
+        err = FT_Done_Face(face);
+      FT_Done_Library(lib);
+      library_unlock(lib);
+      return err;
+    }
+    library_unlock(lib);
   }
 
-  face = malloc(sizeof(FT_Face));
-  err = FT_New_Memory_Face(*lib, mem, len, face_index, face);
-  if (err != FT_Err_Ok)
-    handle_error(err);
+  /*
+   * out of memory: leak the references rather than wait for the locks,
+   * which may be held by a thread waiting for the GVL
+   */
+  if ((pending = malloc(sizeof(PendingFace))) == NULL)
+    return FT_Err_Out_Of_Memory;
+  pending->face = face;
+  pending->size = size;
+  pending->library = lib;
+  pending_faces_push(pending);
+
+  return FT_Err_Ok;
+}
 
-  self = Data_Wrap_Struct(klass, 0, face_free, face);
-  rb_obj_call_init(self, 0, NULL);
+typedef struct {
+  FT_Library     library;
+  FT_Open_Args  *args;
+  FT_Long        face_index;
+  FT_Face        face;
+  FT_Error       err;
+} FaceOpen;
 
-  return self;
+static void *face_open_nogvl(void *ptr) {
+  FaceOpen *op = (FaceOpen *) ptr;
+
+  pthread_mutex_lock(library_lock(op->library));
+  op->err = FT_Open_Face(op->library, op->args, op->face_index, &op->face);
+  if (op->err == FT_Err_Ok)
+    FT_Reference_Library(op->library);
+  pthread_mutex_unlock(library_lock(op->library));
+
+  return NULL;
 }
 
 /*
- * Constructor for FT2::Face.
+ * FT_Open_Face, without the GVL.  A successfully opened face comes
+ * with a reference to `lib', for the face's wrapper (see face_wrap).
  *
- * This method is currently empty.  You should never call this method
- * directly unless you're instantiating a derived class (ie, you know
- * what you're doing).
+ * Faces reading a Ruby stream (see FT2::Face.from_io) are opened with
+ * the GVL held, since the stream calls back into Ruby.
  *
+ * May raise (an interrupt, or while waiting for the library lock)
+ * before FreeType is called; see face_open_protect.
  */
-static VALUE ft_face_init(VALUE self) {
+static FT_Error face_open(FT_Library lib, FT_Open_Args *args, FT_Long face_index, FT_Face *face) {
+  FaceOpen op;
+
+  op.library = lib;
+  op.args = args;
+  op.face_index = face_index;
+  op.face = NULL;
+
+  if (args->flags & FT_OPEN_STREAM) {
+    lock_acquire(library_lock(lib));
+    op.err = FT_Open_Face(lib, args, face_index, &op.face);
+    if (op.err == FT_Err_Ok)
+      FT_Reference_Library(lib);
+    library_unlock(lib);
+  } else {
+    nogvl_call(face_open_nogvl, &op);
+    library_flush(lib);
+  }
+
+  *face = op.face;
+  return op.err;
+}
+
+/* FT_New_Face, without the GVL */
+static FT_Error face_open_path(FT_Library lib, const char *path, FT_Long face_index, FT_Face *face) {
+  FT_Open_Args args;
+
+  memset(&args, 0, sizeof(args));
+  args.flags = FT_OPEN_PATHNAME;
+  args.pathname = (char *) path;
+
+  return face_open(lib, &args, face_index, face);
+}
+
+static VALUE face_open_protected(VALUE ptr) {
+  FaceOpen *op = (FaceOpen *) ptr;
+  op->err = face_open(op->library, op->args, op->face_index, &op->face);
+  return Qnil;
+}
+
+/*
+ * face_open, but an exception raised before FreeType gets to open the
+ * face (an interrupt, or while waiting for the library lock) isn't
+ * raised but left in `state', so the caller can release the font data
+ * first.
+ */
+static FT_Error face_open_protect(FT_Library lib, FT_Open_Args *args, FT_Long face_index,
+                                  FT_Face *face, int *state) {
+  FaceOpen op;
+
+  op.library = lib;
+  op.args = args;
+  op.face_index = face_index;
+  op.face = NULL;
+  op.err = FT_Err_Ok;
+
+  *state = 0;
+  rb_protect(face_open_protected, (VALUE) &op, state);
+
+  *face = op.face;
+  return op.err;
+}
+
+/* FT_New_Memory_Face, without the GVL; see face_open_protect */
+static FT_Error face_open_memory_protect(FT_Library lib, const void *base, FT_Long size,
+                                         FT_Long face_index, FT_Face *face, int *state) {
+  FT_Open_Args args;
+
+  memset(&args, 0, sizeof(args));
+  args.flags = FT_OPEN_MEMORY;
+  args.memory_base = (const FT_Byte *) base;
+  args.memory_size = size;
+
+  return face_open_protect(lib, &args, face_index, face, state);
+}
+
+typedef struct {
+  FT_Face   face;
+  void   *(*func)(void *);
+  void     *data;
+} FaceCall;
+
+static void *face_call_nogvl(void *ptr) {
+  FaceCall *call = (FaceCall *) ptr;
+  void *rtn;
+
+  pthread_mutex_lock(face_lock(call->face));
+  rtn = call->func(call->data);
+  pthread_mutex_unlock(face_lock(call->face));
+
+  return rtn;
+}
+
+/*
+ * Call `func' with the lock of `face' held and, unless the face reads
+ * a Ruby stream, without the GVL.  `func' must not touch Ruby objects.
+ */
+static void *face_call(FT_Face face, void *(*func)(void *), void *data) {
+  FaceCall call;
+  void *rtn;
+
+  if (face->face_flags & FT_FACE_FLAG_EXTERNAL_STREAM) {
+    lock_acquire(face_lock(face));
+    rtn = func(data);
+    pthread_mutex_unlock(face_lock(face));
+    io_stream_check(face);
+    return rtn;
+  }
+
+  call.face = face;
+  call.func = func;
+  call.data = data;
+  return nogvl_call(face_call_nogvl, &call);
+}
+
+/************************/
+/* FT2::Library methods */
+/************************/
+static ID id_thread_library;
+
+static void library_free(void *ptr) {
+  FT_Library lib = *((FT_Library *) ptr);
+
+  /* faces hold their own reference, so this may not destroy it yet */
+  if (lib)
+    face_release(NULL, NULL, lib);
+  free(ptr);
+}
+
+static size_t library_memsize(const void *ptr) {
+  UNUSED(ptr);
+  return sizeof(FT_Library);
+}
+
+/* frozen libraries may be shared between Ractors */
+static const rb_data_type_t library_type = {
+  "FT2::Library",
+  { 0, library_free, library_memsize, },
+  0, 0,
+  RUBY_TYPED_FROZEN_SHAREABLE | RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
+
+static VALUE ft_library_alloc(VALUE klass) {
+  FT_Library *lib;
+
+  if ((lib = malloc(sizeof(FT_Library))) == NULL)
+    rb_memerror();
+  *lib = NULL;
+
+  return TypedData_Wrap_Struct(klass, &library_type, lib);
+}
+
+/* wrap an existing library, taking a new reference to it */
+static VALUE library_wrap(FT_Library ft_lib) {
+  VALUE self;
+  FT_Library *lib;
+
+  self = ft_library_alloc(cLibrary);
+  face_reference(NULL, ft_lib);
+  TypedData_Get_Struct(self, FT_Library, &library_type, lib);
+  *lib = ft_lib;
+
   return self;
 }
 
+static FT_Library library_get(VALUE self) {
+  FT_Library *lib;
+
+  TypedData_Get_Struct(self, FT_Library, &library_type, lib);
+  if (!*lib)
+    rb_raise(eFt2Error, "Uninitialized FT2::Library.");
+  return *lib;
+}
+
 /*
- * Return the number of faces in an FT2::Face object.
- *
- * Aliases:
- *   FT2::Face#num_faces
- *
- * Examples:
- *   num_faces = face.faces
- *
+ * Return the FreeType library used by the calling thread.
+ *
+ * Opening and freeing faces is serialized per library, so each Ruby
+ * thread gets its own (kept in a hidden instance variable of the
+ * thread, so it is shared by the thread's fibers, and released along
+ * with the thread).  The main thread of the main Ractor uses the
+ * library created when the extension was loaded; threads of other
+ * Ractors, their main threads included, always get their own.
  */
-static VALUE ft_face_faces(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->num_faces);
+static FT_Library current_library(void) {
+  VALUE thread, lib;
+
+  /* not rb_thread_main(), which is the main thread of the calling Ractor */
+  thread = rb_thread_current();
+  if (thread == library_thread)
+    return library;
+
+  lib = rb_attr_get(thread, id_thread_library);
+  if (lib == Qnil) {
+    lib = rb_class_new_instance(0, NULL, cLibrary);
+    rb_ivar_set(thread, id_thread_library, lib);
+  }
+
+  return library_get(lib);
 }
 
 /*
- * Return the index of an FT2::Face object in its font file.
+ * Constructor for FT2::Library.
  *
- * Note:
- *   This is almost always zero.
+ * Description:
+ *   Creates a new, independent FreeType library instance.  Faces
+ *   created under a library keep it alive, so a library may be
+ *   dropped while its faces are still in use.
  *
- * Aliases:
- *   FT2::Face#face_index
+ *   The library and everything created under it allocate memory from
+ *   the FT2::Memory given as `memory', or from FT2::Memory.default.
+ *
+ * Note:
+ *   Most code never needs to create a library: FT2::Face objects are
+ *   created under the calling thread's default library (see
+ *   FT2::Library.default) unless one is given.  Libraries and faces
+ *   may be shared between threads; FT2 serializes the FreeType calls
+ *   which need it.
  *
  * Examples:
- *   index = face.index
+ *   lib = FT2::Library.new
+ *   face = FT2::Face.new lib, 'yudit.ttf'
+ *
+ *   # scratch library for a single job
+ *   lib = FT2::Library.new memory: FT2::Memory.new(arena: 1 << 20)
  *
  */
-static VALUE ft_face_index(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->face_index);
+static VALUE ft_library_init(int argc, VALUE *argv, VALUE self) {
+  VALUE opts, memory = Qundef;
+  ID kw_memory;
+  FT_Library *lib;
+  FT_Error err;
+  Memory *mem = default_memory;
+
+  rb_scan_args(argc, argv, ":", &opts);
+  if (opts != Qnil) {
+    kw_memory = rb_intern("memory");
+    rb_get_kwargs(opts, &kw_memory, 0, 1, &memory);
+  }
+  if (memory != Qundef && memory != Qnil)
+    mem = memory_get(memory);
+
+  TypedData_Get_Struct(self, FT_Library, &library_type, lib);
+  if (*lib)
+    rb_raise(eFt2Error, "FT2::Library already initialized.");
+  if ((err = memory_new_library(mem, lib)) != FT_Err_Ok)
+    handle_error(err);
+  memory_gc_flush();
+
+  return self;
 }
 
 /*
- * Return the face flags of an FT2::Face object.
- *
- * You can binary OR this with any of the following values to obtain the
- * value of that flag (note that this is returned as an Integer and not
- * as a boolean value; eg non-zero for true and zero for false).
- *
- * Face Flags:
- *   FT2::Face::SCALABLE
- *   FT2::Face::FIXED_SIZES
- *   FT2::Face::FIXED_WIDTH
- *   FT2::Face::FIXED_HORIZONTAL
- *   FT2::Face::FIXED_VERTICAL
- *   FT2::Face::SFNT
- *   FT2::Face::KERNING
- *   FT2::Face::MULTIPLE_MASTERS
- *   FT2::Face::GLYPH_NAMES
- *   FT2::Face::EXTERNAL_STREAM
- *   FT2::Face::FAST_GLYPHS
- *
- * Alternatively, if you're only checking one flag, it's slightly faster
- * (and arguably more concise), to use the following flag methods, which
- * DO return true or false.
- *
- * Individual Flag Methods:
- *   FT2::Face#scalable?
- *   FT2::Face#fixed_sizes?
- *   FT2::Face#fixed_width?
- *   FT2::Face#horizontal?
- *   FT2::Face#vertical?
- *   FT2::Face#sfnt?
- *   FT2::Face#kerning?
- *   FT2::Face#external_stream?
- *   FT2::Face#fast_glyphs?
+ * Return the default FT2::Library of the calling thread.
  *
- * Aliases:
- *   FT2::Face#face_flags
+ * Description:
+ *   Every Ruby thread transparently gets its own library, created the
+ *   first time the thread opens a face and shared by all the fibers of
+ *   the thread.  Faces opened without an explicit library use it.
  *
  * Examples:
- *   if (face.flags & (FT2::Face::FAST_GLYPHS | FT2::Face::KERNING) != 0)
- *     puts 'face contains fast glyphs and kerning information'
- *   end
+ *   lib = FT2::Library.default
  *
  */
-static VALUE ft_face_flags(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->face_flags);
+static VALUE ft_library_default(VALUE klass) {
+  UNUSED(klass);
+  return library_wrap(current_library());
 }
 
 /*
- * Is this FT2::Face scalable?
+ * Return the FreeType version of a FT2::Library as a string.
  *
  * Examples:
- *   puts "is scalable" if face.scalable?
+ *   puts FT2::Library.new.version
  *
  */
-static VALUE ft_face_flag_scalable(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_SCALABLE) ? Qtrue : Qfalse;
+static VALUE ft_library_version(VALUE self) {
+  char buf[64];
+  FT_Int ver[3];
+
+  FT_Library_Version(library_get(self), &(ver[0]), &(ver[1]), &(ver[2]));
+
+  snprintf(buf, sizeof(buf), "%d.%d.%d", ver[0], ver[1], ver[2]);
+  return rb_str_new2(buf);
 }
 
 /*
- * Does this FT2::Face contain bitmap strikes for some pixel sizes?
+ * Are two FT2::Library objects the same library?
  *
  * Examples:
- *   puts "contains fixed sized glyphs" if face.fixed_sizes?
+ *   slot.library == FT2::Library.default
  *
  */
-static VALUE ft_face_flag_fixed_sizes(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_FIXED_SIZES) ? Qtrue : Qfalse;
+static VALUE ft_library_eq(VALUE self, VALUE other) {
+  if (!rb_obj_is_kind_of(other, cLibrary))
+    return Qfalse;
+  return (library_get(self) == library_get(other)) ? Qtrue : Qfalse;
 }
 
+/***********************/
+/* FT2::Bitmap methods */
+/***********************/
+
 /*
- * Does this FT2::Face contain fixed with characters?
+ * Constructor for FT2::Bitmap.
  *
- * Examples:
- *   puts "contains fixed width characters" if face.fixed_width?
+ * This method is currently empty.  You should never call this method
+ * directly unless you're instantiating a derived class (ie, you know
+ * what you're doing).
  *
  */
-static VALUE ft_face_flag_fixed_width(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_FIXED_WIDTH) ? Qtrue : Qfalse;
+static VALUE ft_bitmap_init(VALUE self) {
+  return self;
 }
 
 /*
- * Does this FT2::Face contain horizontal glyph metrics?
- *
- * Note:
- *   This flag is true for virtually all fonts.
+ * Return the number of rows in a FT2::Bitmap object.
  *
  * Examples:
- *   puts "contains horizontal glyph metrics" if face.horizontal?
+ *   rows = bitmap.rows
  *
  */
-static VALUE ft_face_flag_horizontal(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_HORIZONTAL) ? Qtrue : Qfalse;
+static VALUE ft_bitmap_rows(VALUE self) {
+  FT_Bitmap *bitmap;
+  bitmap = view_get(self, &bitmap_type)->ptr;
+  return INT2FIX(bitmap->rows);
 }
 
 /*
- * Does this FT2::Face contain vertical glyph metrics?
- *
- * Note:
- *   If this flag is not set, the glyph loader will synthesize vertical
- *   metrics itself.
+ * Return the width of an FT2::Bitmap object.
  *
  * Examples:
- *   puts "contains vertical glyph metrics" if face.vertical?
+ *   width = bitmap.width
  *
  */
-static VALUE ft_face_flag_vertical(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_VERTICAL) ? Qtrue : Qfalse;
+static VALUE ft_bitmap_width(VALUE self) {
+  FT_Bitmap *bitmap;
+  bitmap = view_get(self, &bitmap_type)->ptr;
+  return INT2FIX(bitmap->width);
 }
 
 /*
- * Is this FT2::Face stored in the 'sfnt' storage format?
+ * Return the pitch (bytes per row) of an FT2::Bitmap object.
  *
- * Note:
- *   This currently means the file was either TrueType or OpenType.
+ * Return the pitch (bytes per row, including alignment padding) of an
+ * FT2::Bitmap object.
  *
  * Examples:
- *   puts "sfnt format font" if face.sfnt?
+ *   width = bitmap.width
  *
  */
-static VALUE ft_face_flag_sfnt(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_SFNT) ? Qtrue : Qfalse;
+static VALUE ft_bitmap_pitch(VALUE self) {
+  FT_Bitmap *bitmap;
+  bitmap = view_get(self, &bitmap_type)->ptr;
+  return INT2FIX(bitmap->pitch);
 }
 
 /*
- * Does this FT2::Face contain kerning information?
+ * Return the buffer (e.g. raw pixel data) of an FT2::Bitmap object.
  *
  * Examples:
- *   puts "face contains kerning information" if face.kerning?
+ *   # return the rendered pixels as a binary string
+ *   buffer = bitmap.buffer
+ *
+ *   # assume a render method called render_font(buffer, width, height)
+ *   render_font(bitmap.buffer, bitmap.width, bitmap.rows)
  *
  */
-static VALUE ft_face_flag_kerning(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_KERNING) ? Qtrue : Qfalse;
+static VALUE ft_bitmap_buffer(VALUE self) {
+  FT_Bitmap *bitmap;
+  bitmap = view_get(self, &bitmap_type)->ptr;
+  return rb_str_new((char*) bitmap->buffer, ABS(bitmap->pitch) * bitmap->rows);
 }
 
 /*
- * Was this FT2::Face loaded from an external stream?
+ * Return the number of grays in an FT2::Bitmap object.
+ *
+ * Note:
+ *   Only used if Ft2::Bitmap#pixel_mode is FT2::PixelMode::GRAYS.
  *
  * Examples:
- *   puts "face loaded from external stream" if face.external_stream?
+ *   depth = bitmap.num_grays
  *
  */
-static VALUE ft_face_flag_external_stream(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_EXTERNAL_STREAM) ? Qtrue : Qfalse;
+static VALUE ft_bitmap_num_grays(VALUE self) {
+  FT_Bitmap *bitmap;
+  bitmap = view_get(self, &bitmap_type)->ptr;
+  return INT2FIX(bitmap->num_grays);
 }
 
 /*
- * Does this FT2::Face contain fast glyphs?
+ * Return the pixel mode (e.g. bit depth) of an FT2::Bitmap object.
  *
  * Note:
- *   This flag is usually set for fixed-size formats like FNT.
+ *   Always returns one of the values avaiable in FT2::PixelMode (for a
+ *   full list, try the following code: "p FT2::PixelMode.constants.sort")
  *
  * Examples:
- *   puts "face contains fast glyphs" if face.fast_glyphs?
+ *   case bitmap.pixel_mode
+ *   when FT2::PixelMode::RGB32
+ *     puts "wow that's a lot of colors!"
+ *   when FT2::PixelMode::MONO
+ *     puts "time to get a better monitor..."
+ *   end
  *
  */
-static VALUE ft_face_flag_fast_glyphs(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->face_flags & FT_FACE_FLAG_FAST_GLYPHS) ? Qtrue : Qfalse;
+static VALUE ft_bitmap_pixel_mode(VALUE self) {
+  FT_Bitmap *bitmap;
+  bitmap = view_get(self, &bitmap_type)->ptr;
+  return INT2FIX(bitmap->pixel_mode);
 }
 
 /*
- * Return the style flags of an FT2::Face object.
- *
- * You can binary OR this with any of the following values to obtain the
- * value of that style flag (note that this is returned as an Integer
- * and not as a boolean value; eg non-zero for true and zero for false).
- *
- * Style Flags:
- *   FT2::Face::BOLD
- *   FT2::Face::ITALIC
- *
- * Alternatively, if you're only checking one style flag, it's slightly
- * faster (and arguably more concise), to use the following style flag
- * methods, which DO return true or false.
+ * Return the palette mode of an FT2::Bitmap object.
  *
- * Individual Style Flag Methods:
- *   FT2::Face#bold?
- *   FT2::Face#italic?
+ * Note:
+ *   Always returns one of the values avaiable in FT2::PaletteMode.
  *
  * Examples:
- *   style = face.style_flags
+ *   case bitmap.palette_mode
+ *   when FT2::PaletteMode::RGBA
+ *     puts "we have an alpha channel!"
+ *   when FT2::PaletteMode::RGB
+ *     puts "no alpha channel for you"
+ *   end
  *
  */
-static VALUE ft_face_style_flags(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->style_flags);
+static VALUE ft_bitmap_palette_mode(VALUE self) {
+  FT_Bitmap *bitmap;
+  bitmap = view_get(self, &bitmap_type)->ptr;
+  return INT2FIX(bitmap->palette_mode);
 }
 
 /*
- * Is this a bold FT2::Face?
+ * Return the palette of an FT2::Bitmap object.
+ *
+ * Note:
+ *   Returns a binary string of RGB or RGBA elements (check
+ *   FT2::Bitmap#palette_mode to determine which).
  *
  * Examples:
- *   puts "bold face" if face.bold?
+ *   case bitmap.palette_mode
+ *   when FT2::PaletteMode::RGBA
+ *     rgba_palette_string = bitmap.palette
+ *   when FT2::PaletteMode::RGB
+ *     rgb_palette_string = bitmap.palette
+ *   end
  *
  */
-static VALUE ft_face_flag_bold(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->style_flags & FT_STYLE_FLAG_BOLD) ? Qtrue : Qfalse;
+static VALUE ft_bitmap_palette(VALUE self) {
+  FT_Bitmap *bitmap;
+  /* int size; */
+  bitmap = view_get(self, &bitmap_type)->ptr;
+
+  return Qnil;
+  /* FIXME i don't know how big the palette memory is, so i'll just
+   * assume it's 256 entries :/
+   *
+   * none of this shit compiles, so I'm disabling it for now.
+  if (bitmap->palette_mode == ft_palette_mode_rgb)
+    size = 3 * 256;
+  else if (bitmap->palette_mode == ft_palette_mode_rgba)
+    size = 4 * 256;
+  else
+    rb_raise(rb_eException, "Unknown palette mode: %d.",
+             INT2FIX(bitmap->palette_mode));
+
+  return rb_str_new(bitmap->palette, size); */
+}
+
+/*********************/
+/* FT2::Face methods */
+/*********************/
+static void face_free(void *ptr) {
+  Face *face = (Face *) ptr;
+
+  /* nothing can be raised from the GC, and the face is gone either way */
+  face_release(face->face, face->own_size, face->library);
+  free(ptr);
+}
+
+static void face_mark(void *ptr) {
+  Face *face = (Face *) ptr;
+  int i;
+
+  for (i = 0; i < 3; i++)
+    rb_gc_mark_movable(face->views[i]);
+}
+
+/* the FreeType side is reported by the FT2::Memory the face lives in */
+static size_t face_memsize(const void *ptr) {
+  UNUSED(ptr);
+  return sizeof(Face);
+}
+
+static void face_compact(void *ptr) {
+  Face *face = (Face *) ptr;
+  int i;
+
+  for (i = 0; i < 3; i++)
+    face->views[i] = rb_gc_location(face->views[i]);
 }
 
 /*
- * Is this an italic FT2::Face?
- *
- * Examples:
- *   puts "italic face" if face.italic?
- *
+ * Frozen faces may be shared between Ractors; the methods changing a
+ * face (its size, transform, charmap or glyph slot) refuse to run on
+ * a frozen one.
  */
-static VALUE ft_face_flag_italic(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return ((*face)->style_flags & FT_STYLE_FLAG_ITALIC) ? Qtrue : Qfalse;
-}
+static const rb_data_type_t face_type = {
+  "FT2::Face",
+  { face_mark, face_free, face_memsize, face_compact, },
+  0, 0,
+  RUBY_TYPED_FROZEN_SHAREABLE | RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
 
 /*
- * Return the number of glyphs in an FT2::Face object.
- *
- * Aliases:
- *   FT2::Face#num_glyphs
- *
- * Examples:
- *   count = face.glyphs
- *   puts "face has #{count.to_str} glyphs"
- *
+ * Wrap a FT_Face in a new object of class `klass' using `size' (NULL
+ * for the face's default size).  The object takes over the caller's
+ * references to the face and to the library it was created under (see
+ * face_open and face_reference), and `size' if not NULL; they are
+ * dropped if this runs out of memory.
  */
-static VALUE ft_face_glyphs(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->num_glyphs);
+static VALUE face_wrap_size(VALUE klass, FT_Face ft_face, FT_Library lib, FT_Size size) {
+  VALUE self;
+  Face *face;
+
+  if ((face = malloc(sizeof(Face))) == NULL) {
+    face_release(ft_face, size, lib);
+    rb_memerror();
+  }
+  face->face = ft_face;
+  face->library = lib;
+  face->size = face->own_size = size;
+  face->views[FACE_VIEW_GLYPH] = Qnil;
+  face->views[FACE_VIEW_SIZE] = Qnil;
+  face->views[FACE_VIEW_CHARMAP] = Qnil;
+
+  self = TypedData_Wrap_Struct(klass, &face_type, face);
+  rb_obj_call_init(self, 0, NULL);
+
+  return self;
+}
+
+static VALUE face_wrap(VALUE klass, FT_Face ft_face, FT_Library lib) {
+  return face_wrap_size(klass, ft_face, lib, NULL);
+}
+
+/* the size `face' uses: its own, or the one FT_Open_Face created */
+static FT_Size face_size(Face *face) {
+  return face->size ? face->size : (FT_Size) face->face->sizes_list.head->data;
 }
 
 /*
- * Return the family name of an FT2::Face object.
- *
- * Description:
- *   This is an ASCII string, usually in English, which describes the
- *   FT2::Face object's family (eg "Times New Roman" or "Geneva"). Some
- *   formats (eg Truetype and OpenType) provide localized and Unicode
- *   versions of this string, which are accessable via the format specific
- *   interfaces.
- *
- * Examples:
- *   puts 'family: ' << face.family
- *
+ * Make the size of `face' the active size of its FT_Face, which other
+ * objects sharing the FT_Face may have changed.  Call with the face
+ * lock held; it costs nothing unless the size changes.
  */
-static VALUE ft_face_family(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return rb_str_new2((*face)->family_name);
+static FT_Error face_activate(Face *face) {
+  FT_Size size = face_size(face);
+  return face->face->size == size ? FT_Err_Ok : FT_Activate_Size(size);
 }
 
 /*
- * Return the style name of an FT2::Face object.
- *
- * Description:
- *   This is an ASCII string, usually in English, which describes the
- *   FT2::Face object's style (eg "Bold", "Italic", "Condensed", etc).
- *   This field is optional and may be set to nil.
- *
- * Examples:
- *   puts 'style: ' << face.style if face.style
- *
+ * Tables derived from a parsed face, built on first use and shared by
+ * every object wrapping the FT_Face (see FT2::Face#share and
+ * FT2::FaceCache).  They hang off the face's generic slot, in front of
+ * whatever was there (see pinned_object_face_finalizer), and are freed
+ * with the FT_Face.  Only changed with the face lock held; a built
+ * table never changes again, and may be read without it.
  */
-static VALUE ft_face_style(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  if (!(*face)->style_name)
-    return Qnil;
-  return rb_str_new2((*face)->style_name);
+typedef struct {
+  void                 *data;       /* the generic slot we took over */
+  FT_Generic_Finalizer  finalizer;
+  unsigned int          built;      /* the FACE_DATA_XXX tables built */
+
+  FT_Int               *advances;   /* font units, by glyph index */
+
+  /* kerning pairs, by left glyph: those of glyph g are kern_right[i]
+   * for kern_first[g] <= i < kern_first[g + 1], sorted */
+  int                   kerning;    /* a FACE_KERNING_XXX value */
+  FT_UInt32            *kern_first;
+  FT_UShort            *kern_right;
+  FT_Int               *kern_values; /* font units */
+
+  /* the glyph of Unicode code point c is page[c & 0xFF], where page is
+   * cmap_bmp[c >> 8] in the BMP, or the supplementary page numbered
+   * c >> 8 (sorted); an unmapped page is NULL or missing */
+  FT_CharMap            cmap_charmap;  /* the charmap it was built from */
+  FT_UInt32            *cmap_bmp[256];
+  FT_UInt32            *cmap_supp_keys;
+  FT_UInt32           **cmap_supp;
+  FT_ULong              cmap_num_supp;
+
+  /* the code points of the Unicode table with a glyph, as ascending
+   * inclusive ranges: first and last of range i are coverage[2i] and
+   * coverage[2i + 1] */
+  FT_UInt32            *coverage;
+  FT_ULong              num_coverage;
+} FaceData;
+
+enum {
+  FACE_DATA_ADVANCES  = 1 << 0,
+  FACE_DATA_KERNING   = 1 << 1,
+  FACE_DATA_CMAP      = 1 << 2,
+  FACE_DATA_COVERAGE  = 1 << 3,
+};
+
+enum {
+  FACE_KERNING_NONE,      /* the face has no kerning */
+  FACE_KERNING_TABLE,     /* the pairs of its `kern' table */
+  FACE_KERNING_DRIVER,    /* ask FT_Get_Kerning (Type 1 AFM, etc) */
+};
+
+static void face_data_cmap_clear(FaceData *data) {
+  FT_ULong i;
+
+  for (i = 0; i < 256; i++) {
+    free(data->cmap_bmp[i]);
+    data->cmap_bmp[i] = NULL;
+  }
+  for (i = 0; i < data->cmap_num_supp; i++)
+    free(data->cmap_supp[i]);
+  free(data->cmap_supp_keys);
+  free(data->cmap_supp);
+  data->cmap_supp_keys = NULL;
+  data->cmap_supp = NULL;
+  data->cmap_num_supp = 0;
+}
+
+static void face_data_finalizer(void *object) {
+  FT_Face face = (FT_Face) object;
+  FaceData *data = (FaceData *) face->generic.data;
+
+  face->generic.data = data->data;
+  face->generic.finalizer = data->finalizer;
+  free(data->advances);
+  free(data->kern_first);
+  free(data->kern_right);
+  free(data->kern_values);
+  face_data_cmap_clear(data);
+  free(data->coverage);
+  free(data);
+
+  if (face->generic.finalizer)
+    face->generic.finalizer(face);
+}
+
+/* the tables of `face', or NULL; call with the face lock held */
+static FaceData *face_data_find(FT_Face face) {
+  if (face->generic.finalizer != face_data_finalizer)
+    return NULL;
+  return (FaceData *) face->generic.data;
+}
+
+/* the tables of `face', created if needed; call with the face lock held */
+static FaceData *face_data(FT_Face face) {
+  FaceData *data;
+
+  if ((data = face_data_find(face)) != NULL)
+    return data;
+  if ((data = calloc(1, sizeof(FaceData))) == NULL)
+    return NULL;
+
+  data->data = face->generic.data;
+  data->finalizer = face->generic.finalizer;
+  face->generic.data = data;
+  face->generic.finalizer = face_data_finalizer;
+
+  return data;
 }
 
 /*
- * Return the number of fixed sizes in an FT2::Face object.
- *
- * Note:
- *   This should be set to 0 for scalable fonts, unless the FT2::Face
- *   object contains a complete set of glyphs for the specified size.
- *
- * Aliases:
- *   FT2::Face#num_fixed_sizes
- *
- * Examples:
- *   puts 'fized sizes count: ' << face.fixed_sizes
- *
+ * Build the advance table of `face': the advance width of each glyph
+ * in font units, read once through FT_Get_Advances.  Call with the
+ * face lock held.
  */
-static VALUE ft_face_fixed_sizes(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->num_fixed_sizes);
+static FT_Error face_data_advances(FT_Face face, FaceData *data) {
+  FT_Fixed buf[256];
+  FT_Int *advances;
+  FT_Long i, j, count;
+  FT_Error err;
+
+  if (data->built & FACE_DATA_ADVANCES)
+    return FT_Err_Ok;
+  if ((advances = malloc((face->num_glyphs + 1) * sizeof(FT_Int))) == NULL)
+    return FT_Err_Out_Of_Memory;
+
+  for (i = 0; i < face->num_glyphs; i += count) {
+    count = face->num_glyphs - i;
+    if (count > (FT_Long) (sizeof(buf) / sizeof(buf[0])))
+      count = sizeof(buf) / sizeof(buf[0]);
+
+    err = FT_Get_Advances(face, i, count, FT_LOAD_NO_SCALE, buf);
+    if (err != FT_Err_Ok) {
+      free(advances);
+      return err;
+    }
+    for (j = 0; j < count; j++)
+      advances[i + j] = (FT_Int) buf[j];
+  }
+
+  data->advances = advances;
+  data->built |= FACE_DATA_ADVANCES;
+  return FT_Err_Ok;
+}
+
+typedef struct {
+  FT_UInt32 key;      /* left << 16 | right */
+  FT_UInt   order;    /* subtable index, then position */
+  FT_Int    value;
+  int       replace;  /* overrides the earlier subtables */
+} KernPair;
+
+static int kern_pair_cmp(const void *a, const void *b) {
+  const KernPair *pa = (const KernPair *) a,
+                 *pb = (const KernPair *) b;
+
+  if (pa->key != pb->key)
+    return pa->key < pb->key ? -1 : 1;
+  return pa->order < pb->order ? -1 : pa->order > pb->order;
 }
 
+#define KERN_USHORT(p) ((FT_UInt) (p)[0] << 8 | (p)[1])
+
 /*
- * Return an array of sizes in an FT2::Face object.
- *
- * Note:
- *   This method does not currently work..
- *
- * Examples:
- *   face.available_sizesdflksjaflksdjf FIXME
- *
+ * Read the format 0 horizontal subtables of a `kern' table into
+ * `pairs' (NULL to count them), the way FreeType's TrueType driver
+ * reads them: at most 32 subtables, each adding to or replacing the
+ * values of the ones before it.
  */
-static VALUE ft_face_available_sizes(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  /* FIXME!! */
-  return INT2FIX((*face)->available_sizes);
+static FT_ULong kern_table_pairs(const FT_Byte *table, FT_ULong size, KernPair *pairs) {
+  const FT_Byte *p = table, *limit = table + size, *next;
+  FT_UInt num_tables, length, coverage, num_pairs, n, i;
+  FT_ULong count = 0;
+
+  if (size < 4)
+    return 0;
+  num_tables = KERN_USHORT(p + 2);
+  if (num_tables > 32)
+    num_tables = 32;
+  p += 4;
+
+  for (n = 0; n < num_tables && p + 6 <= limit; n++, p = next) {
+    length = KERN_USHORT(p + 2);
+    coverage = KERN_USHORT(p + 4);
+    if (length <= 6 + 8)
+      break;
+    next = (FT_ULong) (limit - p) < length ? limit : p + length;
+
+    /*
+     * exactly FreeType's tests: tt_face_load_kern keeps horizontal
+     * subtables without minimum values, whatever their other flags
+     * (cross-stream included), and tt_face_get_kerning only reads the
+     * format 0 ones
+     */
+    if ((coverage & 3) != 0x0001 || (coverage >> 8) != 0 || p + 14 > next)
+      continue;
+
+    num_pairs = KERN_USHORT(p + 6);
+    if ((FT_ULong) (next - (p + 14)) / 6 < num_pairs)
+      num_pairs = (FT_UInt) ((next - (p + 14)) / 6);
+
+    for (i = 0; i < num_pairs; i++, count++) {
+      const FT_Byte *q = p + 14 + i * 6;
+      if (!pairs)
+        continue;
+      pairs[count].key = (FT_UInt32) KERN_USHORT(q) << 16 | KERN_USHORT(q + 2);
+      pairs[count].order = n;
+      pairs[count].value = (FT_Short) KERN_USHORT(q + 4);
+      pairs[count].replace = (coverage & 8) != 0;
+    }
+  }
+
+  return count;
 }
 
 /*
- * Return the number of charmaps in an FT2::Face object.
- *
- * Examples:
- *   puts 'number of charmaps: ' << face.num_charmaps
- *
+ * Build the kerning index of `face' from its `kern' table, if it has
+ * one; other faces with kerning (a Type 1 font with an attached AFM,
+ * etc) are left to FT_Get_Kerning.  Call with the face lock held.
  */
-static VALUE ft_face_num_charmaps(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->num_charmaps);
+static FT_Error face_data_kerning(FT_Face face, FaceData *data) {
+  FT_Byte *table = NULL;
+  FT_ULong size = 0, count, i, j;
+  FT_Long num_glyphs = face->num_glyphs;
+  KernPair *pairs = NULL;
+  FT_UInt left;
+  FT_Error err;
+
+  if (data->built & FACE_DATA_KERNING)
+    return FT_Err_Ok;
+  if (!FT_HAS_KERNING(face)) {
+    data->kerning = FACE_KERNING_NONE;
+    data->built |= FACE_DATA_KERNING;
+    return FT_Err_Ok;
+  }
+  if (!FT_IS_SFNT(face) ||
+      FT_Load_Sfnt_Table(face, TTAG_kern, 0, NULL, &size) != FT_Err_Ok) {
+    data->kerning = FACE_KERNING_DRIVER;
+    data->built |= FACE_DATA_KERNING;
+    return FT_Err_Ok;
+  }
+
+  if ((table = malloc(size)) == NULL)
+    return FT_Err_Out_Of_Memory;
+  if ((err = FT_Load_Sfnt_Table(face, TTAG_kern, 0, table, &size)) != FT_Err_Ok)
+    goto done;
+
+  count = kern_table_pairs(table, size, NULL);
+  data->kern_first = calloc(num_glyphs + 2, sizeof(FT_UInt32));
+  data->kern_right = malloc((count + 1) * sizeof(FT_UShort));
+  data->kern_values = malloc((count + 1) * sizeof(FT_Int));
+  pairs = malloc((count + 1) * sizeof(KernPair));
+  if (!data->kern_first || !data->kern_right || !data->kern_values || !pairs) {
+    err = FT_Err_Out_Of_Memory;
+    goto done;
+  }
+
+  kern_table_pairs(table, size, pairs);
+  qsort(pairs, count, sizeof(KernPair), kern_pair_cmp);
+
+  /* fold the values of each pair across subtables, in table order */
+  for (i = 0, j = 0; i < count; i++) {
+    left = pairs[i].key >> 16;
+    if ((FT_Long) left >= num_glyphs)
+      continue;
+    if (i > 0 && pairs[i - 1].key == pairs[i].key) {
+      if (pairs[i].replace)
+        data->kern_values[j - 1] = pairs[i].value;
+      else
+        data->kern_values[j - 1] += pairs[i].value;
+      continue;
+    }
+    data->kern_right[j] = (FT_UShort) (pairs[i].key & 0xFFFF);
+    data->kern_values[j] = pairs[i].value;
+    data->kern_first[left + 1]++;
+    j++;
+  }
+  for (i = 0; i < (FT_ULong) num_glyphs; i++)
+    data->kern_first[i + 1] += data->kern_first[i];
+
+  data->kerning = FACE_KERNING_TABLE;
+  data->built |= FACE_DATA_KERNING;
+
+done:
+  if (data->kerning != FACE_KERNING_TABLE) {
+    free(data->kern_first);
+    free(data->kern_right);
+    free(data->kern_values);
+    data->kern_first = NULL;
+    data->kern_right = NULL;
+    data->kern_values = NULL;
+  }
+  free(pairs);
+  free(table);
+  return err;
 }
 
-/*
- * Return an array of charmaps in an FT2::Face object.
- *
- * Note:
- *   This method may not work correctly at the moment (FIXME).
- *
- * Examples:
- *   face.charmaps.each { |map| puts map.to_str }
- *
- */
-static VALUE ft_face_charmaps(VALUE self) {
-  FT_Face *face;
-  VALUE ary;
-  int i;
-  Data_Get_Struct(self, FT_Face, face);
+/* the kerning of a glyph pair in font units; call with the face lock held */
+static FT_Error face_data_kern(FT_Face face, FaceData *data, FT_UInt left, FT_UInt right, FT_Pos *value) {
+  FT_UInt32 lo, hi, mid;
+  FT_Vector v;
+  FT_Error err;
 
-  /* FIXME */
-  rb_bug("not implemented yet");
-  ary = rb_ary_new();
-  for (i = 0; i < (*face)->num_charmaps; i++)
-    rb_ary_push(ary, INT2FIX(i));
+  *value = 0;
+  switch (data->kerning) {
+  case FACE_KERNING_TABLE:
+    if ((FT_Long) left >= face->num_glyphs)
+      break;
+    lo = data->kern_first[left];
+    hi = data->kern_first[left + 1];
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (data->kern_right[mid] == right) {
+        *value = data->kern_values[mid];
+        break;
+      }
+      if (data->kern_right[mid] < right)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    break;
+  case FACE_KERNING_DRIVER:
+    if ((err = FT_Get_Kerning(face, left, right, FT_KERNING_UNSCALED, &v)) != FT_Err_Ok)
+      return err;
+    *value = v.x;
+    break;
+  }
 
-  return ary;
+  return FT_Err_Ok;
 }
 
 /*
- * Return the bounding box of an FT2::Face object.
- *
- * Note:
- *   This method is not currently implemented (FIXME).
- *
- * Examples:
- *   FIXME
- *
+ * Scale a horizontal kerning value in font units the way FT_Get_Kerning
+ * does for `mode', at size `metrics'.
  */
-static VALUE ft_face_bbox(VALUE self) {
-  UNUSED(self);
-  /* FIXME */
-  rb_bug("not implemented yet");
-  return Qnil;
+static FT_Pos kern_scale(FT_Pos value, FT_UInt mode, const FT_Size_Metrics *metrics) {
+  if (mode == FT_KERNING_UNSCALED)
+    return value;
+
+  value = FT_MulFix(value, metrics->x_scale);
+  if (mode != FT_KERNING_UNFITTED) {
+    /* smaller at small sizes, so rounding doesn't make it too big */
+    if (metrics->x_ppem < 25)
+      value = FT_MulDiv(value, metrics->x_ppem, 25);
+    value = (value + 32) & -64;
+  }
+
+  return value;
 }
 
-/*
- * Return the number of font units per EM for this FT2::Face object.
- *
- * Description:
- *   This value is typically 2048 for TrueType fonts, 1000 for Type1
- *   fonts, and should be set to the (unrealistic) value 1 for
- *   fixed-size fonts.
- *
- * Aliases:
- *   FT2::Face#units_per_EM
- *
- * Examples:
- *   em = face.units_per_em
- *
- */
-static VALUE ft_face_units_per_em(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->units_per_EM);
+/* the page of the Unicode table of `data' holding `code', created if needed */
+static FT_UInt32 *face_data_cmap_page(FaceData *data, FT_ULong code) {
+  FT_UInt32 **page, *keys, **pages, n = code >> 8;
+
+  if (n < 256) {
+    page = &data->cmap_bmp[n];
+  } else {
+    /* the walk is in code point order, so new pages come last */
+    if (!data->cmap_num_supp || data->cmap_supp_keys[data->cmap_num_supp - 1] != n) {
+      keys = realloc(data->cmap_supp_keys, (data->cmap_num_supp + 1) * sizeof(FT_UInt32));
+      if (keys)
+        data->cmap_supp_keys = keys;
+      pages = realloc(data->cmap_supp, (data->cmap_num_supp + 1) * sizeof(FT_UInt32 *));
+      if (pages)
+        data->cmap_supp = pages;
+      if (!keys || !pages)
+        return NULL;
+      data->cmap_supp_keys[data->cmap_num_supp] = n;
+      data->cmap_supp[data->cmap_num_supp++] = NULL;
+    }
+    page = &data->cmap_supp[data->cmap_num_supp - 1];
+  }
+
+  if (!*page)
+    *page = calloc(256, sizeof(FT_UInt32));
+  return *page;
 }
 
 /*
- * Return the ascender for this FT2::Face object.
- *
- * Description:
- *   An FT2::Face object's ascender is the vertical distance, in font
- *   units, from the baseline to the topmost point of any glyph in the
- *   face.
- *
- * Examples:
- *   asc = face.ascender
- *
+ * Build the Unicode table of `face' by walking its selected charmap
+ * once, if that is a Unicode one.  Call with the face lock held.
  */
-static VALUE ft_face_ascender(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->ascender);
+static FT_Error face_data_cmap(FT_Face face, FaceData *data) {
+  FT_UInt32 *page;
+  FT_ULong code;
+  FT_UInt gindex;
+
+  if (data->built & FACE_DATA_CMAP)
+    return FT_Err_Ok;
+  if (!face->charmap || face->charmap->encoding != FT_ENCODING_UNICODE)
+    return FT_Err_Ok;
+
+  for (code = FT_Get_First_Char(face, &gindex); gindex != 0;
+       code = FT_Get_Next_Char(face, code, &gindex)) {
+    if (code > 0x10FFFF)
+      break;
+    if ((page = face_data_cmap_page(data, code)) == NULL) {
+      face_data_cmap_clear(data);
+      return FT_Err_Out_Of_Memory;
+    }
+    page[code & 0xFF] = gindex;
+  }
+
+  data->cmap_charmap = face->charmap;
+  data->built |= FACE_DATA_CMAP;
+  return FT_Err_Ok;
 }
 
-/*
- * Return the descender for this FT2::Face object.
- *
- * Description:
- *   An FT2::Face object's descender is the vertical distance, in font
- *   units, from the baseline to the bottommost point of any glyph in
- *   the face.
- *
- * Examples:
- *   asc = face.descender
- *
- */
-static VALUE ft_face_descender(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->descender);
+/* the glyph of Unicode code point `code' in a built table, or 0 */
+static FT_UInt face_data_cmap_lookup(const FaceData *data, FT_ULong code) {
+  const FT_UInt32 *page = NULL;
+  FT_ULong lo, hi, mid;
+  FT_UInt32 n = code >> 8;
+
+  if (n < 256) {
+    page = data->cmap_bmp[n];
+  } else if (code <= 0x10FFFF) {
+    for (lo = 0, hi = data->cmap_num_supp; lo < hi; ) {
+      mid = lo + (hi - lo) / 2;
+      if (data->cmap_supp_keys[mid] == n) {
+        page = data->cmap_supp[mid];
+        break;
+      }
+      if (data->cmap_supp_keys[mid] < n)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  }
+
+  return page ? page[code & 0xFF] : 0;
 }
 
-/*
- * Return the height of this FT2::Face object.
- *
- * Description:
- *   An FT2::Face object's height is the vertical distance, in font
- *   units, from the baseline of one line to the baseline of the next.
- *   The value can be computed as 'ascender + descender + line_gap',
- *   where 'line_gap' is also called 'external leading'.
- *
- * Examples:
- *   h = face.height
- *
- */
-static VALUE ft_face_height(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->height);
+/* add the code points of `page' (numbered `n') with a glyph to the coverage */
+static FT_Error face_data_coverage_page(FaceData *data, FT_UInt32 n, const FT_UInt32 *page, FT_ULong *capa) {
+  FT_UInt32 *ranges, code, i;
+
+  for (i = 0; i < 256; i++) {
+    if (!page[i])
+      continue;
+    code = n << 8 | i;
+    if (data->num_coverage && data->coverage[data->num_coverage * 2 - 1] + 1 == code) {
+      data->coverage[data->num_coverage * 2 - 1] = code;
+      continue;
+    }
+    if (data->num_coverage == *capa) {
+      *capa = *capa ? *capa * 2 : 64;
+      if ((ranges = realloc(data->coverage, *capa * 2 * sizeof(FT_UInt32))) == NULL)
+        return FT_Err_Out_Of_Memory;
+      data->coverage = ranges;
+    }
+    data->coverage[data->num_coverage * 2] = code;
+    data->coverage[data->num_coverage * 2 + 1] = code;
+    data->num_coverage++;
+  }
+
+  return FT_Err_Ok;
 }
 
 /*
- * Return the maximal advance width of this FT2::Face object.
- *
- * Description:
- *   The maximal advance width, in font units, for all glyphs in this
- *   FT2::Face object.  This can be used to make word-wrapping
- *   computations faster.  Only relevant for scalable formats.
- *
- * Examples:
- *   maw = face.max_advance_width
- *
+ * Build the Unicode coverage of `face' from its Unicode table (see
+ * face_data_cmap), if it has one.  Call with the face lock held.
  */
-static VALUE ft_face_max_advance_width(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->max_advance_width);
+static FT_Error face_data_coverage(FT_Face face, FaceData *data) {
+  FT_ULong i, capa = 0;
+  FT_Error err;
+
+  if (data->built & FACE_DATA_COVERAGE)
+    return FT_Err_Ok;
+  if ((err = face_data_cmap(face, data)) != FT_Err_Ok)
+    return err;
+  if (!(data->built & FACE_DATA_CMAP))
+    return FT_Err_Ok;
+
+  for (i = 0; i < 256 && err == FT_Err_Ok; i++)
+    if (data->cmap_bmp[i])
+      err = face_data_coverage_page(data, i, data->cmap_bmp[i], &capa);
+  for (i = 0; i < data->cmap_num_supp && err == FT_Err_Ok; i++)
+    err = face_data_coverage_page(data, data->cmap_supp_keys[i], data->cmap_supp[i], &capa);
+
+  if (err != FT_Err_Ok) {
+    free(data->coverage);
+    data->coverage = NULL;
+    data->num_coverage = 0;
+    return err;
+  }
+
+  data->built |= FACE_DATA_COVERAGE;
+  return FT_Err_Ok;
 }
 
-/*
- * Return the maximal advance height of this FT2::Face object.
- *
- * Description:
- *   The maximal advance height, in font units, for all glyphs in this
- *   FT2::Face object.  This can be used to make word-wrapping
- *   computations faster.  Only relevant for scalable formats.
- *
- * Examples:
- *   mah = face.max_advance_height
- *
- */
-static VALUE ft_face_max_advance_height(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->max_advance_height);
+typedef struct {
+  FT_Face   face;
+  FaceData *data;
+  FT_Error (*func)(FT_Face, FaceData *);
+  unsigned int which;
+  int       built;    /* table `which' is built */
+  FT_Error  err;
+} FaceDataBuild;
+
+static void *face_data_build_nogvl(void *ptr) {
+  FaceDataBuild *build = (FaceDataBuild *) ptr;
+
+  if ((build->data = face_data(build->face)) == NULL)
+    build->err = FT_Err_Out_Of_Memory;
+  else
+    build->err = build->func(build->face, build->data);
+  build->built = build->err == FT_Err_Ok && (build->data->built & build->which);
+
+  return NULL;
 }
 
 /*
- * Return the underline position of this FT2::Face object.
- *
- * Description:
- *   The position, in font units, of the underline line for this face.
- *   It's the center of the underlining stem. Only relevant for scalable
- *   formats.
- *
- * Examples:
- *   uh = face.underline_position
- *
+ * The tables of `face', with table `which' (a FACE_DATA_XXX value)
+ * built by `func' on first use, without the GVL.  Returns NULL if
+ * `func' leaves it unbuilt (e.g. without a Unicode charmap), and
+ * raises if it can't be built.
  */
-static VALUE ft_face_underline_position(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->underline_position);
+static const FaceData *face_data_get(FT_Face face, unsigned int which,
+                                     FT_Error (*func)(FT_Face, FaceData *)) {
+  FaceDataBuild build;
+
+  /* test the bits under the lock, as other tables may be being built */
+  lock_acquire(face_lock(face));
+  build.data = face_data_find(face);
+  build.built = build.data && (build.data->built & which);
+  pthread_mutex_unlock(face_lock(face));
+  if (build.built)
+    return build.data;
+
+  build.face = face;
+  build.func = func;
+  build.which = which;
+  face_call(face, face_data_build_nogvl, &build);
+  if (build.err != FT_Err_Ok)
+    handle_error(build.err);
+
+  return build.built ? build.data : NULL;
 }
 
-/*
- * Return the underline thickness of this FT2::Face object.
- *
- * Description:
- *  The thickness, in font units, of the underline for this face. Only
- *  relevant for scalable formats.
- *
- * Examples:
- *   ut = face.underline_thickness
- *
- */
-static VALUE ft_face_underline_thickness(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX((int) (*face)->underline_thickness);
+/* the advance table of `face' (see face_data_advances) */
+static const FT_Int *face_advances(FT_Face face) {
+  return face_data_get(face, FACE_DATA_ADVANCES, face_data_advances)->advances;
 }
+
 /*
- * Return the glyph slot associated with this FT2::Face object.
- *
- * Description:
- *  The face's associated glyph slot(s) (a FT2::GlyphSlot). This object
- *  is created automatically with a new FT2::Face object. However,
- *  certain kinds of applications (mainly tools like converters) can
- *  need more than one slot to ease their task.
- *
- * Examples:
- *   glyph = face.glyph
- *
+ * The tables to pass to face_char_index: those of `face' with its
+ * Unicode table built, if a Unicode charmap is selected, or NULL.
  */
-static VALUE ft_face_glyph(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
+static const FaceData *face_cmap(FT_Face face) {
+  if (!face->charmap || face->charmap->encoding != FT_ENCODING_UNICODE)
+    return NULL;
+  return face_data_get(face, FACE_DATA_CMAP, face_data_cmap);
+}
 
-  if ((*face)->glyph)
-    return Data_Wrap_Struct(cGlyphSlot, 0, dont_free, &((*face)->glyph));
-  else
-    return Qnil;
+/* the glyph index of `code', from the Unicode table if it applies */
+static FT_UInt face_char_index(FT_Face face, const FaceData *data, FT_ULong code) {
+  if (data && data->cmap_charmap == face->charmap)
+    return face_data_cmap_lookup(data, code);
+  return FT_Get_Char_Index(face, code);
+}
+
+/* `str', converted to UTF-8 unless it is in UTF-8 or US-ASCII */
+static VALUE str_unicode(VALUE str) {
+  rb_encoding *enc;
+
+  StringValue(str);
+  enc = rb_enc_get(str);
+  if (enc != rb_utf8_encoding() && enc != rb_usascii_encoding())
+    str = rb_str_encode(str, rb_enc_from_encoding(rb_utf8_encoding()), 0, Qnil);
+
+  return str;
 }
 
 /*
- * Return the current active size of this FT2::Face object.
- *
- * Examples:
- *   size = face.size
- *
+ * The code point at `p' in a string from str_unicode, ending at `end';
+ * its length in bytes is stored in `*len'.  Raises if it is invalid.
  */
-static VALUE ft_face_size(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-
-  if ((*face)->size)
-    return Data_Wrap_Struct(cSize, 0, dont_free, (*face)->size);
-  else
-    return Qnil;
+static FT_ULong str_codepoint(const char *p, const char *end, int *len) {
+  if ((unsigned char) *p < 0x80) {
+    *len = 1;
+    return (unsigned char) *p;
+  }
+  return rb_enc_codepoint_len(p, end, len, rb_utf8_encoding());
 }
 
 /*
- * Return the current active FT2::CharMap of this FT2::Face object.
- *
- * Examples:
- *   size = face.size
- *
+ * The glyph indices in `ids', an array of integers or a string of
+ * native 32-bit unsigned integers (see FT2::Face#glyph_indices), as a
+ * temporary heap buffer held by `*tmp' (free it with ALLOCV_END).
  */
-static VALUE ft_face_charmap(VALUE self) {
-  FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
+static FT_UInt32 *glyph_ids_get(VALUE ids, volatile VALUE *tmp, long *count) {
+  FT_UInt32 *glyphs;
+  long i;
+
+  if (RB_TYPE_P(ids, T_STRING)) {
+    if (RSTRING_LEN(ids) % sizeof(FT_UInt32))
+      rb_raise(rb_eArgError, "Invalid glyph id string length: %ld.", RSTRING_LEN(ids));
+    *count = RSTRING_LEN(ids) / sizeof(FT_UInt32);
+    glyphs = rb_alloc_tmp_buffer(tmp, (*count + 1) * sizeof(FT_UInt32));
+    memcpy(glyphs, RSTRING_PTR(ids), *count * sizeof(FT_UInt32));
+    return glyphs;
+  }
 
-  if ((*face)->charmap)
-    return Data_Wrap_Struct(cCharMap, 0, dont_free, (*face)->charmap);
-  else
-    return Qnil;
+  Check_Type(ids, T_ARRAY);
+  *count = RARRAY_LEN(ids);
+  glyphs = rb_alloc_tmp_buffer(tmp, (*count + 1) * sizeof(FT_UInt32));
+  for (i = 0; i < *count; i++)
+    glyphs[i] = NUM2UINT(RARRAY_AREF(ids, i));
+  return glyphs;
 }
 
 /*
- * Attach a font file to this FT2::Face object.
+ * Allocate and initialize a new FT2::Face object.
  *
- * Description:
- *   This is usually to read additional information for a single face
- *   object. For example, it is used to read the AFM files that come
- *   with Type 1 fonts in order to add kerning data and other metrics.
- *   Throws an exception if the font file could not be loaded.
- *   FreeType2 also supports loading from an input stream, but this
- *   feature is not implemented in FT2-Ruby.
+ * Note:
+ *   FT2::Face objects are created under the calling thread's default
+ *   FT2::Library (see FT2::Library.default) if a library is not
+ *   specified.
+ *
+ *   Other Ruby threads keep running while the font file is opened.
+ *
+ * Aliases:
+ *   FT2::Face.load
  *
  * Examples:
- *   path = 'fonts'yudit.ttf'
- *   begin
- *     face.attach path  # attach file "fonts/yudit.ttf"
- *   rescue Exception
- *     $stderr.puts "Couldn't open font file \"#{path}\": " << $!
- *   end
+ *   # load font from file "yudit.ttf"
+ *   face = FT2::Face.new 'yudit.ttf'
+ *
+ *   # load second face from from file "yudit.ttf"
+ *   face = FT2::Face.new 'yudit.ttf', 1
+ *
+ *   # load font from file "yudit.ttf" under FT2::Library instance lib
+ *   face = FT2::Face.new lib, 'yudit.ttf'
  *
+ *   # load second face from file "yudit.ttf" under FT2::Library instance lib
+ *   face = FT2::Face.new lib, 'yudit.ttf', 1
  */
-static VALUE ft_face_attach(VALUE self, VALUE path) {
-  FT_Face *face;
+VALUE ft_face_new(int argc, VALUE *argv, VALUE klass) {
+  VALUE path;
+  FT_Library lib;
+  FT_Face face;
   FT_Error err;
-  Data_Get_Struct(self, FT_Face, face);
-  if ((err = FT_Attach_File(*face, RSTRING_PTR(path))) != FT_Err_Ok)
+  FT_Long face_index;
+
+  lib = NULL;
+  switch (argc) {
+    case 1:
+      path = argv[0];
+      face_index = 0;
+      break;
+    case 2:
+      if (rb_obj_is_kind_of(argv[0], rb_cString)) {
+        path = argv[0];
+        face_index = NUM2INT(argv[1]);
+      } else if (rb_obj_is_kind_of(argv[0], cLibrary)) {
+        lib = library_get(argv[0]);
+        path = argv[1];
+        face_index = 0;
+      } else {
+        rb_raise(rb_eArgError, "Invalid first argument.");
+      }
+      break;
+    case 3:
+      lib = library_get(argv[0]);
+      path = argv[1];
+      face_index = NUM2INT(argv[2]);
+      break;
+    default:
+      rb_raise(rb_eArgError, "Invalid argument count: %d.", argc);
+  }
+
+  FilePathValue(path);
+  if (!lib)
+    lib = current_library();
+
+  err = face_open_path(lib, RSTRING_PTR(path), face_index, &face);
+  if (err != FT_Err_Ok)
     handle_error(err);
-  return self;
+
+  return face_wrap(klass, face, lib);
 }
 
 /*
- * Set the character dimensions of this FT2::Face object.
- *
- * Description:
- *   Sets the character dimensions of a FT2::Face object. The
- *   `char_width' and `char_height' values are used for the width and
- *   height, respectively, expressed in 26.6 fractional points.
- *
- *   If the horizontal or vertical resolution values are zero, a default
- *   value of 72dpi is used. Similarly, if one of the character
- *   dimensions is zero, its value is set equal to the other.
- *
- *   When dealing with fixed-size faces (i.e., non-scalable formats),
- *   use the function FT2::Face#set_pixel_sizes .
- *
- * Examples:
- *   face.set_char_size char_width, char_height, horiz_res, vert_res
- *
+ * Ruby objects backing faces created with FT2::Face.new_from_memory and
+ * FT2::Face.from_io.  FreeType reads the font data lazily, so the source
+ * object must neither be collected nor modified while any face still
+ * uses it.  Every pinned object is marked (which also keeps compaction
+ * from moving it) until the last face using it is freed.
  */
-static VALUE ft_face_set_char_size(VALUE self, VALUE c_w, VALUE c_h, VALUE h_r, VALUE v_r) {
-  FT_Face *face;
+typedef struct PinnedObject {
+  VALUE obj;
+  int   locked;     /* obj is an IO::Buffer we locked */
+  long  refcount;
+  struct PinnedObject *next;
+} PinnedObject;
+
+static PinnedObject *pinned_objects = NULL;
+static VALUE pinned_objects_holder = Qnil;
+static int vm_shutting_down = 0;
+
+/* the list is shared by every Ractor */
+static pthread_mutex_t pinned_objects_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * At exit the VM frees every object regardless of reachability, so the
+ * pinned objects may already be gone by the time their faces are freed.
+ * This is the finalizer of pinned_objects_holder, which is never
+ * collected: it runs after every at_exit hook (which may still be using
+ * faces, as test runners do), just before the objects are freed.
+ */
+static VALUE pinned_objects_at_exit(RB_BLOCK_CALL_FUNC_ARGLIST(unused, data)) {
+  UNUSED(unused);
+  UNUSED(data);
+  vm_shutting_down = 1;
+  return Qnil;
+}
+
+static void pinned_objects_mark(void *ptr) {
+  PinnedObject *pin;
+  UNUSED(ptr);
+
+  for (pin = pinned_objects; pin; pin = pin->next)
+    rb_gc_mark(pin->obj);
+}
+
+/* rb_gc_mark, not rb_gc_mark_movable: FreeType holds the raw pointers */
+static const rb_data_type_t pinned_objects_type = {
+  "FT2::PinnedObjects",
+  { pinned_objects_mark, 0, 0, },
+  0, 0,
+  0,
+};
+
+/* call with pinned_objects_lock held */
+static PinnedObject *pinned_object_find(VALUE obj) {
+  PinnedObject *pin;
+
+  for (pin = pinned_objects; pin; pin = pin->next)
+    if (pin->obj == obj)
+      return pin;
+
+  return NULL;
+}
+
+#ifdef HAVE_RUBY_IO_BUFFER_H
+static int pinned_object_p(VALUE obj) {
+  int found;
+
+  pthread_mutex_lock(&pinned_objects_lock);
+  found = pinned_object_find(obj) != NULL;
+  pthread_mutex_unlock(&pinned_objects_lock);
+
+  return found;
+}
+#endif /* HAVE_RUBY_IO_BUFFER_H */
+
+static PinnedObject *pinned_object_acquire(VALUE obj) {
+  PinnedObject *pin;
+
+  pthread_mutex_lock(&pinned_objects_lock);
+  if ((pin = pinned_object_find(obj)) == NULL) {
+    if ((pin = malloc(sizeof(PinnedObject))) == NULL) {
+      pthread_mutex_unlock(&pinned_objects_lock);
+      rb_memerror();
+    }
+    pin->obj = obj;
+    pin->locked = 0;
+    pin->refcount = 0;
+    pin->next = pinned_objects;
+    pinned_objects = pin;
+  }
+  pin->refcount++;
+  pthread_mutex_unlock(&pinned_objects_lock);
+
+  return pin;
+}
+
+static void pinned_object_release(PinnedObject *pin) {
+  PinnedObject **p;
+
+  pthread_mutex_lock(&pinned_objects_lock);
+  if (--pin->refcount > 0) {
+    pthread_mutex_unlock(&pinned_objects_lock);
+    return;
+  }
+
+  for (p = &pinned_objects; *p; p = &(*p)->next) {
+    if (*p == pin) {
+      *p = pin->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pinned_objects_lock);
+
+#ifdef HAVE_RUBY_IO_BUFFER_H
+  /*
+   * Safe even when called from a face being swept: the buffer was
+   * marked through the pin list, so it survives this GC cycle.
+   */
+  if (pin->locked && !vm_shutting_down)
+    rb_io_buffer_unlock(pin->obj);
+#endif /* HAVE_RUBY_IO_BUFFER_H */
+
+  free(pin);
+}
+
+static void pinned_object_face_finalizer(void *object) {
+  FT_Face face = (FT_Face) object;
+  pinned_object_release((PinnedObject *) face->generic.data);
+}
+
+static PinnedObject *pinned_buffer_acquire(VALUE obj, const void **base, size_t *size) {
+  PinnedObject *pin;
+
+  if (rb_obj_is_kind_of(obj, rb_cString)) {
+    rb_obj_freeze(obj);
+    *base = RSTRING_PTR(obj);
+    *size = RSTRING_LEN(obj);
+    pin = pinned_object_acquire(obj);
+#ifdef HAVE_RUBY_IO_BUFFER_H
+  } else if (rb_obj_is_kind_of(obj, rb_cIOBuffer)) {
+    /* locking keeps the buffer from being resized, transferred or freed */
+    if (!pinned_object_p(obj))
+      rb_io_buffer_lock(obj);
+    rb_io_buffer_get_bytes_for_reading(obj, base, size);
+    pin = pinned_object_acquire(obj);
+    pin->locked = 1;
+#endif /* HAVE_RUBY_IO_BUFFER_H */
+  } else {
+    rb_raise(rb_eTypeError, "Invalid font buffer (expected String or IO::Buffer).");
+  }
+
+  return pin;
+}
+
+static VALUE face_new_from_buffer(VALUE klass, FT_Library lib, VALUE buf, long len, FT_Long face_index) {
+  PinnedObject *pin;
+  FT_Face face;
   FT_Error err;
-  Data_Get_Struct(self, FT_Face, face);
-  err = FT_Set_Char_Size(*face, NUM2DBL(c_w), NUM2DBL(c_h), NUM2INT(h_r), NUM2INT(v_r));
-  if (err != FT_Err_Ok)
+  const void *mem;
+  size_t size;
+  int state;
+
+  pin = pinned_buffer_acquire(buf, &mem, &size);
+  if (len < 0)
+    len = size;
+  if ((size_t) len > size) {
+    pinned_object_release(pin);
+    rb_raise(rb_eArgError, "Invalid buffer size: %ld.", len);
+  }
+
+  err = face_open_memory_protect(lib, mem, len, face_index, &face, &state);
+  if (state || err != FT_Err_Ok) {
+    pinned_object_release(pin);
+    if (state)
+      rb_jump_tag(state);
     handle_error(err);
-  return self;
+  }
+
+  face->generic.data = pin;
+  face->generic.finalizer = pinned_object_face_finalizer;
+
+  return face_wrap(klass, face, lib);
 }
 
 /*
- * Set the character dimensions of this FT2::Face object.
+ * Allocate and initialize a new FT2::Face object from in-memory buffer.
  *
  * Description:
- *   Sets the character dimensions of a FT2::Face object. The width and
- *   height are expressed in integer pixels.
+ *   The face is parsed in place, without copying the buffer.  The
+ *   buffer may be a String (which is frozen) or an IO::Buffer (which is
+ *   locked, and may itself be a mapping created with IO::Buffer.map).
+ *   The buffer is kept alive and unmodifiable for as long as any face
+ *   created from it exists, so callers don't need to hold on to it.
  *
- *   If one of the character dimensions is zero, its value is set equal
- *   to the other.
+ * Note:
+ *   FT2::Face objects are created under the calling thread's default
+ *   FT2::Library (see FT2::Library.default) if a library is not
+ *   specified.
  *
- *   The values of `pixel_width' and `pixel_height' correspond to the
- *   pixel values of the typographic character size, which are NOT
- *   necessarily the same as the dimensions of the glyph `bitmap cells'.
+ *   The buffer size may not exceed the size of the buffer.
  *
- *   The `character size' is really the size of an abstract square
- *   called the `EM', used to design the font. However, depending on the
- *   font design, glyphs will be smaller or greater than the EM.
+ * Examples:
+ *   # load font from string _buffer_
+ *   face = FT2::Face.new_from_memory buffer, buffer.bytesize
  *
- *   This means that setting the pixel size to, say, 8x8 doesn't
- *   guarantee in any way that you will get glyph bitmaps that all fit
- *   within an 8x8 cell (sometimes even far from it).
+ *   # load second face from string _buffer_
+ *   face = FT2::Face.new_from_memory buffer, buffer.bytesize, 1
  *
- * Examples:
- *   face.set_pixel_sizes pixel_width, pixel_height
+ *   # load font from a mapped file
+ *   buffer = IO::Buffer.map File.open('yudit.ttf'), nil, 0, IO::Buffer::READONLY
+ *   face = FT2::Face.new_from_memory buffer, buffer.size
  *
+ *   # load font from string _buffer_ under FT2::Library instance _lib_
+ *   face = FT2::Face.new_from_memory lib, buffer, buffer_size
+ *
+ *   # load second face from string _buffer_ under FT2::Library instance _lib_
+ *   face = FT2::Face.new_from_memory lib, buffer, buffer_size, 1
  */
-static VALUE ft_face_set_pixel_sizes(VALUE self, VALUE pixel_w, VALUE pixel_h) {
-  FT_Face *face;
-  FT_Error err;
-  Data_Get_Struct(self, FT_Face, face);
-  err = FT_Set_Pixel_Sizes(*face, NUM2INT(pixel_w), NUM2INT(pixel_h));
-  if (err != FT_Err_Ok)
-    handle_error(err);
-  return self;
+VALUE ft_face_new_from_memory(int argc, VALUE *argv, VALUE klass) {
+  VALUE buf;
+  FT_Library lib;
+  FT_Long face_index;
+  long len;
+
+  lib = NULL;
+  switch (argc) {
+    case 2:
+      buf = argv[0];
+      len = NUM2LONG(argv[1]);
+      face_index = 0;
+      break;
+    case 3:
+      if (!rb_obj_is_kind_of(argv[0], cLibrary)) {
+        buf = argv[0];
+        len = NUM2LONG(argv[1]);
+        face_index = NUM2INT(argv[2]);
+      } else {
+        lib = library_get(argv[0]);
+        buf = argv[1];
+        len = NUM2LONG(argv[2]);
+        face_index = 0;
+      }
+      break;
+    case 4:
+      lib = library_get(argv[0]);
+      buf = argv[1];
+      len = NUM2LONG(argv[2]);
+      face_index = NUM2INT(argv[3]);
+      break;
+    default:
+      rb_raise(rb_eArgError, "Invalid argument count: %d.", argc);
+  }
+
+  return face_new_from_buffer(klass, lib ? lib : current_library(), buf, len, face_index);
 }
 
 /*
- * Set the pre-render transoformation matrix and vector of a FT2::Face object.
+ * FT_Stream reading from a Ruby IO object.  FreeType asks for byte
+ * ranges as it needs them; small reads (FreeType reads most table
+ * headers a few bytes at a time) are served from a read-ahead window
+ * so they don't each turn into a Ruby method call.
+ */
+#define IO_STREAM_WINDOW 4096
+
+typedef struct {
+  FT_StreamRec   stream;    /* must be first, FreeType passes FT_Stream */
+  PinnedObject  *pin;       /* keeps the IO alive */
+  unsigned long  base;      /* offset of the font within the IO */
+  unsigned long  window_pos,
+                 window_len;
+  int            state,     /* tag of an exception raised by the IO ... */
+                *pending;   /* ... left here (&state or the opener's) */
+  unsigned char  window[IO_STREAM_WINDOW];
+} IOStream;
+
+typedef struct {
+  IOStream      *io_stream;
+  unsigned long  offset,
+                 count;
+  unsigned char *dest;
+} IOStreamRead;
+
+static ID id_seek, id_read, id_size, id_pos;
+
+static VALUE io_stream_read_protected(VALUE arg) {
+  IOStreamRead *rd = (IOStreamRead *) arg;
+  VALUE io = rd->io_stream->pin->obj, str;
+  unsigned long len;
+
+  rb_funcall(io, id_seek, 1, ULONG2NUM(rd->io_stream->base + rd->offset));
+  str = rb_funcall(io, id_read, 1, ULONG2NUM(rd->count));
+  if (str == Qnil)
+    return INT2FIX(0);
+
+  StringValue(str);
+  len = RSTRING_LEN(str);
+  if (len > rd->count)
+    len = rd->count;
+  memcpy(rd->dest, RSTRING_PTR(str), len);
+
+  return ULONG2NUM(len);
+}
+
+static unsigned long io_stream_fetch(IOStream *s, unsigned long offset, unsigned char *dest, unsigned long count) {
+  IOStreamRead rd;
+  VALUE len;
+  int state = 0;
+
+  /* don't call into the IO again until the exception is re-raised */
+  if (*s->pending)
+    return 0;
+
+  rd.io_stream = s;
+  rd.offset = offset;
+  rd.count = count;
+  rd.dest = dest;
+
+  len = rb_protect(io_stream_read_protected, (VALUE) &rd, &state);
+  if (state) {
+    /* FreeType sees a short read; the exception is raised once it returns */
+    *s->pending = state;
+    return 0;
+  }
+
+  return NUM2ULONG(len);
+}
+
+/* re-raise an exception left by the IO of a face, see io_stream_fetch */
+static void io_stream_check(FT_Face face) {
+  IOStream *s;
+  int state;
+
+  if (!(face->face_flags & FT_FACE_FLAG_EXTERNAL_STREAM))
+    return;
+
+  s = (IOStream *) face->stream;
+  if ((state = s->state) != 0) {
+    s->state = 0;
+    rb_jump_tag(state);
+  }
+}
+
+static unsigned long io_stream_read(FT_Stream stream, unsigned long offset, unsigned char *buffer, unsigned long count) {
+  IOStream *s = (IOStream *) stream;
+  unsigned long len;
+
+  /* a zero count is a seek request; zero means success */
+  if (count == 0)
+    return (offset > stream->size) ? 1 : 0;
+
+  if (count > IO_STREAM_WINDOW)
+    return io_stream_fetch(s, offset, buffer, count);
+
+  if (offset < s->window_pos || offset + count > s->window_pos + s->window_len) {
+    s->window_pos = offset;
+    s->window_len = io_stream_fetch(s, offset, s->window, IO_STREAM_WINDOW);
+  }
+
+  if (offset >= s->window_pos + s->window_len)
+    return 0;
+
+  len = s->window_pos + s->window_len - offset;
+  if (len > count)
+    len = count;
+  memcpy(buffer, s->window + (offset - s->window_pos), len);
+
+  return len;
+}
+
+static void io_stream_close(FT_Stream stream) {
+  IOStream *s = (IOStream *) stream;
+  pinned_object_release(s->pin);
+  free(s);
+}
+
+/*
+ * Allocate and initialize a new FT2::Face object from a Ruby IO object.
  *
  * Description:
- *   Used to set the transformation that is applied to glyph images just
- *   before they are converted to bitmaps in a FT2::GlyphSlot when
- *   FT2::GlyphSlot#render is called.
+ *   The face is read through a FreeType stream over `io', which may be
+ *   any object responding to `read', `seek', `pos' and `size' (File,
+ *   StringIO, etc).  FreeType reads only the parts of the font it
+ *   needs, when it needs them, so querying names and metrics of a large
+ *   font reads a small fraction of the file.  The font is expected to
+ *   start at the current position of `io'.
  *
- *   matrix: The transformation's 2x2 matrix. Use nil for the identity
- *           matrix.
- *   delta: The translation vector. Use nil for the null vector.
+ *   Objects which can't seek or don't know their size (pipes, sockets)
+ *   are read to the end and the face is created from the result, as if
+ *   by FT2::Face.new_from_memory.
  *
  * Note:
- *   The transformation is only applied to scalable image formats after
- *   the glyph has been loaded. It means that hinting is unaltered by
- *   the transformation and is performed on the character size given in
- *   the last call to FT2::Face#set_char_sizes or
- *   FT2::Face#set_pixel_sizes.
+ *   `io' is kept open and referenced by the face for as long as the
+ *   face exists, and FreeType may seek and read it at any time (e.g.
+ *   when loading glyphs).  Don't read from or close it in the meantime.
+ *   Exceptions raised by `io' propagate to the caller once FreeType
+ *   has returned.
  *
  * Examples:
- *   matrix = [[0, 1],
- *             [0, 1]]
- *   vector = nil
+ *   # stream font from file "yudit.ttf"
+ *   face = FT2::Face.from_io File.open('yudit.ttf', 'rb')
  *
- *   face.set_transform matrix, vector
+ *   # stream second face of a font collection
+ *   face = FT2::Face.from_io File.open('fonts.ttc', 'rb'), 1
+ *
+ *   # read a font from a pipe
+ *   face = FT2::Face.from_io IO.popen(['fetch-font', name])
  *
  */
-static VALUE ft_face_set_transform(VALUE self, VALUE matrix, VALUE delta) {
-  FT_Face *face;
-  FT_Matrix m;
-  FT_Vector v;
+static VALUE ft_face_from_io(int argc, VALUE *argv, VALUE klass) {
+  VALUE io, index;
+  IOStream *s;
+  FT_Open_Args args;
+  FT_Library lib;
+  FT_Face face;
+  FT_Error err;
+  FT_Long face_index;
+  unsigned long base, size;
+  int state = 0, open_state;
+
+  rb_scan_args(argc, argv, "11", &io, &index);
+  face_index = (index == Qnil) ? 0 : NUM2LONG(index);
+  lib = current_library();
+
+  if (!rb_respond_to(io, id_size) || !rb_respond_to(io, id_seek) ||
+      !rb_respond_to(io, id_pos))
+    return face_new_from_buffer(klass, lib, rb_funcall(io, id_read, 0), -1, face_index);
+
+  base = NUM2ULONG(rb_funcall(io, id_pos, 0));
+  size = NUM2ULONG(rb_funcall(io, id_size, 0));
+  if (size < base)
+    rb_raise(rb_eArgError, "IO is positioned past its end.");
+
+  if ((s = malloc(sizeof(IOStream))) == NULL)
+    rb_memerror();
+  memset(s, 0, sizeof(IOStream));
+  s->stream.size = size - base;
+  s->stream.read = io_stream_read;
+  s->stream.close = io_stream_close;
+  s->base = base;
+  s->pending = &state;  /* the stream is gone if opening fails */
+  s->pin = pinned_object_acquire(io);
+
+  memset(&args, 0, sizeof(args));
+  args.flags = FT_OPEN_STREAM;
+  args.stream = &s->stream;
+
+  /*
+   * FreeType closes the stream (see io_stream_close) on failure too,
+   * but not if the open raised before FreeType got the stream.
+   */
+  err = face_open_protect(lib, &args, face_index, &face, &open_state);
+  if (open_state) {
+    io_stream_close(&s->stream);
+    rb_jump_tag(open_state);
+  }
+  if (err == FT_Err_Ok) {
+    s->pending = &s->state;
+    if (state) {
+      face_release(face, NULL, lib);
+      rb_jump_tag(state);
+    }
+  } else {
+    if (state)
+      rb_jump_tag(state);
+    handle_error(err);
+  }
 
-  Data_Get_Struct(self, FT_Face, face);
+  return face_wrap(klass, face, lib);
+}
 
-  if (matrix != Qnil) {
-    /* FIXME: do I have these reversed? */
-    m.xx = DBL2FTFIX(NUM2DBL(rb_ary_entry(rb_ary_entry(matrix, 0), 0)));
-    m.xy = DBL2FTFIX(NUM2DBL(rb_ary_entry(rb_ary_entry(matrix, 1), 0)));
-    m.yx = DBL2FTFIX(NUM2DBL(rb_ary_entry(rb_ary_entry(matrix, 0), 1)));
-    m.yy = DBL2FTFIX(NUM2DBL(rb_ary_entry(rb_ary_entry(matrix, 1), 1)));
+/*
+ * Read-only mappings of font files, shared by every face opened from
+ * the same file with FT2::Face.open_mapped.  Each face holds one
+ * reference which is dropped by FreeType through the face's generic
+ * finalizer, so faces shared with FT_Reference_Face keep the mapping
+ * alive until the last of them is gone.
+ */
+typedef struct FontMapping {
+  char   *path;
+  dev_t   dev;
+  ino_t   ino;
+  time_t  mtime;
+  off_t   size;
+  void   *addr;
+  long    refcount;
+  struct FontMapping *next;
+} FontMapping;
+
+static FontMapping *font_mappings = NULL;
+static pthread_mutex_t font_mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* call with font_mappings_lock held */
+static FontMapping *font_mapping_find(const struct stat *st) {
+  FontMapping *map;
+
+  for (map = font_mappings; map; map = map->next)
+    if (map->dev == st->st_dev && map->ino == st->st_ino &&
+        map->mtime == st->st_mtime && map->size == st->st_size)
+      return map;
+
+  return NULL;
+}
+
+static FontMapping *font_mapping_acquire(const char *path) {
+  FontMapping *map;
+  struct stat st;
+  char *real;
+  void *addr;
+  int fd;
+
+  if ((real = realpath(path, NULL)) == NULL)
+    rb_sys_fail(path);
+
+  if ((fd = open(real, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0)
+      close(fd);
+    free(real);
+    rb_sys_fail(path);
   }
 
-  if (delta != Qnil) {
-    v.x = NUM2INT(rb_ary_entry(delta, 0));
-    v.y = NUM2INT(rb_ary_entry(delta, 1));
+  pthread_mutex_lock(&font_mappings_lock);
+  if ((map = font_mapping_find(&st)) != NULL)
+    map->refcount++;
+  pthread_mutex_unlock(&font_mappings_lock);
+  if (map) {
+    close(fd);
+    free(real);
+    return map;
   }
 
-  if (matrix != Qnil && delta != Qnil)
-    FT_Set_Transform(*face, &m, &v);
-  else if (matrix == Qnil && delta != Qnil)
-    FT_Set_Transform(*face, NULL, &v);
-  else if (matrix != Qnil && delta == Qnil)
-    FT_Set_Transform(*face, &m, NULL);
-  else
-    FT_Set_Transform(*face, NULL, NULL);
+  if (st.st_size == 0) {
+    close(fd);
+    free(real);
+    rb_raise(eFt2Error, "Empty font file \"%s\".", path);
+  }
 
-  return self;
+  addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    free(real);
+    rb_sys_fail(path);
+  }
+
+  pthread_mutex_lock(&font_mappings_lock);
+  if ((map = font_mapping_find(&st)) != NULL) {
+    /* another Ractor mapped the file in the meantime */
+    map->refcount++;
+    pthread_mutex_unlock(&font_mappings_lock);
+    munmap(addr, st.st_size);
+    free(real);
+    return map;
+  }
+
+  if ((map = malloc(sizeof(FontMapping))) == NULL) {
+    pthread_mutex_unlock(&font_mappings_lock);
+    munmap(addr, st.st_size);
+    free(real);
+    rb_memerror();
+  }
+  map->path = real;
+  map->dev = st.st_dev;
+  map->ino = st.st_ino;
+  map->mtime = st.st_mtime;
+  map->size = st.st_size;
+  map->addr = addr;
+  map->refcount = 1;
+  map->next = font_mappings;
+  font_mappings = map;
+  pthread_mutex_unlock(&font_mappings_lock);
+
+  return map;
 }
 
-/*
- * Load a glyph at a given size into a glyph slot of a FT2::Face object.
- *
- * Description:
- *   Load a glyph at a given size into a glyph slot of a FT2::Face
- *   object.
- *
- *   glyph_index: The index of the glyph in the font file.
- *   load_flags: A flag indicating what to load for this glyph. The
- *               FT2::Load::XXXX constants can be used to control the
- *               glyph loading process (e.g., whether the outline should
- *               be scaled, whether to load bitmaps or not, whether to
- *               hint the outline, etc).
- *
- * Note:
- *   If the glyph image is not a bitmap, and if the bit flag
- *   FT2::Load::IGNORE_TRANSFORM is unset, the glyph image will be
- *   transformed with the information passed to a previous call to
- *   FT2::Face#set_transform
+static void font_mapping_release(FontMapping *map) {
+  FontMapping **p;
+
+  pthread_mutex_lock(&font_mappings_lock);
+  if (--map->refcount > 0) {
+    pthread_mutex_unlock(&font_mappings_lock);
+    return;
+  }
+
+  for (p = &font_mappings; *p; p = &(*p)->next) {
+    if (*p == map) {
+      *p = map->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&font_mappings_lock);
+
+  munmap(map->addr, map->size);
+  free(map->path);
+  free(map);
+}
+
+static void font_mapping_face_finalizer(void *object) {
+  FT_Face face = (FT_Face) object;
+  font_mapping_release((FontMapping *) face->generic.data);
+}
+
+/*
+ * Allocate and initialize a new FT2::Face object from a memory-mapped font file.
  *
- *   Note that this also transforms the `face.glyph.advance' field, but
- *   not the values in `face.glyph.metrics'.
+ * Description:
+ *   The font file is mapped read-only with mmap(2) and the face is
+ *   parsed straight from the mapping.  Every face opened from the same
+ *   file (the other faces of a TrueType/OpenType collection, or the
+ *   same face opened again) shares a single mapping, so the font data
+ *   lives in the page cache rather than in each process' private heap.
+ *   The mapping is released when the last face using it is freed.
  *
- * Load Flags:
- *   FT2::Load::DEFAULT
- *   FT2::Load::RENDER
- *   FT2::Load::MONOCHROME
- *   FT2::Load::LINEAR_DESIGN
- *   FT2::Load::NO_SCALE
- *   FT2::Load::NO_HINTING
- *   FT2::Load::NO_BITMAP
- *   FT2::Load::CROP_BITMAP
- *   FT2::Load::VERTICAL_LAYOUT
- *   FT2::Load::IGNORE_TRANSFORM
- *   FT2::Load::IGNORE_GLOBAL_ADVANCE_WIDTH
- *   FT2::Load::FORCE_AUTOHINT
- *   FT2::Load::NO_RECURSE
- *   FT2::Load::PEDANTIC
+ * Note:
+ *   The font file must not be truncated or rewritten in place while it
+ *   is mapped.  Replacing it (e.g. with rename(2)) is safe; faces opened
+ *   afterwards get a fresh mapping.
  *
  * Examples:
- *   face.load_glyph 5, FT2::Load::DEFAULT
+ *   # map font file "yudit.ttf"
+ *   face = FT2::Face.open_mapped 'yudit.ttf'
+ *
+ *   # map second face from font collection "fonts.ttc"
+ *   face = FT2::Face.open_mapped 'fonts.ttc', 1
  *
  */
-static VALUE ft_face_load_glyph(VALUE self, VALUE glyph_index, VALUE flags) {
-  FT_Face *face;
+static VALUE ft_face_open_mapped(int argc, VALUE *argv, VALUE klass) {
+  VALUE path, index;
+  FontMapping *map;
+  FT_Library lib;
+  FT_Face face;
   FT_Error err;
+  FT_Long face_index;
+  int state;
 
-  Data_Get_Struct(self, FT_Face, face);
-  if (flags == Qnil)
-    flags = INT2FIX(FT_LOAD_DEFAULT);
+  rb_scan_args(argc, argv, "11", &path, &index);
+  FilePathValue(path);
+  face_index = (index == Qnil) ? 0 : NUM2LONG(index);
+  lib = current_library();
 
-  err = FT_Load_Glyph(*face, NUM2INT(glyph_index), NUM2INT(flags));
-  if (err != FT_Err_Ok)
+  map = font_mapping_acquire(RSTRING_PTR(path));
+
+  err = face_open_memory_protect(lib, map->addr, map->size, face_index, &face, &state);
+  if (state || err != FT_Err_Ok) {
+    font_mapping_release(map);
+    if (state)
+      rb_jump_tag(state);
     handle_error(err);
+  }
 
-  return self;
+  face->generic.data = map;
+  face->generic.finalizer = font_mapping_face_finalizer;
+
+  return face_wrap(klass, face, lib);
 }
 
 /*
- * Load a glyph at a given size into a glyph slot of a FT2::Face object.
+ * Constructor for FT2::Face.
  *
- * Description:
- *   Load a glyph at a given size into a glyph slot of a FT2::Face
- *   object according to its character code.
+ * This method is currently empty.  You should never call this method
+ * directly unless you're instantiating a derived class (ie, you know
+ * what you're doing).
  *
- *   char_code: The glyph's character code, according to the current
- *              charmap used in the FT2::Face object.
- *   load_flags: A flag indicating what to load for this glyph. The
- *               FT2::Load::XXXX constants can be used to control the
- *               glyph loading process (e.g., whether the outline should
- *               be scaled, whether to load bitmaps or not, whether to
- *               hint the outline, etc).
+ */
+static VALUE ft_face_init(VALUE self) {
+  return self;
+}
+
+/*
+ * Return the number of faces in an FT2::Face object.
  *
- * Note:
- *   If the face has no current charmap, or if the character code is not
- *   defined in the charmap, this function will return an error.
+ * Aliases:
+ *   FT2::Face#num_faces
  *
- *   If the glyph image is not a bitmap, and if the bit flag
- *   FT2::Load::IGNORE_TRANSFORM is unset, the glyph image will be
- *   transformed with the information passed to a previous call to
- *   FT2::Face#set_transform
+ * Examples:
+ *   num_faces = face.faces
  *
- *   Note that this also transforms the `face.glyph.advance' field, but
- *   not the values in `face.glyph.metrics'.
+ */
+static VALUE ft_face_faces(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->num_faces);
+}
+
+/*
+ * Return the index of an FT2::Face object in its font file.
  *
- * Load Flags:
- *   FT2::Load::DEFAULT
- *   FT2::Load::RENDER
- *   FT2::Load::MONOCHROME
- *   FT2::Load::LINEAR_DESIGN
- *   FT2::Load::NO_SCALE
- *   FT2::Load::NO_HINTING
- *   FT2::Load::NO_BITMAP
- *   FT2::Load::CROP_BITMAP
- *   FT2::Load::VERTICAL_LAYOUT
- *   FT2::Load::IGNORE_TRANSFORM
- *   FT2::Load::IGNORE_GLOBAL_ADVANCE_WIDTH
- *   FT2::Load::FORCE_AUTOHINT
- *   FT2::Load::NO_RECURSE
- *   FT2::Load::PEDANTIC
+ * Note:
+ *   This is almost always zero.
+ *
+ * Aliases:
+ *   FT2::Face#face_index
  *
  * Examples:
- *   face.load_char 5, FT2::Load::DEFAULT
+ *   index = face.index
  *
  */
-static VALUE ft_face_load_char(VALUE self, VALUE char_code, VALUE flags) {
+static VALUE ft_face_index(VALUE self) {
   FT_Face *face;
-  FT_Error err;
-  Data_Get_Struct(self, FT_Face, face);
-  err = FT_Load_Char(*face, NUM2INT(char_code), NUM2INT(flags));
-  if (err != FT_Err_Ok)
-    handle_error(err);
-  return self;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->face_index);
 }
 
 /*
- * Get the glyph index of a character code.
+ * Return the face flags of an FT2::Face object.
  *
- * Note:
- *   This function uses a charmap object in order to do the translation.
+ * You can binary OR this with any of the following values to obtain the
+ * value of that flag (note that this is returned as an Integer and not
+ * as a boolean value; eg non-zero for true and zero for false).
  *
- *   FreeType computes its own glyph indices which are not necessarily
- *   the same as used in the font in case the font is based on glyph
- *   indices. Reason for this behaviour is to assure that index 0 is
- *   never used, representing the missing glyph.
+ * Face Flags:
+ *   FT2::Face::SCALABLE
+ *   FT2::Face::FIXED_SIZES
+ *   FT2::Face::FIXED_WIDTH
+ *   FT2::Face::FIXED_HORIZONTAL
+ *   FT2::Face::FIXED_VERTICAL
+ *   FT2::Face::SFNT
+ *   FT2::Face::KERNING
+ *   FT2::Face::MULTIPLE_MASTERS
+ *   FT2::Face::GLYPH_NAMES
+ *   FT2::Face::EXTERNAL_STREAM
+ *   FT2::Face::FAST_GLYPHS
  *
- *   A return value of 0 means `undefined character code'.
+ * Alternatively, if you're only checking one flag, it's slightly faster
+ * (and arguably more concise), to use the following flag methods, which
+ * DO return true or false.
+ *
+ * Individual Flag Methods:
+ *   FT2::Face#scalable?
+ *   FT2::Face#fixed_sizes?
+ *   FT2::Face#fixed_width?
+ *   FT2::Face#horizontal?
+ *   FT2::Face#vertical?
+ *   FT2::Face#sfnt?
+ *   FT2::Face#kerning?
+ *   FT2::Face#external_stream?
+ *   FT2::Face#fast_glyphs?
+ *
+ * Aliases:
+ *   FT2::Face#face_flags
  *
  * Examples:
- *   index = face.char_index 65
- *   puts 'undefined character code' if index == 0
+ *   if (face.flags & (FT2::Face::FAST_GLYPHS | FT2::Face::KERNING) != 0)
+ *     puts 'face contains fast glyphs and kerning information'
+ *   end
  *
  */
-static VALUE ft_face_char_index(VALUE self, VALUE char_code) {
+static VALUE ft_face_flags(VALUE self) {
   FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX(FT_Get_Char_Index(*face, NUM2INT(char_code)));
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->face_flags);
 }
 
 /*
- * Get the glyph index of a given glyph name.
+ * Is this FT2::Face scalable?
  *
- * Note:
- *   This method uses driver specific objects to do the translation.
+ * Examples:
+ *   puts "is scalable" if face.scalable?
  *
- *   A return value of 0 means `undefined character code'.
+ */
+static VALUE ft_face_flag_scalable(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_SCALABLE) ? Qtrue : Qfalse;
+}
+
+/*
+ * Does this FT2::Face contain bitmap strikes for some pixel sizes?
  *
  * Examples:
- *   index = face.name_index glyph_name
+ *   puts "contains fixed sized glyphs" if face.fixed_sizes?
  *
  */
-static VALUE ft_face_name_index(VALUE self, VALUE glyph_name) {
+static VALUE ft_face_flag_fixed_sizes(VALUE self) {
   FT_Face *face;
-  Data_Get_Struct(self, FT_Face, face);
-  return INT2FIX(FT_Get_Name_Index(*face, RSTRING_PTR(glyph_name)));
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_FIXED_SIZES) ? Qtrue : Qfalse;
 }
 
 /*
- * Get the kerning vector between two glyphs of a FT2::Face object.
+ * Does this FT2::Face contain fixed with characters?
  *
- * Description:
- *   Get the kerning vector between two glyphs of a FT2::Face object.
+ * Examples:
+ *   puts "contains fixed width characters" if face.fixed_width?
  *
- *   left_glyph: The index of the left glyph in the kern pair.
- *   right_glyph: The index of the right glyph in the kern pair.
- *   kern_mode: One of the FT2::KerningMode::XXXX constants. Determines
- *              the scale/dimension of the returned kerning vector.
+ */
+static VALUE ft_face_flag_fixed_width(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_FIXED_WIDTH) ? Qtrue : Qfalse;
+}
+
+/*
+ * Does this FT2::Face contain horizontal glyph metrics?
  *
- *   Passing kern_mode == nil is the same as FT2::KerningMode::DEFAULT.
+ * Note:
+ *   This flag is true for virtually all fonts.
  *
- *   Returns a kerning vector (actually a two-element array). This is in
- *   font units for scalable formats, and in pixels for fixed-sizes
- *   formats.
+ * Examples:
+ *   puts "contains horizontal glyph metrics" if face.horizontal?
  *
- * Kerning Modes:
- *   FT2::KerningMode::DEFAULT
- *   FT2::KerningMode::UNFITTED
- *   FT2::KerningMode::UNSCALED
+ */
+static VALUE ft_face_flag_horizontal(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_HORIZONTAL) ? Qtrue : Qfalse;
+}
+
+/*
+ * Does this FT2::Face contain vertical glyph metrics?
  *
- * Examples:
- *   left_glyph = 10
- *   left_glyph = 11
- *   k_v = face.kerning left_glyph, right_glyph, nil
+ * Note:
+ *   If this flag is not set, the glyph loader will synthesize vertical
+ *   metrics itself.
  *
- *   # another example, w/o default options
- *   k_v = face.get_kerning 12, 13, FT2::KerningMode::UNFITTED
+ * Examples:
+ *   puts "contains vertical glyph metrics" if face.vertical?
  *
  */
-static VALUE ft_face_kerning(VALUE self, VALUE left_glyph, VALUE right_glyph, VALUE kern_mode) {
+static VALUE ft_face_flag_vertical(VALUE self) {
   FT_Face *face;
-  FT_Error err;
-  FT_Vector v;
-  VALUE ary;
-
-  Data_Get_Struct(self, FT_Face, face);
-  ary = rb_ary_new();
-
-  if (kern_mode == Qnil)
-    kern_mode = NUM2INT(ft_kerning_default);
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_VERTICAL) ? Qtrue : Qfalse;
+}
 
-  err = FT_Get_Kerning(*face, NUM2INT(left_glyph), NUM2INT(right_glyph), NUM2INT(kern_mode), &v);
-  if (err != FT_Err_Ok)
-    handle_error(err);
+/*
+ * Is this FT2::Face stored in the 'sfnt' storage format?
+ *
+ * Note:
+ *   This currently means the file was either TrueType or OpenType.
+ *
+ * Examples:
+ *   puts "sfnt format font" if face.sfnt?
+ *
+ */
+static VALUE ft_face_flag_sfnt(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_SFNT) ? Qtrue : Qfalse;
+}
 
-  rb_ary_push(ary, INT2FIX(v.x));
-  rb_ary_push(ary, INT2FIX(v.y));
+/*
+ * Does this FT2::Face contain kerning information?
+ *
+ * Examples:
+ *   puts "face contains kerning information" if face.kerning?
+ *
+ */
+static VALUE ft_face_flag_kerning(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_KERNING) ? Qtrue : Qfalse;
+}
+
+/*
+ * Was this FT2::Face loaded from an external stream?
+ *
+ * Examples:
+ *   puts "face loaded from external stream" if face.external_stream?
+ *
+ */
+static VALUE ft_face_flag_external_stream(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_EXTERNAL_STREAM) ? Qtrue : Qfalse;
+}
+
+/*
+ * Does this FT2::Face contain fast glyphs?
+ *
+ * Note:
+ *   This flag is usually set for fixed-size formats like FNT.
+ *
+ * Examples:
+ *   puts "face contains fast glyphs" if face.fast_glyphs?
+ *
+ */
+static VALUE ft_face_flag_fast_glyphs(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->face_flags & FT_FACE_FLAG_FAST_GLYPHS) ? Qtrue : Qfalse;
+}
+
+/*
+ * Return the style flags of an FT2::Face object.
+ *
+ * You can binary OR this with any of the following values to obtain the
+ * value of that style flag (note that this is returned as an Integer
+ * and not as a boolean value; eg non-zero for true and zero for false).
+ *
+ * Style Flags:
+ *   FT2::Face::BOLD
+ *   FT2::Face::ITALIC
+ *
+ * Alternatively, if you're only checking one style flag, it's slightly
+ * faster (and arguably more concise), to use the following style flag
+ * methods, which DO return true or false.
+ *
+ * Individual Style Flag Methods:
+ *   FT2::Face#bold?
+ *   FT2::Face#italic?
+ *
+ * Examples:
+ *   style = face.style_flags
+ *
+ */
+static VALUE ft_face_style_flags(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->style_flags);
+}
+
+/*
+ * Is this a bold FT2::Face?
+ *
+ * Examples:
+ *   puts "bold face" if face.bold?
+ *
+ */
+static VALUE ft_face_flag_bold(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->style_flags & FT_STYLE_FLAG_BOLD) ? Qtrue : Qfalse;
+}
+
+/*
+ * Is this an italic FT2::Face?
+ *
+ * Examples:
+ *   puts "italic face" if face.italic?
+ *
+ */
+static VALUE ft_face_flag_italic(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return ((*face)->style_flags & FT_STYLE_FLAG_ITALIC) ? Qtrue : Qfalse;
+}
+
+/*
+ * Return the number of glyphs in an FT2::Face object.
+ *
+ * Aliases:
+ *   FT2::Face#num_glyphs
+ *
+ * Examples:
+ *   count = face.glyphs
+ *   puts "face has #{count.to_str} glyphs"
+ *
+ */
+static VALUE ft_face_glyphs(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->num_glyphs);
+}
+
+/*
+ * Return the family name of an FT2::Face object.
+ *
+ * Description:
+ *   This is an ASCII string, usually in English, which describes the
+ *   FT2::Face object's family (eg "Times New Roman" or "Geneva"). Some
+ *   formats (eg Truetype and OpenType) provide localized and Unicode
+ *   versions of this string, which are accessable via the format specific
+ *   interfaces.
+ *
+ * Examples:
+ *   puts 'family: ' << face.family
+ *
+ */
+static VALUE ft_face_family(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return rb_str_new2((*face)->family_name);
+}
+
+/*
+ * Return the style name of an FT2::Face object.
+ *
+ * Description:
+ *   This is an ASCII string, usually in English, which describes the
+ *   FT2::Face object's style (eg "Bold", "Italic", "Condensed", etc).
+ *   This field is optional and may be set to nil.
+ *
+ * Examples:
+ *   puts 'style: ' << face.style if face.style
+ *
+ */
+static VALUE ft_face_style(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  if (!(*face)->style_name)
+    return Qnil;
+  return rb_str_new2((*face)->style_name);
+}
+
+/*
+ * Return the number of fixed sizes in an FT2::Face object.
+ *
+ * Note:
+ *   This should be set to 0 for scalable fonts, unless the FT2::Face
+ *   object contains a complete set of glyphs for the specified size.
+ *
+ * Aliases:
+ *   FT2::Face#num_fixed_sizes
+ *
+ * Examples:
+ *   puts 'fized sizes count: ' << face.fixed_sizes
+ *
+ */
+static VALUE ft_face_fixed_sizes(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->num_fixed_sizes);
+}
+
+/*
+ * Return an array of sizes in an FT2::Face object.
+ *
+ * Note:
+ *   This method does not currently work..
+ *
+ * Examples:
+ *   face.available_sizesdflksjaflksdjf FIXME
+ *
+ */
+static VALUE ft_face_available_sizes(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  /* FIXME!! */
+  return INT2FIX((*face)->available_sizes);
+}
+
+/*
+ * Return the number of charmaps in an FT2::Face object.
+ *
+ * Examples:
+ *   puts 'number of charmaps: ' << face.num_charmaps
+ *
+ */
+static VALUE ft_face_num_charmaps(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->num_charmaps);
+}
+
+/*
+ * Return an array of charmaps in an FT2::Face object.
+ *
+ * Note:
+ *   This method may not work correctly at the moment (FIXME).
+ *
+ * Examples:
+ *   face.charmaps.each { |map| puts map.to_str }
+ *
+ */
+static VALUE ft_face_charmaps(VALUE self) {
+  FT_Face *face;
+  VALUE ary;
+  int i;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+
+  /* FIXME */
+  rb_bug("not implemented yet");
+  ary = rb_ary_new();
+  for (i = 0; i < (*face)->num_charmaps; i++)
+    rb_ary_push(ary, INT2FIX(i));
 
   return ary;
 }
 
 /*
- * Get the ASCII name of a glyph in a FT2::Face object.
+ * Return the bounding box of an FT2::Face object.
+ *
+ * Note:
+ *   This method is not currently implemented (FIXME).
+ *
+ * Examples:
+ *   FIXME
+ *
+ */
+static VALUE ft_face_bbox(VALUE self) {
+  UNUSED(self);
+  /* FIXME */
+  rb_bug("not implemented yet");
+  return Qnil;
+}
+
+/*
+ * Return the number of font units per EM for this FT2::Face object.
+ *
+ * Description:
+ *   This value is typically 2048 for TrueType fonts, 1000 for Type1
+ *   fonts, and should be set to the (unrealistic) value 1 for
+ *   fixed-size fonts.
+ *
+ * Aliases:
+ *   FT2::Face#units_per_EM
+ *
+ * Examples:
+ *   em = face.units_per_em
+ *
+ */
+static VALUE ft_face_units_per_em(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->units_per_EM);
+}
+
+/*
+ * Return the ascender for this FT2::Face object.
+ *
+ * Description:
+ *   An FT2::Face object's ascender is the vertical distance, in font
+ *   units, from the baseline to the topmost point of any glyph in the
+ *   face.
+ *
+ * Examples:
+ *   asc = face.ascender
+ *
+ */
+static VALUE ft_face_ascender(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->ascender);
+}
+
+/*
+ * Return the descender for this FT2::Face object.
+ *
+ * Description:
+ *   An FT2::Face object's descender is the vertical distance, in font
+ *   units, from the baseline to the bottommost point of any glyph in
+ *   the face.
+ *
+ * Examples:
+ *   asc = face.descender
+ *
+ */
+static VALUE ft_face_descender(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->descender);
+}
+
+/*
+ * Return the height of this FT2::Face object.
+ *
+ * Description:
+ *   An FT2::Face object's height is the vertical distance, in font
+ *   units, from the baseline of one line to the baseline of the next.
+ *   The value can be computed as 'ascender + descender + line_gap',
+ *   where 'line_gap' is also called 'external leading'.
+ *
+ * Examples:
+ *   h = face.height
+ *
+ */
+static VALUE ft_face_height(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->height);
+}
+
+/*
+ * Return the maximal advance width of this FT2::Face object.
+ *
+ * Description:
+ *   The maximal advance width, in font units, for all glyphs in this
+ *   FT2::Face object.  This can be used to make word-wrapping
+ *   computations faster.  Only relevant for scalable formats.
+ *
+ * Examples:
+ *   maw = face.max_advance_width
+ *
+ */
+static VALUE ft_face_max_advance_width(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->max_advance_width);
+}
+
+/*
+ * Return the maximal advance height of this FT2::Face object.
+ *
+ * Description:
+ *   The maximal advance height, in font units, for all glyphs in this
+ *   FT2::Face object.  This can be used to make word-wrapping
+ *   computations faster.  Only relevant for scalable formats.
+ *
+ * Examples:
+ *   mah = face.max_advance_height
+ *
+ */
+static VALUE ft_face_max_advance_height(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->max_advance_height);
+}
+
+/*
+ * Return the underline position of this FT2::Face object.
+ *
+ * Description:
+ *   The position, in font units, of the underline line for this face.
+ *   It's the center of the underlining stem. Only relevant for scalable
+ *   formats.
+ *
+ * Examples:
+ *   uh = face.underline_position
+ *
+ */
+static VALUE ft_face_underline_position(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->underline_position);
+}
+
+/*
+ * Return the underline thickness of this FT2::Face object.
+ *
+ * Description:
+ *  The thickness, in font units, of the underline for this face. Only
+ *  relevant for scalable formats.
+ *
+ * Examples:
+ *   ut = face.underline_thickness
+ *
+ */
+static VALUE ft_face_underline_thickness(VALUE self) {
+  FT_Face *face;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  return INT2FIX((int) (*face)->underline_thickness);
+}
+/*
+ * Return the glyph slot associated with this FT2::Face object.
+ *
+ * Description:
+ *  The face's associated glyph slot(s) (a FT2::GlyphSlot). This object
+ *  is created automatically with a new FT2::Face object. However,
+ *  certain kinds of applications (mainly tools like converters) can
+ *  need more than one slot to ease their task.
+ *
+ * Note:
+ *   The same FT2::GlyphSlot object is returned on every call (a new one
+ *   for frozen faces), and it always shows the last glyph loaded.
+ *
+ * Examples:
+ *   glyph = face.glyph
+ *
+ */
+static VALUE ft_face_glyph(VALUE self) {
+  Face *face;
+  TypedData_Get_Struct(self, Face, &face_type, face);
+
+  if (face->face->glyph)
+    return view_cached(self, &face->views[FACE_VIEW_GLYPH], cGlyphSlot,
+                       &glyphslot_type, face->face->glyph, self);
+  else
+    return Qnil;
+}
+
+/*
+ * Return the current active size of this FT2::Face object.
+ *
+ * Note:
+ *   Each FT2::Face object has its own active size (see
+ *   FT2::Size#activate, FT2::Face#share and FT2::FaceCache#open).
+ *
+ * Examples:
+ *   size = face.size
+ *
+ */
+static VALUE ft_face_size(VALUE self) {
+  Face *face;
+  TypedData_Get_Struct(self, Face, &face_type, face);
+
+  return view_cached(self, &face->views[FACE_VIEW_SIZE], cSize,
+                     &size_type, face_size(face), self);
+}
+
+typedef struct {
+  FT_Face   face;
+  FT_Size   src,
+            size;
+  FT_Error  err;
+} FaceNewSize;
+
+static VALUE face_new_size_protected(VALUE ptr) {
+  FaceNewSize *args = (FaceNewSize *) ptr;
+  FT_Size_RequestRec req;
+  FT_Face face = args->face;
+  FT_Size src = args->src;
+  FT_Error err;
+
+  lock_acquire(face_lock(face));
+  err = FT_New_Size(face, &args->size);
+  if (err == FT_Err_Ok && src->metrics.x_ppem) {
+    if ((err = FT_Activate_Size(args->size)) == FT_Err_Ok) {
+      if (FT_IS_SCALABLE(face)) {
+        memset(&req, 0, sizeof(req));
+        req.type = FT_SIZE_REQUEST_TYPE_SCALES;
+        req.width = src->metrics.x_scale;
+        req.height = src->metrics.y_scale;
+        err = FT_Request_Size(face, &req);
+      } else {
+        err = FT_Set_Pixel_Sizes(face, src->metrics.x_ppem,
+                                 src->metrics.y_ppem);
+      }
+    }
+    if (err != FT_Err_Ok)
+      FT_Done_Size(args->size);
+  }
+  pthread_mutex_unlock(face_lock(face));
+  args->err = err;
+
+  return Qnil;
+}
+
+/*
+ * Create a new size of `face', set like `src' unless that was never
+ * set.  Takes over the caller's references to `face' and its library
+ * `lib', which are dropped if this raises.
+ */
+static FT_Size face_new_size(FT_Face face, FT_Library lib, FT_Size src) {
+  FaceNewSize args;
+  int state = 0;
+
+  args.face = face;
+  args.src = src;
+  args.size = NULL;
+  args.err = FT_Err_Ok;
+  rb_protect(face_new_size_protected, (VALUE) &args, &state);
+  if (state || args.err != FT_Err_Ok) {
+    face_release(face, NULL, lib);
+    if (state)
+      rb_jump_tag(state);
+    handle_error(args.err);
+  }
+
+  return args.size;
+}
+
+/*
+ * Return a new FT2::Face object sharing this one's parsed font.
+ *
+ * Description:
+ *   The font isn't opened or parsed again; the new object takes another
+ *   reference to the same FreeType face (FT_Reference_Face), and gets a
+ *   size of its own, initially set to the size of this one.  Threads or
+ *   requests can each hold a shared face, and set its size without
+ *   affecting the others.
+ *
+ * Note:
+ *   The transform, charmap and glyph slot are still shared, so loading a
+ *   glyph replaces the glyph slot of every shared face.  Threads take
+ *   turns loading (see FT2::Face#load_glyph); use FT2::GlyphSlot#glyph
+ *   to keep a copy.  Frozen faces can be shared too.
+ *
+ * Examples:
+ *   small = face.share
+ *   small.set_pixel_sizes 0, 12
+ *
+ */
+static VALUE ft_face_share(VALUE self) {
+  FT_Size size;
+  Face *face;
+
+  TypedData_Get_Struct(self, Face, &face_type, face);
+  face_reference(face->face, face->library);
+  size = face_new_size(face->face, face->library, face_size(face));
+
+  return face_wrap_size(rb_obj_class(self), face->face, face->library, size);
+}
+
+/*
+ * Return the current active FT2::CharMap of this FT2::Face object.
+ *
+ * Examples:
+ *   size = face.size
+ *
+ */
+static VALUE ft_face_charmap(VALUE self) {
+  Face *face;
+  TypedData_Get_Struct(self, Face, &face_type, face);
+
+  if (face->face->charmap)
+    return view_cached(self, &face->views[FACE_VIEW_CHARMAP], cCharMap,
+                       &charmap_type, face->face->charmap, self);
+  else
+    return Qnil;
+}
+
+/*
+ * Attach a font file to this FT2::Face object.
+ *
+ * Description:
+ *   This is usually to read additional information for a single face
+ *   object. For example, it is used to read the AFM files that come
+ *   with Type 1 fonts in order to add kerning data and other metrics.
+ *   Throws an exception if the font file could not be loaded.
+ *   FreeType2 also supports loading from an input stream, but this
+ *   feature is not implemented in FT2-Ruby.
+ *
+ * Examples:
+ *   path = 'fonts'yudit.ttf'
+ *   begin
+ *     face.attach path  # attach file "fonts/yudit.ttf"
+ *   rescue Exception
+ *     $stderr.puts "Couldn't open font file \"#{path}\": " << $!
+ *   end
+ *
+ */
+static VALUE ft_face_attach(VALUE self, VALUE path) {
+  FT_Face *face;
+  FT_Error err;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  rb_check_frozen(self);
+  lock_acquire(face_lock(*face));
+  err = FT_Attach_File(*face, RSTRING_PTR(path));
+  pthread_mutex_unlock(face_lock(*face));
+  if (err != FT_Err_Ok)
+    handle_error(err);
+  return self;
+}
+
+/*
+ * Set the character dimensions of this FT2::Face object.
+ *
+ * Description:
+ *   Sets the character dimensions of a FT2::Face object. The
+ *   `char_width' and `char_height' values are used for the width and
+ *   height, respectively, expressed in 26.6 fractional points.
+ *
+ *   If the horizontal or vertical resolution values are zero, a default
+ *   value of 72dpi is used. Similarly, if one of the character
+ *   dimensions is zero, its value is set equal to the other.
+ *
+ *   When dealing with fixed-size faces (i.e., non-scalable formats),
+ *   use the function FT2::Face#set_pixel_sizes .
+ *
+ * Examples:
+ *   face.set_char_size char_width, char_height, horiz_res, vert_res
+ *
+ */
+static VALUE ft_face_set_char_size(VALUE self, VALUE c_w, VALUE c_h, VALUE h_r, VALUE v_r) {
+  Face *face;
+  FT_Error err;
+  FT_F26Dot6 w, h;
+  FT_UInt h_res, v_res;
+
+  TypedData_Get_Struct(self, Face, &face_type, face);
+  rb_check_frozen(self);
+  w = NUM2DBL(c_w);
+  h = NUM2DBL(c_h);
+  h_res = NUM2INT(h_r);
+  v_res = NUM2INT(v_r);
+
+  lock_acquire(face_lock(face->face));
+  if ((err = face_activate(face)) == FT_Err_Ok)
+    err = FT_Set_Char_Size(face->face, w, h, h_res, v_res);
+  pthread_mutex_unlock(face_lock(face->face));
+  if (err != FT_Err_Ok)
+    handle_error(err);
+  return self;
+}
+
+/*
+ * Set the character dimensions of this FT2::Face object.
+ *
+ * Description:
+ *   Sets the character dimensions of a FT2::Face object. The width and
+ *   height are expressed in integer pixels.
+ *
+ *   If one of the character dimensions is zero, its value is set equal
+ *   to the other.
+ *
+ *   The values of `pixel_width' and `pixel_height' correspond to the
+ *   pixel values of the typographic character size, which are NOT
+ *   necessarily the same as the dimensions of the glyph `bitmap cells'.
+ *
+ *   The `character size' is really the size of an abstract square
+ *   called the `EM', used to design the font. However, depending on the
+ *   font design, glyphs will be smaller or greater than the EM.
+ *
+ *   This means that setting the pixel size to, say, 8x8 doesn't
+ *   guarantee in any way that you will get glyph bitmaps that all fit
+ *   within an 8x8 cell (sometimes even far from it).
+ *
+ * Examples:
+ *   face.set_pixel_sizes pixel_width, pixel_height
+ *
+ */
+static VALUE ft_face_set_pixel_sizes(VALUE self, VALUE pixel_w, VALUE pixel_h) {
+  Face *face;
+  FT_Error err;
+  FT_UInt w, h;
+
+  TypedData_Get_Struct(self, Face, &face_type, face);
+  rb_check_frozen(self);
+  w = NUM2INT(pixel_w);
+  h = NUM2INT(pixel_h);
+
+  lock_acquire(face_lock(face->face));
+  if ((err = face_activate(face)) == FT_Err_Ok)
+    err = FT_Set_Pixel_Sizes(face->face, w, h);
+  pthread_mutex_unlock(face_lock(face->face));
+  if (err != FT_Err_Ok)
+    handle_error(err);
+  return self;
+}
+
+/*
+ * Set the pre-render transoformation matrix and vector of a FT2::Face object.
+ *
+ * Description:
+ *   Used to set the transformation that is applied to glyph images just
+ *   before they are converted to bitmaps in a FT2::GlyphSlot when
+ *   FT2::GlyphSlot#render is called.
+ *
+ *   matrix: The transformation's 2x2 matrix. Use nil for the identity
+ *           matrix.
+ *   delta: The translation vector. Use nil for the null vector.
+ *
+ * Note:
+ *   The transformation is only applied to scalable image formats after
+ *   the glyph has been loaded. It means that hinting is unaltered by
+ *   the transformation and is performed on the character size given in
+ *   the last call to FT2::Face#set_char_sizes or
+ *   FT2::Face#set_pixel_sizes.
+ *
+ * Examples:
+ *   matrix = [[0, 1],
+ *             [0, 1]]
+ *   vector = nil
+ *
+ *   face.set_transform matrix, vector
+ *
+ */
+static VALUE ft_face_set_transform(VALUE self, VALUE matrix, VALUE delta) {
+  FT_Face *face;
+  FT_Matrix m;
+  FT_Vector v;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  rb_check_frozen(self);
+
+  if (matrix != Qnil) {
+    /* FIXME: do I have these reversed? */
+    m.xx = DBL2FTFIX(NUM2DBL(rb_ary_entry(rb_ary_entry(matrix, 0), 0)));
+    m.xy = DBL2FTFIX(NUM2DBL(rb_ary_entry(rb_ary_entry(matrix, 1), 0)));
+    m.yx = DBL2FTFIX(NUM2DBL(rb_ary_entry(rb_ary_entry(matrix, 0), 1)));
+    m.yy = DBL2FTFIX(NUM2DBL(rb_ary_entry(rb_ary_entry(matrix, 1), 1)));
+  }
+
+  if (delta != Qnil) {
+    v.x = NUM2INT(rb_ary_entry(delta, 0));
+    v.y = NUM2INT(rb_ary_entry(delta, 1));
+  }
+
+  lock_acquire(face_lock(*face));
+  if (matrix != Qnil && delta != Qnil)
+    FT_Set_Transform(*face, &m, &v);
+  else if (matrix == Qnil && delta != Qnil)
+    FT_Set_Transform(*face, NULL, &v);
+  else if (matrix != Qnil && delta == Qnil)
+    FT_Set_Transform(*face, &m, NULL);
+  else
+    FT_Set_Transform(*face, NULL, NULL);
+  pthread_mutex_unlock(face_lock(*face));
+
+  return self;
+}
+
+typedef struct {
+  Face     *face;
+  FT_ULong  code;   /* glyph index or character code */
+  FT_Int32  flags;
+  FT_Error  err;
+} FaceLoad;
+
+static void *face_load_glyph_nogvl(void *ptr) {
+  FaceLoad *load = (FaceLoad *) ptr;
+  if ((load->err = face_activate(load->face)) == FT_Err_Ok)
+    load->err = FT_Load_Glyph(load->face->face, load->code, load->flags);
+  return NULL;
+}
+
+static void *face_load_char_nogvl(void *ptr) {
+  FaceLoad *load = (FaceLoad *) ptr;
+  if ((load->err = face_activate(load->face)) == FT_Err_Ok)
+    load->err = FT_Load_Char(load->face->face, load->code, load->flags);
+  return NULL;
+}
+
+/*
+ * Load a glyph at a given size into a glyph slot of a FT2::Face object.
+ *
+ * Description:
+ *   Load a glyph at a given size into a glyph slot of a FT2::Face
+ *   object.
+ *
+ *   glyph_index: The index of the glyph in the font file.
+ *   load_flags: A flag indicating what to load for this glyph. The
+ *               FT2::Load::XXXX constants can be used to control the
+ *               glyph loading process (e.g., whether the outline should
+ *               be scaled, whether to load bitmaps or not, whether to
+ *               hint the outline, etc).
+ *
+ * Note:
+ *   If the glyph image is not a bitmap, and if the bit flag
+ *   FT2::Load::IGNORE_TRANSFORM is unset, the glyph image will be
+ *   transformed with the information passed to a previous call to
+ *   FT2::Face#set_transform
+ *
+ *   Note that this also transforms the `face.glyph.advance' field, but
+ *   not the values in `face.glyph.metrics'.
+ *
+ *   Other Ruby threads keep running while the glyph is loaded.  Threads
+ *   sharing a face take turns, and share its glyph slot.
+ *
+ * Load Flags:
+ *   FT2::Load::DEFAULT
+ *   FT2::Load::RENDER
+ *   FT2::Load::MONOCHROME
+ *   FT2::Load::LINEAR_DESIGN
+ *   FT2::Load::NO_SCALE
+ *   FT2::Load::NO_HINTING
+ *   FT2::Load::NO_BITMAP
+ *   FT2::Load::CROP_BITMAP
+ *   FT2::Load::VERTICAL_LAYOUT
+ *   FT2::Load::IGNORE_TRANSFORM
+ *   FT2::Load::IGNORE_GLOBAL_ADVANCE_WIDTH
+ *   FT2::Load::FORCE_AUTOHINT
+ *   FT2::Load::NO_RECURSE
+ *   FT2::Load::PEDANTIC
+ *
+ * Examples:
+ *   face.load_glyph 5, FT2::Load::DEFAULT
+ *
+ */
+static VALUE ft_face_load_glyph(VALUE self, VALUE glyph_index, VALUE flags) {
+  Face *face;
+  FaceLoad load;
+
+  TypedData_Get_Struct(self, Face, &face_type, face);
+  rb_check_frozen(self);
+  if (flags == Qnil)
+    flags = INT2FIX(FT_LOAD_DEFAULT);
+
+  load.face = face;
+  load.code = NUM2INT(glyph_index);
+  load.flags = NUM2INT(flags);
+  face_call(face->face, face_load_glyph_nogvl, &load);
+  if (load.err != FT_Err_Ok)
+    handle_error(load.err);
+
+  return self;
+}
+
+/*
+ * Load a glyph at a given size into a glyph slot of a FT2::Face object.
+ *
+ * Description:
+ *   Load a glyph at a given size into a glyph slot of a FT2::Face
+ *   object according to its character code.
+ *
+ *   char_code: The glyph's character code, according to the current
+ *              charmap used in the FT2::Face object.
+ *   load_flags: A flag indicating what to load for this glyph. The
+ *               FT2::Load::XXXX constants can be used to control the
+ *               glyph loading process (e.g., whether the outline should
+ *               be scaled, whether to load bitmaps or not, whether to
+ *               hint the outline, etc).
+ *
+ * Note:
+ *   If the face has no current charmap, or if the character code is not
+ *   defined in the charmap, this function will return an error.
+ *
+ *   If the glyph image is not a bitmap, and if the bit flag
+ *   FT2::Load::IGNORE_TRANSFORM is unset, the glyph image will be
+ *   transformed with the information passed to a previous call to
+ *   FT2::Face#set_transform
+ *
+ *   Note that this also transforms the `face.glyph.advance' field, but
+ *   not the values in `face.glyph.metrics'.
+ *
+ *   Other Ruby threads keep running while the glyph is loaded.  Threads
+ *   sharing a face take turns, and share its glyph slot.
+ *
+ * Load Flags:
+ *   FT2::Load::DEFAULT
+ *   FT2::Load::RENDER
+ *   FT2::Load::MONOCHROME
+ *   FT2::Load::LINEAR_DESIGN
+ *   FT2::Load::NO_SCALE
+ *   FT2::Load::NO_HINTING
+ *   FT2::Load::NO_BITMAP
+ *   FT2::Load::CROP_BITMAP
+ *   FT2::Load::VERTICAL_LAYOUT
+ *   FT2::Load::IGNORE_TRANSFORM
+ *   FT2::Load::IGNORE_GLOBAL_ADVANCE_WIDTH
+ *   FT2::Load::FORCE_AUTOHINT
+ *   FT2::Load::NO_RECURSE
+ *   FT2::Load::PEDANTIC
+ *
+ * Examples:
+ *   face.load_char 5, FT2::Load::DEFAULT
+ *
+ */
+static VALUE ft_face_load_char(VALUE self, VALUE char_code, VALUE flags) {
+  Face *face;
+  FaceLoad load;
+
+  TypedData_Get_Struct(self, Face, &face_type, face);
+  rb_check_frozen(self);
+
+  load.face = face;
+  load.code = NUM2INT(char_code);
+  load.flags = NUM2INT(flags);
+  face_call(face->face, face_load_char_nogvl, &load);
+  if (load.err != FT_Err_Ok)
+    handle_error(load.err);
+
+  return self;
+}
+
+/*
+ * Get the glyph index of a character code.
+ *
+ * Note:
+ *   This function uses a charmap object in order to do the translation.
+ *
+ *   FreeType computes its own glyph indices which are not necessarily
+ *   the same as used in the font in case the font is based on glyph
+ *   indices. Reason for this behaviour is to assure that index 0 is
+ *   never used, representing the missing glyph.
+ *
+ *   A return value of 0 means `undefined character code'.
+ *
+ *   With a Unicode charmap selected, the whole charmap is read into a
+ *   flat table the first time, shared by all the objects using the
+ *   same parsed face (see FT2::Face#share and FT2::FaceCache); each
+ *   lookup is then an array index or two.
+ *
+ * Examples:
+ *   index = face.char_index 65
+ *   puts 'undefined character code' if index == 0
+ *
+ */
+static VALUE ft_face_char_index(VALUE self, VALUE char_code) {
+  FT_Face *face;
+  const FaceData *data;
+  FT_ULong code;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  code = NUM2INT(char_code);
+  data = face_cmap(*face);
+
+  return INT2FIX(face_char_index(*face, data, code));
+}
+
+/*
+ * Get the glyph indices of the characters of a string.
+ *
+ * Description:
+ *   Get the glyph index of each character of `str', as FT2::Face#char_index
+ *   would for its Unicode code point, in one call.
+ *
+ *   str: The string.  Strings in encodings other than UTF-8 and US-ASCII
+ *        are converted to UTF-8 first.
+ *   missing: If true, also return the positions of the characters
+ *            without a glyph.
+ *
+ *   Returns a binary string of native 32-bit unsigned integers, one per
+ *   character.  If `missing' is true, returns a two-element array of
+ *   this string and an array of the (character) positions in `str'
+ *   whose glyph index is 0.
+ *
+ *   FT2::Face#advances and FT2::Face#kerning_run take the returned
+ *   string as is.
+ *
+ * Examples:
+ *   ids = face.glyph_indices 'Hello'
+ *   ids.unpack 'L*'
+ *   width = face.advances ids, 16
+ *
+ *   ids, missing = face.glyph_indices 'Hello ☃', missing: true
+ *
+ */
+static VALUE ft_face_glyph_indices(int argc, VALUE *argv, VALUE self) {
+  FT_Face *face;
+  const FaceData *data;
+  VALUE str, opts, missing = Qfalse, rtn, positions = Qnil;
+  const char *p, *end;
+  FT_UInt32 gindex;
+  long i, len;
+  int n;
+  ID kw_missing;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  rb_scan_args(argc, argv, "1:", &str, &opts);
+  if (opts != Qnil) {
+    kw_missing = rb_intern("missing");
+    rb_get_kwargs(opts, &kw_missing, 0, 1, &missing);
+  }
+
+  str = str_unicode(str);
+  data = face_cmap(*face);
+  len = rb_str_strlen(str);
+  rtn = rb_str_new(NULL, len * sizeof(FT_UInt32));
+  if (RTEST(missing) && missing != Qundef)
+    positions = rb_ary_new();
+
+  p = RSTRING_PTR(str);
+  end = RSTRING_END(str);
+  for (i = 0; i < len && p < end; i++, p += n) {
+    gindex = face_char_index(*face, data, str_codepoint(p, end, &n));
+    memcpy(RSTRING_PTR(rtn) + i * sizeof(FT_UInt32), &gindex, sizeof(gindex));
+    if (!gindex && positions != Qnil)
+      rb_ary_push(positions, LONG2NUM(i));
+  }
+  RB_GC_GUARD(str);
+
+  if (positions == Qnil)
+    return rtn;
+  return rb_assoc_new(rtn, positions);
+}
+
+/*
+ * Return the Unicode coverage of a FT2::Face object.
+ *
+ * Description:
+ *   Return the Unicode code points the face has a glyph for, as a
+ *   frozen binary string of native 32-bit unsigned integers: pairs of
+ *   the first and last code point of each range, in ascending order.
+ *
+ * Note:
+ *   The coverage is computed once per parsed face, from the same table
+ *   as FT2::Face#char_index, and is shared by all the objects using
+ *   it.  The string is compact and can be stored as is.
+ *
+ *   Raises FT2::Error unless a Unicode charmap is (or was) selected.
+ *
+ * Examples:
+ *   ranges = face.coverage.unpack('L*').each_slice(2).map { |a, b| a..b }
+ *   File.binwrite 'yudit.coverage', face.coverage
+ *
+ */
+static VALUE ft_face_coverage(VALUE self) {
+  FT_Face *face;
+  const FaceData *data;
+  VALUE rtn;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  if ((data = face_data_get(*face, FACE_DATA_COVERAGE, face_data_coverage)) == NULL)
+    rb_raise(eFt2Error, "No Unicode charmap selected.");
+
+  rtn = rb_str_new((const char *) data->coverage,
+                   data->num_coverage * 2 * sizeof(FT_UInt32));
+  return rb_obj_freeze(rtn);
+}
+
+/*
+ * Check whether a FT2::Face object has a glyph for every character of a string.
+ *
+ * Description:
+ *   Return true if every character of `str' (spaces and line breaks
+ *   included) maps to a glyph other than 0, as FT2::Face#char_index
+ *   would map its Unicode code point, and false otherwise.
+ *
+ *   str: The string.  Strings in encodings other than UTF-8 and US-ASCII
+ *        are converted to UTF-8 first.
+ *
+ * Note:
+ *   The whole check runs in one call, and stops at the first missing
+ *   character.
+ *
+ * Examples:
+ *   fonts = faces.select { |face| face.covers? text }
+ *
+ */
+static VALUE ft_face_covers(VALUE self, VALUE str) {
+  FT_Face *face;
+  const FaceData *data;
+  const char *p, *end;
+  int n;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  str = str_unicode(str);
+  data = face_cmap(*face);
+
+  for (p = RSTRING_PTR(str), end = RSTRING_END(str); p < end; p += n)
+    if (!face_char_index(*face, data, str_codepoint(p, end, &n)))
+      return Qfalse;
+  RB_GC_GUARD(str);
+
+  return Qtrue;
+}
+
+/*
+ * Return the characters of a string a FT2::Face object has no glyph for.
+ *
+ * Description:
+ *   Return an array of the distinct characters of `str' that map to
+ *   glyph 0 (see FT2::Face#covers?), in order of first appearance, as
+ *   UTF-8 strings.  The array is empty if the face covers `str'.
+ *
+ * Examples:
+ *   face.missing_chars 'Hello ☃'   # => ["☃"]
+ *
+ */
+static VALUE ft_face_missing_chars(VALUE self, VALUE str) {
+  FT_Face *face;
+  const FaceData *data;
+  const char *p, *end;
+  FT_ULong code;
+  VALUE rtn, seen = Qnil;
+  int n;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  str = str_unicode(str);
+  data = face_cmap(*face);
+  rtn = rb_ary_new();
+
+  for (p = RSTRING_PTR(str), end = RSTRING_END(str); p < end; p += n) {
+    code = str_codepoint(p, end, &n);
+    if (face_char_index(*face, data, code))
+      continue;
+    if (seen == Qnil)
+      seen = rb_hash_new();
+    if (rb_hash_lookup2(seen, ULONG2NUM(code), Qfalse) != Qfalse)
+      continue;
+    rb_hash_aset(seen, ULONG2NUM(code), Qtrue);
+    rb_ary_push(rtn, rb_enc_uint_chr((unsigned int) code, rb_utf8_encoding()));
+  }
+  RB_GC_GUARD(str);
+
+  return rtn;
+}
+
+typedef struct {
+  Face       *face;
+  FT_UInt32  *glyphs;
+  long        count;
+  FT_Int32    flags;
+  int         kerning;
+  FT_Pos      advance,
+              x_min, y_min, x_max, y_max,
+              ascent, descent;
+  FT_Error    err;
+} FaceMeasure;
+
+/*
+ * The metrics of recently measured glyphs, by glyph index modulo the
+ * number of slots: text repeats its glyphs a lot, and each is loaded
+ * once per call rather than once per character.
+ */
+#define MEASURE_SLOTS 256
+
+typedef struct {
+  FT_UInt           glyph_index;   /* plus one; 0 if the slot is empty */
+  FT_Glyph_Metrics  metrics;
+} MeasureSlot;
+
+/* the metrics of `glyph_index', loaded unless in `slots' already */
+static FT_Error measure_glyph(FT_Face face, MeasureSlot *slots, FT_UInt glyph_index,
+                              FT_Int32 flags, const FT_Glyph_Metrics **metrics) {
+  MeasureSlot *slot = &slots[glyph_index % MEASURE_SLOTS];
+  FT_Error err;
+
+  if (slot->glyph_index != glyph_index + 1) {
+    if ((err = FT_Load_Glyph(face, glyph_index, flags)) != FT_Err_Ok)
+      return err;
+    slot->glyph_index = glyph_index + 1;
+    slot->metrics = face->glyph->metrics;
+  }
+
+  *metrics = &slot->metrics;
+  return FT_Err_Ok;
+}
+
+static void *face_measure_nogvl(void *ptr) {
+  FaceMeasure *m = (FaceMeasure *) ptr;
+  FT_Face face = m->face->face;
+  const FT_Glyph_Metrics *metrics;
+  MeasureSlot slots[MEASURE_SLOTS];
+  FT_UInt mode = (m->flags & FT_LOAD_NO_SCALE) ? FT_KERNING_UNSCALED : FT_KERNING_DEFAULT;
+  FaceData *data = NULL;
+  FT_Pos pen = 0, kern, x0, y0, x1, y1;
+  int ink = 0;
+  long i;
+
+  if ((m->err = face_activate(m->face)) != FT_Err_Ok)
+    return NULL;
+  memset(slots, 0, sizeof(slots));
+  if (m->kerning && FT_HAS_KERNING(face)) {
+    if ((data = face_data(face)) == NULL) {
+      m->err = FT_Err_Out_Of_Memory;
+      return NULL;
+    }
+    if ((m->err = face_data_kerning(face, data)) != FT_Err_Ok)
+      return NULL;
+  }
+
+  for (i = 0; i < m->count; i++) {
+    if (data && i > 0) {
+      m->err = face_data_kern(face, data, m->glyphs[i - 1], m->glyphs[i], &kern);
+      if (m->err != FT_Err_Ok)
+        return NULL;
+      pen += kern_scale(kern, mode, &face->size->metrics);
+    }
+
+    if ((m->err = measure_glyph(face, slots, m->glyphs[i], m->flags, &metrics)) != FT_Err_Ok)
+      return NULL;
+
+    /* blank glyphs (spaces) have no ink */
+    if (metrics->width || metrics->height) {
+      x0 = pen + metrics->horiBearingX;
+      x1 = x0 + metrics->width;
+      y1 = metrics->horiBearingY;
+      y0 = y1 - metrics->height;
+      if (!ink || x0 < m->x_min) m->x_min = x0;
+      if (!ink || y0 < m->y_min) m->y_min = y0;
+      if (!ink || x1 > m->x_max) m->x_max = x1;
+      if (!ink || y1 > m->y_max) m->y_max = y1;
+      ink = 1;
+    }
+    pen += metrics->horiAdvance;
+  }
+
+  m->advance = pen;
+  if (m->flags & FT_LOAD_NO_SCALE) {
+    m->ascent = face->ascender;
+    m->descent = -face->descender;
+  } else {
+    m->ascent = face->size->metrics.ascender;
+    m->descent = -face->size->metrics.descender;
+  }
+
+  return NULL;
+}
+
+static VALUE sFaceMeasurement;
+
+/*
+ * Measure a string set in a FT2::Face object.
+ *
+ * Description:
+ *   Measure `str' laid out on a horizontal line at the face's current
+ *   size, loading each glyph with `load_flags' (default:
+ *   FT2::Load::DEFAULT) and, if `kerning' is true (the default),
+ *   kerning each pair as FT2::Face#kerning does.  Returns a
+ *   FT2::Face::Measurement struct, with members:
+ *
+ *   advance: The advance width of the whole string.
+ *   x_min, y_min, x_max, y_max: The bounding box of the ink of the
+ *                               string, relative to the pen position
+ *                               of its first character on the
+ *                               baseline; all 0 if it has no ink.
+ *   ascent: The face's ascender at the current size.
+ *   descent: The face's descender at the current size, as a positive
+ *            distance below the baseline.
+ *
+ *   Values are in 26.6 pixels, or font units with FT2::Load::NO_SCALE.
+ *   Strings in encodings other than UTF-8 and US-ASCII are converted to
+ *   UTF-8 first.
+ *
+ * Note:
+ *   The whole string is measured in one call, with the face lock held
+ *   and other Ruby threads running.  Each distinct glyph is loaded once,
+ *   into the face's glyph slot, which is left holding one of them; the
+ *   face's transform is not applied.  Characters the face has no glyph for
+ *   are measured as glyph 0.
+ *
+ * Examples:
+ *   face.set_char_size 0, 16 * 64, 72, 72
+ *   m = face.measure 'Hello, World'
+ *   width_px = m.advance / 64.0
+ *
+ *   m = face.measure 'AVATAR', load_flags: FT2::Load::NO_HINTING, kerning: false
+ *
+ */
+static VALUE ft_face_measure(int argc, VALUE *argv, VALUE self) {
+  FaceMeasure m;
+  const FaceData *data;
+  const char *p, *end;
+  VALUE str, opts, kw_vals[2], buf;
+  ID kw[2];
+  int n;
+
+  TypedData_Get_Struct(self, Face, &face_type, m.face);
+  rb_check_frozen(self);
+  rb_scan_args(argc, argv, "1:", &str, &opts);
+  kw_vals[0] = kw_vals[1] = Qundef;
+  if (opts != Qnil) {
+    kw[0] = rb_intern("load_flags");
+    kw[1] = rb_intern("kerning");
+    rb_get_kwargs(opts, kw, 0, 2, kw_vals);
+  }
+
+  m.x_min = m.y_min = m.x_max = m.y_max = 0;
+  m.flags = kw_vals[0] == Qundef || kw_vals[0] == Qnil ? FT_LOAD_DEFAULT : NUM2INT(kw_vals[0]);
+  m.kerning = kw_vals[1] == Qundef || RTEST(kw_vals[1]);
+
+  str = str_unicode(str);
+  data = face_cmap(m.face->face);
+  m.glyphs = ALLOCV_N(FT_UInt32, buf, RSTRING_LEN(str) + 1);
+  m.count = 0;
+  for (p = RSTRING_PTR(str), end = RSTRING_END(str); p < end; p += n)
+    m.glyphs[m.count++] = face_char_index(m.face->face, data, str_codepoint(p, end, &n));
+  RB_GC_GUARD(str);
+
+  face_call(m.face->face, face_measure_nogvl, &m);
+  ALLOCV_END(buf);
+  if (m.err != FT_Err_Ok)
+    handle_error(m.err);
+
+  return rb_struct_new(sFaceMeasurement,
+                       LONG2NUM(m.advance),
+                       LONG2NUM(m.x_min), LONG2NUM(m.y_min),
+                       LONG2NUM(m.x_max), LONG2NUM(m.y_max),
+                       LONG2NUM(m.ascent), LONG2NUM(m.descent));
+}
+
+#define FIT_LINE_BREAK  0xFFFFFFFF   /* in FaceFit.glyphs */
+#define FIT_MAX_SIZE    0xFFFF
+
+typedef struct {
+  Face       *face;
+  FT_UInt32  *glyphs;
+  long        count;
+  double      width, height, line_gap;
+  long        min, max;       /* max is 0 for no maximum */
+  long        size;           /* the result, or 0 */
+  FT_Error    err;
+} FaceFit;
+
+/*
+ * The width of the widest line of `fit' (its glyphs are split by
+ * FIT_LINE_BREAK): in font units from the advance table if `slots' is
+ * NULL, else hinted at the active size.  Kerned either way.
+ */
+static FT_Error fit_width(FaceFit *fit, FaceData *data, MeasureSlot *slots, FT_Pos *width) {
+  FT_Face face = fit->face->face;
+  const FT_Glyph_Metrics *metrics;
+  FT_Pos pen = 0, kern;
+  FT_UInt mode = slots ? FT_KERNING_DEFAULT : FT_KERNING_UNSCALED;
+  FT_Error err;
+  long i;
+
+  *width = 0;
+  for (i = 0; i <= fit->count; i++) {
+    if (i == fit->count || fit->glyphs[i] == FIT_LINE_BREAK) {
+      if (pen > *width)
+        *width = pen;
+      pen = 0;
+      continue;
+    }
+
+    if (i > 0 && fit->glyphs[i - 1] != FIT_LINE_BREAK) {
+      if ((err = face_data_kern(face, data, fit->glyphs[i - 1], fit->glyphs[i], &kern)) != FT_Err_Ok)
+        return err;
+      pen += kern_scale(kern, mode, &face->size->metrics);
+    }
+
+    if (!slots) {
+      if ((FT_Long) fit->glyphs[i] < face->num_glyphs)
+        pen += data->advances[fit->glyphs[i]];
+    } else {
+      if ((err = measure_glyph(face, slots, fit->glyphs[i], FT_LOAD_DEFAULT, &metrics)) != FT_Err_Ok)
+        return err;
+      pen += metrics->horiAdvance;
+    }
+  }
+
+  return FT_Err_Ok;
+}
+
+static void *face_fit_nogvl(void *ptr) {
+  FaceFit *fit = (FaceFit *) ptr;
+  FT_Face face = fit->face->face;
+  FT_Size size;
+  FT_Size_Metrics *metrics;
+  MeasureSlot slots[MEASURE_SLOTS];
+  FaceData *data;
+  FT_Pos width, line_height;
+  double fit_w, fit_h, fit_size, height;
+  long i, lines = 1;
+
+  fit->size = 0;
+  if ((data = face_data(face)) == NULL) {
+    fit->err = FT_Err_Out_Of_Memory;
+    return NULL;
+  }
+  if ((fit->err = face_data_advances(face, data)) != FT_Err_Ok ||
+      (fit->err = face_data_kerning(face, data)) != FT_Err_Ok)
+    return NULL;
+
+  for (i = 0; i < fit->count; i++)
+    if (fit->glyphs[i] == FIT_LINE_BREAK)
+      lines++;
+
+  /* the largest size at which the unhinted text fits, by arithmetic */
+  if ((fit->err = fit_width(fit, data, NULL, &width)) != FT_Err_Ok)
+    return NULL;
+  fit_w = width > 0 ? fit->width * face->units_per_EM / width : FIT_MAX_SIZE;
+  /* fonts with zero line metrics don't constrain the height either */
+  line_height = (face->ascender - face->descender) + (lines - 1) * face->height;
+  fit_h = line_height > 0 ?
+          (fit->height - (lines - 1) * fit->line_gap) * face->units_per_EM / line_height :
+          FIT_MAX_SIZE;
+  /* clamp before converting, the quotients may be out of range of a long */
+  fit_size = fit_w < fit_h ? fit_w : fit_h;
+  if (fit_size > FIT_MAX_SIZE)
+    fit_size = FIT_MAX_SIZE;
+  if (fit_size < 0)
+    fit_size = 0;
+  fit->size = (long) fit_size;
+  if (fit->max && fit->size > fit->max)
+    fit->size = fit->max;
+  if (fit->size < fit->min)
+    fit->size = fit->min;
+
+  /* check it hinted, on a size of our own, and shrink until it fits */
+  if ((fit->err = FT_New_Size(face, &size)) != FT_Err_Ok)
+    return NULL;
+  if ((fit->err = FT_Activate_Size(size)) == FT_Err_Ok) {
+    metrics = &size->metrics;
+    for (; fit->size >= fit->min; fit->size--) {
+      if ((fit->err = FT_Set_Pixel_Sizes(face, 0, fit->size)) != FT_Err_Ok)
+        break;
+      memset(slots, 0, sizeof(slots));
+      if ((fit->err = fit_width(fit, data, slots, &width)) != FT_Err_Ok)
+        break;
+      height = (metrics->ascender - metrics->descender) +
+               (lines - 1) * (metrics->height + fit->line_gap * 64);
+      if (width <= fit->width * 64 && height <= fit->height * 64)
+        break;
+    }
+  }
+  FT_Done_Size(size);
+
+  if (fit->err != FT_Err_Ok || fit->size < fit->min)
+    fit->size = 0;
+  if (fit->err == FT_Err_Ok)
+    fit->err = face_activate(fit->face);
+
+  return NULL;
+}
+
+/*
+ * Find the largest size at which a string fits in a box.
+ *
+ * Description:
+ *   Return the largest size, in whole pixels per EM (points at 72 dpi),
+ *   at which `str' fits in a box `width' by `height' pixels, or nil if
+ *   it doesn't fit even at `min'.  Sizes above `max' (if given) are not
+ *   considered.
+ *
+ *   Lines are split at line breaks, and are `line_gap' pixels (default:
+ *   0) further apart than the face's own line height.  A line's width is
+ *   its kerned advance width, and the text's height runs from the first
+ *   line's ascender to the last line's descender.
+ *
+ *   Strings in encodings other than UTF-8 and US-ASCII are converted to
+ *   UTF-8 first.
+ *
+ * Note:
+ *   The size is worked out from the face's unhinted advances, kerning
+ *   and line metrics in font units, which scale linearly; no glyph is
+ *   loaded for that.  The text is then laid out hinted at that size
+ *   only (or at the next smaller ones, should hinting widen it), on a
+ *   size of its own, so the face's size is left alone.  Glyphs are
+ *   loaded into the face's glyph slot.
+ *
+ * Examples:
+ *   size = face.fit 'Hello, World', width: 300, height: 40
+ *   face.set_pixel_sizes 0, size if size
+ *
+ *   size = face.fit "Two\nlines", width: 200, height: 100, min: 8, max: 72, line_gap: 4
+ *
+ */
+static VALUE ft_face_fit(int argc, VALUE *argv, VALUE self) {
+  FaceFit fit;
+  const FaceData *data;
+  const char *p, *end;
+  FT_ULong code;
+  VALUE str, opts, kw_vals[5], buf;
+  ID kw[5];
+  int n;
+
+  TypedData_Get_Struct(self, Face, &face_type, fit.face);
+  rb_check_frozen(self);
+  rb_scan_args(argc, argv, "1:", &str, &opts);
+  kw[0] = rb_intern("width");
+  kw[1] = rb_intern("height");
+  kw[2] = rb_intern("min");
+  kw[3] = rb_intern("max");
+  kw[4] = rb_intern("line_gap");
+  rb_get_kwargs(opts, kw, 2, 3, kw_vals);
+
+  if (!fit.face->face->units_per_EM)
+    rb_raise(eFt2Error, "Face is not scalable.");
+
+  fit.width = NUM2DBL(kw_vals[0]);
+  fit.height = NUM2DBL(kw_vals[1]);
+  fit.min = kw_vals[2] == Qundef || kw_vals[2] == Qnil ? 1 : NUM2LONG(kw_vals[2]);
+  fit.max = kw_vals[3] == Qundef || kw_vals[3] == Qnil ? 0 : NUM2LONG(kw_vals[3]);
+  fit.line_gap = kw_vals[4] == Qundef || kw_vals[4] == Qnil ? 0 : NUM2DBL(kw_vals[4]);
+  if (!isfinite(fit.width) || !isfinite(fit.height) || !isfinite(fit.line_gap))
+    rb_raise(rb_eArgError, "Invalid box.");
+  if (fit.min < 1 || fit.min > FIT_MAX_SIZE || fit.max < 0 || (fit.max && fit.max < fit.min))
+    rb_raise(rb_eArgError, "Invalid size range.");
+
+  str = str_unicode(str);
+  data = face_cmap(fit.face->face);
+  fit.glyphs = ALLOCV_N(FT_UInt32, buf, RSTRING_LEN(str) + 1);
+  fit.count = 0;
+  for (p = RSTRING_PTR(str), end = RSTRING_END(str); p < end; p += n) {
+    code = str_codepoint(p, end, &n);
+    if (code == '\r' && p + 1 < end && p[1] == '\n')
+      continue;
+    if (code == '\n' || code == '\r')
+      fit.glyphs[fit.count++] = FIT_LINE_BREAK;
+    else
+      fit.glyphs[fit.count++] = face_char_index(fit.face->face, data, code);
+  }
+  RB_GC_GUARD(str);
+
+  face_call(fit.face->face, face_fit_nogvl, &fit);
+  ALLOCV_END(buf);
+  if (fit.err != FT_Err_Ok)
+    handle_error(fit.err);
+
+  return fit.size ? LONG2NUM(fit.size) : Qnil;
+}
+
+/*
+ * Get the glyph index of a given glyph name.
+ *
+ * Note:
+ *   This method uses driver specific objects to do the translation.
+ *
+ *   A return value of 0 means `undefined character code'.
+ *
+ * Examples:
+ *   index = face.name_index glyph_name
+ *
+ */
+static VALUE ft_face_name_index(VALUE self, VALUE glyph_name) {
+  FT_Face *face;
+  FT_UInt index;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  StringValueCStr(glyph_name);
+
+  lock_acquire(face_lock(*face));
+  index = FT_Get_Name_Index(*face, RSTRING_PTR(glyph_name));
+  pthread_mutex_unlock(face_lock(*face));
+
+  return INT2FIX(index);
+}
+
+/*
+ * Get the kerning vector between two glyphs of a FT2::Face object.
+ *
+ * Description:
+ *   Get the kerning vector between two glyphs of a FT2::Face object.
+ *
+ *   left_glyph: The index of the left glyph in the kern pair.
+ *   right_glyph: The index of the right glyph in the kern pair.
+ *   kern_mode: One of the FT2::KerningMode::XXXX constants. Determines
+ *              the scale/dimension of the returned kerning vector.
+ *
+ *   Passing kern_mode == nil is the same as FT2::KerningMode::DEFAULT.
+ *
+ *   Returns a kerning vector (actually a two-element array). This is in
+ *   font units for scalable formats, and in pixels for fixed-sizes
+ *   formats.
+ *
+ * Kerning Modes:
+ *   FT2::KerningMode::DEFAULT
+ *   FT2::KerningMode::UNFITTED
+ *   FT2::KerningMode::UNSCALED
+ *
+ * Examples:
+ *   left_glyph = 10
+ *   left_glyph = 11
+ *   k_v = face.kerning left_glyph, right_glyph, nil
+ *
+ *   # another example, w/o default options
+ *   k_v = face.get_kerning 12, 13, FT2::KerningMode::UNFITTED
+ *
+ */
+static VALUE ft_face_kerning(VALUE self, VALUE left_glyph, VALUE right_glyph, VALUE kern_mode) {
+  Face *face;
+  FT_Error err;
+  FT_Vector v;
+  FT_UInt left, right, mode;
+  VALUE ary;
+
+  TypedData_Get_Struct(self, Face, &face_type, face);
+  ary = rb_ary_new();
+
+  if (kern_mode == Qnil)
+    kern_mode = INT2FIX(ft_kerning_default);
+  left = NUM2INT(left_glyph);
+  right = NUM2INT(right_glyph);
+  mode = NUM2INT(kern_mode);
+
+  /* scaled kerning depends on the active size */
+  lock_acquire(face_lock(face->face));
+  if ((err = face_activate(face)) == FT_Err_Ok)
+    err = FT_Get_Kerning(face->face, left, right, mode, &v);
+  pthread_mutex_unlock(face_lock(face->face));
+  if (err != FT_Err_Ok)
+    handle_error(err);
+
+  rb_ary_push(ary, INT2FIX(v.x));
+  rb_ary_push(ary, INT2FIX(v.y));
+
+  return ary;
+}
+
+typedef struct {
+  Face      *face;
+  FT_UInt32 *glyphs;
+  long       count;
+  FT_UInt    mode;
+  int32_t   *kerns;
+  FT_Error   err;
+} FaceKerningRun;
+
+static void *face_kerning_run_nogvl(void *ptr) {
+  FaceKerningRun *run = (FaceKerningRun *) ptr;
+  FT_Face face = run->face->face;
+  FT_Size_Metrics metrics;
+  FaceData *data;
+  FT_Pos value;
+  long i;
+
+  if ((data = face_data(face)) == NULL) {
+    run->err = FT_Err_Out_Of_Memory;
+    return NULL;
+  }
+  if ((run->err = face_data_kerning(face, data)) != FT_Err_Ok)
+    return NULL;
+
+  metrics = face_size(run->face)->metrics;
+  for (i = 0; i + 1 < run->count; i++) {
+    run->err = face_data_kern(face, data, run->glyphs[i], run->glyphs[i + 1], &value);
+    if (run->err != FT_Err_Ok)
+      break;
+    run->kerns[i] = (int32_t) kern_scale(value, run->mode, &metrics);
+  }
+
+  return NULL;
+}
+
+/*
+ * Get the kerning between each pair of adjacent glyphs in a run.
+ *
+ * Description:
+ *   Get the horizontal kerning between each pair of adjacent glyphs in
+ *   an array of glyph indices, in one call.
+ *
+ *   glyph_ids: An array of glyph indices, or a string of them as
+ *              returned by FT2::Face#glyph_indices.
+ *   kern_mode: One of the FT2::KerningMode::XXXX constants, as for
+ *              FT2::Face#kerning.
+ *
+ *   Returns a binary string of native 32-bit integers, one less than
+ *   there are glyphs: the kerning between glyph i and glyph i + 1 is
+ *   its i-th value.  These are in 26.6 pixels, or in font units for
+ *   FT2::KerningMode::UNSCALED, and equal the x value FT2::Face#kerning
+ *   returns for the pair.
+ *
+ * Note:
+ *   The pairs of the font's `kern' table are indexed by left glyph the
+ *   first time kerning is asked for, and the index is shared by all the
+ *   objects using the same parsed face (see FT2::Face#share and
+ *   FT2::FaceCache).  Faces without one (a Type 1 font with an
+ *   attached AFM file, say) are still kerned in the one call.
+ *
+ * Examples:
+ *   ids = 'AVATAR'.each_char.map { |c| face.char_index c.ord }
+ *   kerns = face.kerning_run(ids).unpack 'l*'
+ *
+ *   # in font units
+ *   kerns = face.kerning_run(ids, FT2::KerningMode::UNSCALED).unpack 'l*'
+ *
+ */
+static VALUE ft_face_kerning_run(int argc, VALUE *argv, VALUE self) {
+  FaceKerningRun run;
+  VALUE glyph_ids, kern_mode, buf, kerns, rtn;
+
+  TypedData_Get_Struct(self, Face, &face_type, run.face);
+  rb_scan_args(argc, argv, "11", &glyph_ids, &kern_mode);
+  run.mode = kern_mode == Qnil ? FT_KERNING_DEFAULT : NUM2UINT(kern_mode);
+
+  run.glyphs = glyph_ids_get(glyph_ids, &buf, &run.count);
+  if (run.count < 2) {
+    ALLOCV_END(buf);
+    return rb_str_new(NULL, 0);
+  }
+  run.kerns = ALLOCV_N(int32_t, kerns, run.count - 1);
+
+  face_call(run.face->face, face_kerning_run_nogvl, &run);
+  if (run.err != FT_Err_Ok) {
+    ALLOCV_END(buf);
+    ALLOCV_END(kerns);
+    handle_error(run.err);
+  }
+
+  rtn = rb_str_new((const char *) run.kerns, (run.count - 1) * sizeof(int32_t));
+  ALLOCV_END(buf);
+  ALLOCV_END(kerns);
+
+  return rtn;
+}
+
+/*
+ * Get the ASCII name of a glyph in a FT2::Face object.
+ *
+ * Note:
+ *   If the face doesn't provide glyph names or if the glyph index is
+ *   invalid, nil is returned.  The glyph name is truncated if it is
+ *   longer than 1024 characters.
+ *
+ * Examples:
+ *   glyph_index = 45
+ *   glyph_name = face.glyph_name glyph_index
+ *
+ */
+static VALUE ft_face_glyph_name(VALUE self, VALUE glyph_index) {
+  FT_Face *face;
+  FT_Error err;
+  FT_UInt index;
+  char buf[1024];
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  index = NUM2INT(glyph_index);
+
+  /* glyph names are loaded (and cached) on first use */
+  lock_acquire(face_lock(*face));
+  err = FT_Get_Glyph_Name(*face, index, buf, sizeof(buf));
+  pthread_mutex_unlock(face_lock(*face));
+  if (err != FT_Err_Ok)
+    handle_error(err);
+
+  return (buf && strlen(buf)) ? rb_str_new2(buf) : Qnil;
+}
+
+/*
+ * Get the ASCII Postscript name of a FT2::Face object.
+ *
+ * Note:
+ *   This should only work with Postscript and TrueType fonts. If the
+ *   PostScript name is un-avaialble, nil is returned.
+ *
+ * Examples:
+ *   ps_name = face.postscript_name
+ *   name = face.name
+ *
+ */
+static VALUE ft_face_ps_name(VALUE self) {
+  FT_Face *face;
+  const char *str;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+
+  lock_acquire(face_lock(*face));
+  str = FT_Get_Postscript_Name(*face);
+  pthread_mutex_unlock(face_lock(*face));
+
+  if (str != NULL)
+    return rb_str_new2(str);
+  else
+    return Qnil;
+}
+
+/*
+ * Select a FT2::Face object's charmap by its encoding tag.
+ *
+ * Encoding Tags:
+ *   FT2::Encoding::NONE
+ *   FT2::Encoding::SYMBOL
+ *   FT2::Encoding::UNICODE
+ *   FT2::Encoding::LATIN_1
+ *
+ * Examples:
+ *   face.select_charmap FT2::Encoding::UNICODE
+ *
+ */
+static VALUE ft_face_select_charmap(VALUE self, VALUE encoding) {
+  FT_Face *face;
+  FT_Error err;
+  FT_Encoding enc;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  rb_check_frozen(self);
+  enc = NUM2INT(encoding);
+
+  lock_acquire(face_lock(*face));
+  err = FT_Select_Charmap(*face, enc);
+  pthread_mutex_unlock(face_lock(*face));
+  if (err != FT_Err_Ok)
+    handle_error(err);
+  return self;
+}
+
+/*
+ * Select the FT2::Face object's charmap for character code to glyph index decoding.
+ *
+ * Examples:
+ *   charmap = face.charmaps[0]
+ *   face.set_charmap charmap
+ *
+ *   charmap = face.charmaps[0]
+ *   face.charmap = charmap
+ *
+ */
+static VALUE ft_face_set_charmap(VALUE self, VALUE charmap) {
+  FT_Face *face;
+  FT_CharMap *cm;
+  FT_Error err;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  rb_check_frozen(self);
+  TypedData_Get_Struct(charmap, FT_CharMap, &charmap_type, cm);
+
+  lock_acquire(face_lock(*face));
+  err = FT_Set_Charmap(*face, *cm);
+  pthread_mutex_unlock(face_lock(*face));
+  if (err != FT_Err_Ok)
+    handle_error(err);
+  return self;
+}
+
+/*
+ * Return the first character code of the selected charmap and corresponding glyph index of a FT2::Face object.
+ *
+ * Note:
+ *   Using this with FT2::Face#next_char will allow you to iterate
+ *   through the charmap => glyph index mapping for the selected
+ *   charmap.
+ *
+ *   You should probably use the method FT2::Face#each_char_mapping
+ *   or FT2::Face#charmap_pairs instead.
+ *
+ * Examples:
+ *   c_code, g_idx = face.first_char
+ *   while g_idx != 0
+ *     puts "#{c_code} => #{g_idx}"
+ *     c_code, g_idx = face.next_char
+ *   end
+ *
+ */
+static VALUE ft_face_first_char(VALUE self) {
+  FT_Face *face;
+  VALUE ary;
+  FT_ULong char_code;
+  FT_UInt  glyph_index;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  ary = rb_ary_new();
+
+  /* charmap iteration keeps its state in the charmap */
+  lock_acquire(face_lock(*face));
+  char_code = FT_Get_First_Char(*face, &glyph_index);
+  pthread_mutex_unlock(face_lock(*face));
+  rb_ary_push(ary, UINT2NUM(char_code));
+  rb_ary_push(ary, UINT2NUM(glyph_index));
+
+  return ary;
+}
+
+/*
+ * Return the next character code of the selected charmap and corresponding glyph index of a FT2::Face object.
+ *
+ * Note:
+ *   Using this with FT2::Face#first_char will allow you to iterate
+ *   through the charmap => glyph index mapping for the selected
+ *   charmap.  Returns 0 if the charmap is empty, or if there are no
+ *   more codes in the charmap.
+ *
+ *   You should probably use the method FT2::Face#each_char_mapping
+ *   or FT2::Face#charmap_pairs instead.
+ *
+ * Examples:
+ *   c_code, g_idx = face.first_char
+ *   while g_idx != 0
+ *     puts "#{c_code} => #{g_idx}"
+ *     c_code, g_idx = face.next_char
+ *   end
+ *
+ */
+static VALUE ft_face_next_char(VALUE self, VALUE char_code) {
+  FT_Face *face;
+  VALUE ary;
+  FT_ULong code, ret_char_code;
+  FT_UInt  glyph_index;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  ary = rb_ary_new();
+  code = NUM2ULONG(char_code);
+
+  lock_acquire(face_lock(*face));
+  ret_char_code = FT_Get_Next_Char(*face, code, &glyph_index);
+  pthread_mutex_unlock(face_lock(*face));
+  rb_ary_push(ary, UINT2NUM(ret_char_code));
+  rb_ary_push(ary, UINT2NUM(glyph_index));
+
+  return ary;
+}
+
+typedef struct {
+  FT_Face     face;
+  FT_UInt32  *codes,
+             *glyphs;
+  size_t      count,
+              capa;
+  FT_Error    err;
+} FaceCharmapPairs;
+
+static void *face_charmap_pairs_nogvl(void *ptr) {
+  FaceCharmapPairs *pairs = (FaceCharmapPairs *) ptr;
+  FT_UInt32 *codes, *glyphs;
+  FT_ULong code;
+  FT_UInt gindex;
+
+  for (code = FT_Get_First_Char(pairs->face, &gindex); gindex != 0;
+       code = FT_Get_Next_Char(pairs->face, code, &gindex)) {
+    if (pairs->count == pairs->capa) {
+      pairs->capa = pairs->capa ? pairs->capa * 2 : 1024;
+      codes = realloc(pairs->codes, pairs->capa * sizeof(FT_UInt32));
+      if (codes)
+        pairs->codes = codes;
+      glyphs = realloc(pairs->glyphs, pairs->capa * sizeof(FT_UInt32));
+      if (glyphs)
+        pairs->glyphs = glyphs;
+      if (!codes || !glyphs) {
+        pairs->err = FT_Err_Out_Of_Memory;
+        break;
+      }
+    }
+    pairs->codes[pairs->count] = (FT_UInt32) code;
+    pairs->glyphs[pairs->count++] = gindex;
+  }
+
+  return NULL;
+}
+
+/*
+ * Return the character code to glyph index map of the selected charmap of a FT2::Face object.
+ *
+ * Note:
+ *   Returns nil if the selected charmap is empty.
+ *
+ * Examples:
+ *   mapping = face.charmap
+ *
+ */
+static VALUE ft_face_current_charmap(VALUE self) {
+  FT_Face *face;
+  FaceCharmapPairs pairs;
+  VALUE rtn;
+  size_t i;
+
+  rtn = Qnil;
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+
+  /* read under the face lock, the hash is built once it's released */
+  memset(&pairs, 0, sizeof(pairs));
+  pairs.face = *face;
+  face_call(*face, face_charmap_pairs_nogvl, &pairs);
+  if (pairs.err != FT_Err_Ok) {
+    free(pairs.codes);
+    free(pairs.glyphs);
+    handle_error(pairs.err);
+  }
+
+  if (pairs.count > 0) {
+    rtn = rb_hash_new();
+    for (i = 0; i < pairs.count; i++)
+      rb_hash_aset(rtn, UINT2NUM(pairs.codes[i]), UINT2NUM(pairs.glyphs[i]));
+  }
+  free(pairs.codes);
+  free(pairs.glyphs);
+
+  return rtn;
+}
+
+/*
+ * Return the character code to glyph index map of the selected charmap of a FT2::Face object, packed.
+ *
+ * Description:
+ *   Return the mapping of the selected charmap as a two-element array
+ *   of binary strings of native 32-bit unsigned integers: the character
+ *   codes, in ascending order, and the glyph index of each.  Both are
+ *   empty if the charmap is.
+ *
+ * Note:
+ *   Unlike FT2::Face#current_charmap, this allocates two strings
+ *   however large the charmap, and the codes need no sorting.  Other
+ *   Ruby threads keep running while the charmap is read.
+ *
+ * Examples:
+ *   codes, glyphs = face.charmap_pairs
+ *   codes.unpack('L*').zip(glyphs.unpack('L*')) { |c, g| puts "#{c} => #{g}" }
+ *
+ */
+static VALUE ft_face_charmap_pairs(VALUE self) {
+  FT_Face *face;
+  FaceCharmapPairs pairs;
+  VALUE codes, glyphs;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+
+  memset(&pairs, 0, sizeof(pairs));
+  pairs.face = *face;
+  face_call(*face, face_charmap_pairs_nogvl, &pairs);
+  if (pairs.err != FT_Err_Ok) {
+    free(pairs.codes);
+    free(pairs.glyphs);
+    handle_error(pairs.err);
+  }
+
+  codes = rb_str_new((const char *) pairs.codes, pairs.count * sizeof(FT_UInt32));
+  free(pairs.codes);
+  glyphs = rb_str_new((const char *) pairs.glyphs, pairs.count * sizeof(FT_UInt32));
+  free(pairs.glyphs);
+
+  return rb_assoc_new(codes, glyphs);
+}
+
+/*
+ * Iterate over the character code to glyph index map of the selected charmap of a FT2::Face object.
+ *
+ * Description:
+ *   Yield each character code of the selected charmap, in ascending
+ *   order, and its glyph index.  Returns an Enumerator if no block is
+ *   given.
+ *
+ * Note:
+ *   The charmap is walked one code at a time, as with
+ *   FT2::Face#first_char and FT2::Face#next_char, so stopping early
+ *   costs nothing; a block taking two arguments gets them without an
+ *   array being allocated.
+ *
+ * Examples:
+ *   face.each_char_mapping { |c_code, g_idx| puts "#{c_code} => #{g_idx}" }
+ *   first_ten = face.each_char_mapping.first 10
+ *
+ */
+static VALUE ft_face_each_char_mapping(VALUE self) {
+  FT_Face *face;
+  FT_ULong code;
+  FT_UInt gindex;
+
+  RETURN_ENUMERATOR(self, 0, 0);
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+
+  lock_acquire(face_lock(*face));
+  code = FT_Get_First_Char(*face, &gindex);
+  pthread_mutex_unlock(face_lock(*face));
+
+  while (gindex != 0) {
+    rb_yield_values(2, ULONG2NUM(code), UINT2NUM(gindex));
+
+    lock_acquire(face_lock(*face));
+    code = FT_Get_Next_Char(*face, code, &gindex);
+    pthread_mutex_unlock(face_lock(*face));
+  }
+
+  return self;
+}
+
+/* scale `units' (font units) to `size' pixels per EM */
+static VALUE face_scale_units(FT_Face face, double units, VALUE size) {
+  if (!face->units_per_EM)
+    rb_raise(eFt2Error, "Face is not scalable.");
+  return DBL2NUM(units * NUM2DBL(size) / face->units_per_EM);
+}
+
+/*
+ * Get the advance width of a glyph in a FT2::Face object.
+ *
+ * Description:
+ *   Get the advance width of a glyph in a FT2::Face object, in font
+ *   units, or in (fractional, unhinted) pixels at `size' pixels per EM
+ *   if `size' is given.
+ *
+ *   glyph_index: The index of the glyph.
+ *   size: The size in pixels per EM, or nil.
+ *
+ * Note:
+ *   The advances of every glyph are read once, the first time one is
+ *   asked for, and are shared by all the objects using the same parsed
+ *   face (see FT2::Face#share and FT2::FaceCache).  Scaling them to a
+ *   size is plain arithmetic: no glyph is ever loaded, and the face's
+ *   own size is left alone.
+ *
+ *   Hinting may round the advances of a loaded glyph, so these can
+ *   differ slightly from `face.glyph.advance' at small sizes.
+ *
+ * Examples:
+ *   units = face.advance face.char_index(65)
+ *   pixels = face.advance face.char_index(65), 16
+ *
+ */
+static VALUE ft_face_advance(int argc, VALUE *argv, VALUE self) {
+  FT_Face *face;
+  const FT_Int *advances;
+  VALUE glyph_index, size;
+  long index;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  rb_scan_args(argc, argv, "11", &glyph_index, &size);
+
+  index = NUM2LONG(glyph_index);
+  if (index < 0 || index >= (*face)->num_glyphs)
+    handle_error(FT_Err_Invalid_Glyph_Index);
+
+  advances = face_advances(*face);
+  if (size == Qnil)
+    return INT2NUM(advances[index]);
+  return face_scale_units(*face, advances[index], size);
+}
+
+/*
+ * Get the total advance width of a run of glyphs in a FT2::Face object.
+ *
+ * Description:
+ *   Get the sum of the advance widths of an array of glyph indices,
+ *   in font units, or in (fractional, unhinted) pixels at `size' pixels
+ *   per EM if `size' is given.  Kerning is not applied.
+ *
+ *   glyph_ids: An array of glyph indices, or a string of them as
+ *              returned by FT2::Face#glyph_indices.
+ *   size: The size in pixels per EM, or nil.
+ *
+ * Note:
+ *   See FT2::Face#advance.  Measuring a run at many sizes only needs
+ *   its width in font units, which scales linearly.
+ *
+ * Examples:
+ *   ids = 'Hello'.each_char.map { |c| face.char_index c.ord }
+ *   width = face.advances ids, 16
+ *
+ *   # the widths at 8 to 48 pixels per EM, from a single lookup
+ *   units = face.advances ids
+ *   widths = (8..48).map { |s| units * s / face.units_per_em.to_f }
+ *
+ */
+static VALUE ft_face_advances(int argc, VALUE *argv, VALUE self) {
+  FT_Face *face;
+  const FT_Int *advances;
+  FT_UInt32 *glyphs;
+  VALUE glyph_ids, size, buf;
+  long i, count, total = 0;
+
+  TypedData_Get_Struct(self, FT_Face, &face_type, face);
+  rb_scan_args(argc, argv, "11", &glyph_ids, &size);
+
+  advances = face_advances(*face);
+  glyphs = glyph_ids_get(glyph_ids, &buf, &count);
+  for (i = 0; i < count; i++) {
+    if ((FT_Long) glyphs[i] >= (*face)->num_glyphs) {
+      ALLOCV_END(buf);
+      handle_error(FT_Err_Invalid_Glyph_Index);
+    }
+    total += advances[glyphs[i]];
+  }
+  ALLOCV_END(buf);
+
+  if (size == Qnil)
+    return LONG2NUM(total);
+  return face_scale_units(*face, (double) total, size);
+}
+
+/**************************/
+/* FT2::FaceCache methods */
+/**************************/
+
+typedef struct {
+  char    *path;        /* absolute font file path */
+  FT_Long  face_index;
+} FaceCacheKey;
+
+typedef struct FaceCacheEntry {
+  FaceCacheKey key;
+  time_t   mtime;
+  double   checked_at;  /* monotonic time mtime was last read */
+  FT_Face  face;        /* the cache holds one FreeType reference */
+  FT_Library library;   /* ... and one to the face's library */
+  int      pins;        /* opens waiting to reference the face */
+  int      removed;     /* dropped from the cache while pinned */
+  struct FaceCacheEntry *prev, *next;
+} FaceCacheEntry;
+
+typedef struct {
+  st_table       *table;        /* FaceCacheKey => FaceCacheEntry */
+  FaceCacheEntry *head, *tail;  /* most recently used first */
+  long num_entries,
+       max_entries,
+       hits,
+       misses;
+  double ttl;                   /* seconds between mtime checks, < 0 never */
+} FaceCache;
+
+#ifdef HAVE_RUBY_RACTOR_H
+static rb_ractor_local_key_t default_face_cache_key;
+#else
+static VALUE default_face_cache = Qnil;
+#endif /* HAVE_RUBY_RACTOR_H */
+
+static int face_cache_key_cmp(st_data_t a, st_data_t b) {
+  const FaceCacheKey *x = (const FaceCacheKey *) a,
+                     *y = (const FaceCacheKey *) b;
+  return x->face_index != y->face_index || strcmp(x->path, y->path) != 0;
+}
+
+static st_index_t face_cache_key_hash(st_data_t key) {
+  const FaceCacheKey *k = (const FaceCacheKey *) key;
+  return rb_memhash(k->path, strlen(k->path)) ^ (st_index_t) k->face_index;
+}
+
+static const struct st_hash_type face_cache_hash_type = {
+  face_cache_key_cmp,
+  face_cache_key_hash,
+};
+
+static double face_cache_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void face_cache_unlink(FaceCache *cache, FaceCacheEntry *entry) {
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache->head = entry->next;
+
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache->tail = entry->prev;
+
+  entry->prev = entry->next = NULL;
+}
+
+static void face_cache_push(FaceCache *cache, FaceCacheEntry *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head)
+    cache->head->prev = entry;
+  cache->head = entry;
+  if (!cache->tail)
+    cache->tail = entry;
+}
+
+static void face_cache_entry_free(FaceCacheEntry *entry) {
+  /* drops the cache's reference only; live FT2::Face objects keep theirs */
+  face_release(entry->face, NULL, entry->library);
+  free(entry->key.path);
+  free(entry);
+}
+
+/*
+ * Drop `entry' from the cache.  An entry pinned by a FT2::FaceCache#open
+ * waiting for the library lock is freed once that open is done with it.
+ */
+static void face_cache_remove(FaceCache *cache, FaceCacheEntry *entry) {
+  st_data_t key = (st_data_t) &entry->key;
+
+  st_delete(cache->table, &key, NULL);
+  face_cache_unlink(cache, entry);
+  cache->num_entries--;
+  if (entry->pins > 0)
+    entry->removed = 1;
+  else
+    face_cache_entry_free(entry);
+}
+
+static void face_cache_evict(FaceCache *cache, long max_entries) {
+  FaceCacheEntry *entry;
+
+  while (cache->num_entries > max_entries && (entry = cache->tail) != NULL)
+    face_cache_remove(cache, entry);
+}
+
+static void face_cache_free(void *ptr) {
+  FaceCache *cache = (FaceCache *) ptr;
+  if (cache->table) {
+    face_cache_evict(cache, 0);
+    st_free_table(cache->table);
+  }
+  xfree(cache);
+}
+
+/* the faces themselves are reported by the FT2::Memory they live in */
+static size_t face_cache_memsize(const void *ptr) {
+  const FaceCache *cache = (const FaceCache *) ptr;
+  const FaceCacheEntry *entry;
+  size_t size = sizeof(FaceCache) + st_memsize(cache->table);
+
+  for (entry = cache->head; entry; entry = entry->next)
+    size += sizeof(FaceCacheEntry) + strlen(entry->key.path) + 1;
+
+  return size;
+}
+
+static const rb_data_type_t face_cache_type = {
+  "FT2::FaceCache",
+  { 0, face_cache_free, face_cache_memsize, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
+
+static VALUE ft_face_cache_alloc(VALUE klass) {
+  FaceCache *cache;
+  VALUE self;
+
+  self = TypedData_Make_Struct(klass, FaceCache, &face_cache_type, cache);
+  cache->table = st_init_table(&face_cache_hash_type);
+  cache->max_entries = 16;
+  cache->ttl = -1;
+
+  return self;
+}
+
+/*
+ * Constructor for FT2::FaceCache.
+ *
+ * Description:
+ *   Creates a new face cache which holds at most `max_faces' parsed
+ *   FT2::Face objects (16 by default).  When the cache is full, the
+ *   least recently opened face is evicted.
+ *
+ *   If `ttl' is given, FT2::FaceCache#open checks the modification
+ *   time of a cached font file at most once every `ttl' seconds, and
+ *   reparses the file if it changed.  Otherwise cache hits never touch
+ *   the file system.
+ *
+ * Examples:
+ *   cache = FT2::FaceCache.new
+ *   cache = FT2::FaceCache.new 64
+ *   cache = FT2::FaceCache.new 64, ttl: 10
+ *
+ */
+static VALUE ft_face_cache_init(int argc, VALUE *argv, VALUE self) {
+  FaceCache *cache;
+  VALUE max_faces, opts, ttl = Qundef;
+  ID kw_ttl;
+
+  TypedData_Get_Struct(self, FaceCache, &face_cache_type, cache);
+  rb_scan_args(argc, argv, "01:", &max_faces, &opts);
+  if (opts != Qnil) {
+    kw_ttl = rb_intern("ttl");
+    rb_get_kwargs(opts, &kw_ttl, 0, 1, &ttl);
+  }
+  if (max_faces != Qnil) {
+    if (NUM2LONG(max_faces) < 1)
+      rb_raise(rb_eArgError, "Invalid cache size: %ld.", NUM2LONG(max_faces));
+    cache->max_entries = NUM2LONG(max_faces);
+  }
+  if (ttl != Qundef && ttl != Qnil) {
+    if (NUM2DBL(ttl) < 0)
+      rb_raise(rb_eArgError, "ttl must not be negative");
+    cache->ttl = NUM2DBL(ttl);
+  }
+
+  return self;
+}
+
+/*
+ * Get the process-wide FT2::FaceCache instance.
+ *
+ * Note:
+ *   The default cache is created on first use and is shared by every
+ *   caller in the process.  Each Ractor has a default cache of its
+ *   own, since caches (and the faces they hand out) can't be shared.
+ *
+ * Examples:
+ *   face = FT2::FaceCache.default.open 'yudit.ttf'
+ *
+ */
+static VALUE ft_face_cache_default(VALUE klass) {
+#ifdef HAVE_RUBY_RACTOR_H
+  VALUE cache = rb_ractor_local_storage_value(default_face_cache_key);
+
+  if (cache == Qnil) {
+    cache = rb_class_new_instance(0, NULL, klass);
+    rb_ractor_local_storage_value_set(default_face_cache_key, cache);
+  }
+  return cache;
+#else
+  if (default_face_cache == Qnil)
+    default_face_cache = rb_class_new_instance(0, NULL, klass);
+  return default_face_cache;
+#endif /* HAVE_RUBY_RACTOR_H */
+}
+
+/*
+ * Open a FT2::Face object through a FT2::FaceCache.
+ *
+ * Description:
+ *   Faces are keyed by absolute path and face index.  If the font file
+ *   has already been parsed, a new FT2::Face object sharing the parsed
+ *   face is returned without reading or parsing the font file again,
+ *   and without any file system access.  Like FT2::Face#share, each
+ *   object gets a size of its own, initially set like the face's
+ *   default size (see FT2.preload).
+ *
+ *   With `revalidate: true' (or once the cache's `ttl' has passed) the
+ *   modification time of a cached font file is checked, and the file
+ *   is parsed again if it changed on disk.
+ *
+ * Note:
+ *   FT2::Face objects returned for the same key share the underlying
+ *   FreeType face, including its transform and glyph slot.  Evicting
+ *   an entry never invalidates faces which have already been handed
+ *   out; each of them holds its own reference.
+ *
+ *   Relative paths are expanded against the current directory, but
+ *   symbolic links aren't resolved, so two links to the same file are
+ *   cached separately.
+ *
+ * Examples:
+ *   face = cache.open 'yudit.ttf'
+ *   face = cache.open 'yudit.ttf', 1
+ *   face = cache.open 'yudit.ttf', revalidate: true
+ *
+ */
+static VALUE face_cache_reference_protected(VALUE ptr) {
+  FaceCacheEntry *entry = (FaceCacheEntry *) ptr;
+  face_reference(entry->face, entry->library);
+  return Qnil;
+}
+
+static VALUE face_cache_open(FaceCache *cache, VALUE path, VALUE index, int revalidate) {
+  FaceCacheEntry *entry = NULL;
+  FaceCacheKey key;
+  st_data_t found;
+  FT_Library lib;
+  FT_Face face;
+  FT_Size size;
+  FT_Error err;
+  struct stat st;
+  double now = 0;
+  int state = 0;
+
+  /* a relative path means another file after Dir.chdir */
+  path = rb_file_expand_path(path, Qnil);
+  key.path = StringValueCStr(path);
+  key.face_index = (index == Qnil) ? 0 : NUM2LONG(index);
+
+  if (st_lookup(cache->table, (st_data_t) &key, &found))
+    entry = (FaceCacheEntry *) found;
+
+  if (entry && (revalidate || cache->ttl >= 0)) {
+    now = face_cache_now();
+    if (revalidate || now - entry->checked_at >= cache->ttl) {
+      if (stat(key.path, &st) != 0) {
+        face_cache_remove(cache, entry);
+        rb_sys_fail(key.path);
+      }
+      entry->checked_at = now;
+      if (entry->mtime != st.st_mtime) {
+        /* stale entry, the file changed on disk */
+        face_cache_remove(cache, entry);
+        entry = NULL;
+      }
+    }
+  }
+
+  if (entry) {
+    cache->hits++;
+    face_cache_unlink(cache, entry);
+    face_cache_push(cache, entry);
+  } else {
+    cache->misses++;
+    if (stat(key.path, &st) != 0)
+      rb_sys_fail(key.path);
+    if ((key.path = strdup(key.path)) == NULL)
+      rb_memerror();
+
+    lib = current_library();
+    err = face_open_path(lib, key.path, key.face_index, &face);
+    if (err != FT_Err_Ok) {
+      free(key.path);
+      handle_error(err);
+    }
+
+    /*
+     * The GVL was released while parsing, so another thread may have
+     * cached the same key meanwhile; if so, use its face.
+     */
+    if (st_lookup(cache->table, (st_data_t) &key, &found)) {
+      face_release(face, NULL, lib);
+      free(key.path);
+      entry = (FaceCacheEntry *) found;
+      face_cache_unlink(cache, entry);
+      face_cache_push(cache, entry);
+    } else {
+      if ((entry = malloc(sizeof(FaceCacheEntry))) == NULL) {
+        face_release(face, NULL, lib);
+        free(key.path);
+        rb_memerror();
+      }
+      entry->key = key;
+      entry->mtime = st.st_mtime;
+      entry->checked_at = (cache->ttl >= 0) ? face_cache_now() : now;
+      entry->face = face;
+      entry->library = lib;   /* referenced by face_open */
+      entry->pins = 0;
+      entry->removed = 0;
+      st_insert(cache->table, (st_data_t) &entry->key, (st_data_t) entry);
+      face_cache_push(cache, entry);
+      cache->num_entries++;
+    }
+  }
+
+  /*
+   * Waiting for the library lock releases the GVL, and with it other
+   * threads may evict or clear the entry; the pin keeps the cache's
+   * reference (and so the face) alive until ours is taken.
+   */
+  entry->pins++;
+  rb_protect(face_cache_reference_protected, (VALUE) entry, &state);
+  face = entry->face;
+  lib = entry->library;
+  if (--entry->pins == 0 && entry->removed)
+    face_cache_entry_free(entry);
+  if (state)
+    rb_jump_tag(state);
+
+  /* evict after taking our references, so the face can't disappear */
+  face_cache_evict(cache, cache->max_entries);
+  RB_GC_GUARD(path);
+
+  size = face_new_size(face, lib, (FT_Size) face->sizes_list.head->data);
+  return face_wrap_size(cFace, face, lib, size);
+}
+
+static VALUE ft_face_cache_open(int argc, VALUE *argv, VALUE self) {
+  FaceCache *cache;
+  VALUE path, index, opts, revalidate = Qundef;
+  ID kw_revalidate;
+
+  TypedData_Get_Struct(self, FaceCache, &face_cache_type, cache);
+  rb_scan_args(argc, argv, "11:", &path, &index, &opts);
+  if (opts != Qnil) {
+    kw_revalidate = rb_intern("revalidate");
+    rb_get_kwargs(opts, &kw_revalidate, 0, 1, &revalidate);
+  }
+
+  return face_cache_open(cache, path, index, revalidate != Qundef && RTEST(revalidate));
+}
+
+/*
+ * Return the number of FT2::FaceCache#open calls served from the cache.
+ *
+ * Examples:
+ *   hits = cache.hits
+ *
+ */
+static VALUE ft_face_cache_hits(VALUE self) {
+  FaceCache *cache;
+  TypedData_Get_Struct(self, FaceCache, &face_cache_type, cache);
+  return LONG2NUM(cache->hits);
+}
+
+/*
+ * Return the number of FT2::FaceCache#open calls which had to parse the font file.
+ *
+ * Examples:
+ *   misses = cache.misses
+ *
+ */
+static VALUE ft_face_cache_misses(VALUE self) {
+  FaceCache *cache;
+  TypedData_Get_Struct(self, FaceCache, &face_cache_type, cache);
+  return LONG2NUM(cache->misses);
+}
+
+/*
+ * Return the number of faces currently held by a FT2::FaceCache.
+ *
+ * Aliases:
+ *   FT2::FaceCache#length
+ *
+ * Examples:
+ *   num_faces = cache.size
+ *
+ */
+static VALUE ft_face_cache_size(VALUE self) {
+  FaceCache *cache;
+  TypedData_Get_Struct(self, FaceCache, &face_cache_type, cache);
+  return LONG2NUM(cache->num_entries);
+}
+
+/*
+ * Return the maximum number of faces held by a FT2::FaceCache.
+ *
+ * Examples:
+ *   max = cache.max_faces
+ *
+ */
+static VALUE ft_face_cache_max_faces(VALUE self) {
+  FaceCache *cache;
+  TypedData_Get_Struct(self, FaceCache, &face_cache_type, cache);
+  return LONG2NUM(cache->max_entries);
+}
+
+/*
+ * Drop every face held by a FT2::FaceCache and reset its counters.
+ *
+ * Note:
+ *   FT2::Face objects already returned by FT2::FaceCache#open remain
+ *   valid.
+ *
+ * Examples:
+ *   cache.clear
+ *
+ */
+static VALUE ft_face_cache_clear(VALUE self) {
+  FaceCache *cache;
+  TypedData_Get_Struct(self, FaceCache, &face_cache_type, cache);
+  face_cache_evict(cache, 0);
+  cache->hits = cache->misses = 0;
+  return self;
+}
+
+/**************************/
+/* FT2 preload and fork   */
+/**************************/
+
+typedef struct {
+  FT_Face   face;
+  int       size;     /* pixels per EM, or 0 */
+  FT_Error  err;
+} FacePreload;
+
+static void *face_preload_nogvl(void *ptr) {
+  FacePreload *pre = (FacePreload *) ptr;
+  FT_Face face = pre->face;
+  FaceData *data;
+  FT_ULong code;
+  FT_UInt gindex;
+
+  /* faces opened through the cache start at the default size */
+  if ((pre->err = FT_Activate_Size((FT_Size) face->sizes_list.head->data)) != FT_Err_Ok)
+    return NULL;
+
+  if ((data = face_data(face)) == NULL) {
+    pre->err = FT_Err_Out_Of_Memory;
+    return NULL;
+  }
+
+  /* build the Unicode table (see FT2::Face#char_index), or at least
+   * walk the charmap, so the cmap is paged in */
+  if ((pre->err = face_data_cmap(face, data)) != FT_Err_Ok)
+    return NULL;
+  if (!(data->built & FACE_DATA_CMAP))
+    for (code = FT_Get_First_Char(face, &gindex); gindex != 0;
+         code = FT_Get_Next_Char(face, code, &gindex))
+      ;
+
+  /* build the advance table (see FT2::Face#advance) */
+  if ((pre->err = face_data_advances(face, data)) != FT_Err_Ok)
+    return NULL;
+
+  if (pre->size)
+    pre->err = FT_Set_Pixel_Sizes(face, 0, pre->size);
+
+  return NULL;
+}
+
+static void face_preload(FT_Face face, int size) {
+  FacePreload pre;
+
+  pre.face = face;
+  pre.size = size;
+
+  face_call(face, face_preload_nogvl, &pre);
+  if (pre.err != FT_Err_Ok)
+    handle_error(pre.err);
+}
+
+/*
+ * Preload fonts in a preforking server, before forking the workers.
+ *
+ * Description:
+ *   Opens every face of `paths' through FT2::FaceCache.default (growing
+ *   it to hold them all), walks its charmap and builds its advance
+ *   table (see FT2::Face#advance).  With `size', the default size of
+ *   each face is set to `size' pixels per EM, which faces opened
+ *   through the cache start at.  Workers forked after this share the
+ *   parsed faces with the master copy-on-write: their
+ *   FT2::FaceCache.default.open calls for the same fonts are hits, and
+ *   never parse the font files again.
+ *
+ *   Each element of `paths' is a path, or an array of a path and a face
+ *   index.  Returns an array of the preloaded FT2::Face objects.
+ *
+ * Note:
+ *   On Ruby 3.3 and later, calling Process.warmup afterwards also
+ *   compacts the heap before forking.
+ *
+ * Examples:
+ *   FT2.preload %w[fonts/yudit.ttf fonts/serif.ttf], size: 16
+ *   FT2.preload [['fonts/collection.ttc', 1]]
+ *
+ */
+static VALUE ft_preload(int argc, VALUE *argv, VALUE klass) {
+  VALUE paths, opts, size = Qundef, cache_obj, faces, face, args[2];
+  FaceCache *cache;
+  ID kw_size;
+  int px = 0;
+  long i;
+  UNUSED(klass);
+
+  rb_scan_args(argc, argv, "1:", &paths, &opts);
+  if (opts != Qnil) {
+    kw_size = rb_intern("size");
+    rb_get_kwargs(opts, &kw_size, 0, 1, &size);
+  }
+  paths = rb_Array(paths);
+  if (size != Qundef && size != Qnil && (px = NUM2INT(size)) <= 0)
+    rb_raise(rb_eArgError, "size must be positive");
+
+  cache_obj = ft_face_cache_default(cFaceCache);
+  TypedData_Get_Struct(cache_obj, FaceCache, &face_cache_type, cache);
+  if (cache->max_entries < cache->num_entries + RARRAY_LEN(paths))
+    cache->max_entries = cache->num_entries + RARRAY_LEN(paths);
+
+  faces = rb_ary_new_capa(RARRAY_LEN(paths));
+  for (i = 0; i < RARRAY_LEN(paths); i++) {
+    args[0] = RARRAY_AREF(paths, i);
+    args[1] = Qnil;
+    if (RB_TYPE_P(args[0], T_ARRAY)) {
+      args[1] = rb_ary_entry(args[0], 1);
+      args[0] = rb_ary_entry(args[0], 0);
+    }
+
+    face = face_cache_open(cache, args[0], args[1], 0);
+    face_preload(*((FT_Face *) RTYPEDDATA_DATA(face)), px);
+    rb_ary_push(faces, face);
+  }
+
+  return faces;
+}
+
+/*
+ * Runs in the child after fork(2).  Only the forking thread survives,
+ * so a lock another thread held at the time would stay held forever;
+ * every lock is reinitialized, unlocked.  The forking thread itself
+ * only holds locks around FreeType calls, and FreeType only calls back
+ * into Ruby (which might fork) to read an FT2::Face.from_io stream.
+ * The parsed faces themselves stay valid, and are shared copy-on-write.
+ */
+static void ft2_atfork_child(void) {
+  Memory *mem;
+  int i;
+
+  for (i = 0; i < LOCK_STRIPES; i++) {
+    pthread_mutex_init(&face_locks[i], NULL);
+    pthread_mutex_init(&library_locks[i], NULL);
+  }
+  pthread_mutex_init(&pending_faces_lock, NULL);
+  pthread_mutex_init(&pinned_objects_lock, NULL);
+  pthread_mutex_init(&font_mappings_lock, NULL);
+
+  pthread_mutex_init(&memories_lock, NULL);
+  for (mem = memories; mem; mem = mem->next)
+    pthread_mutex_init(&mem->lock, NULL);
+
+  cache_atfork_child();
+}
+
+/**********************/
+/* FT2::Cache methods */
+/**********************/
+
+typedef struct {
+  char *path;           /* NULL once removed */
+  long  face_index;
+} CacheFace;
+
+/*
+ * A FreeType cache manager with its image, small bitmap and charmap
+ * caches.  FTC isn't thread safe, and opens (and closes) the faces it
+ * needs itself, so each FT2::Cache has a private library, and all of
+ * it is only used with `lock' held.  Face ids are indices into `faces'
+ * plus one, since FTC treats a NULL face id specially.
+ */
+typedef struct Cache {
+  pthread_mutex_t  lock;
+  FT_Library       library;
+  FTC_Manager      manager;
+  FTC_ImageCache   images;
+  FTC_SBitCache    sbits;
+  FTC_CMapCache    cmaps;
+  CacheFace       *faces;
+  long             num_faces,
+                   capa;
+  struct Cache    *prev, *next;   /* in the list of all caches, for fork */
+} Cache;
+
+static Cache *caches = NULL;
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+static VALUE sCacheSBit;
+
+/* see ft2_atfork_child */
+static void cache_atfork_child(void) {
+  Cache *cache;
+
+  pthread_mutex_init(&caches_lock, NULL);
+  for (cache = caches; cache; cache = cache->next)
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+static FT_Error cache_face_requester(FTC_FaceID face_id, FT_Library lib,
+                                     FT_Pointer data, FT_Face *face) {
+  Cache *cache = (Cache *) data;
+  long i = (long) (uintptr_t) face_id - 1;
+
+  if (i < 0 || i >= cache->num_faces || !cache->faces[i].path)
+    return FT_Err_Invalid_Argument;
+  return FT_New_Face(lib, cache->faces[i].path, cache->faces[i].face_index, face);
+}
+
+static void cache_free(void *ptr) {
+  Cache *cache = (Cache *) ptr;
+  long i;
+
+  if (cache->manager)
+    FTC_Manager_Done(cache->manager);
+  /* glyphs returned by lookups hold references to the library */
+  if (cache->library)
+    face_release(NULL, NULL, cache->library);
+  for (i = 0; i < cache->num_faces; i++)
+    free(cache->faces[i].path);
+  free(cache->faces);
+
+  pthread_mutex_lock(&caches_lock);
+  if (cache->prev)
+    cache->prev->next = cache->next;
+  else
+    caches = cache->next;
+  if (cache->next)
+    cache->next->prev = cache->prev;
+  pthread_mutex_unlock(&caches_lock);
+
+  pthread_mutex_destroy(&cache->lock);
+  xfree(ptr);
+}
+
+/* the FTC side is reported by the FT2::Memory of its library */
+static size_t cache_memsize(const void *ptr) {
+  const Cache *cache = (const Cache *) ptr;
+  size_t size = sizeof(Cache) + cache->capa * sizeof(CacheFace);
+  long i;
+
+  for (i = 0; i < cache->num_faces; i++)
+    if (cache->faces[i].path)
+      size += strlen(cache->faces[i].path) + 1;
+
+  return size;
+}
+
+static const rb_data_type_t cache_type = {
+  "FT2::Cache",
+  { 0, cache_free, cache_memsize, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
+
+static VALUE ft_cache_alloc(VALUE klass) {
+  Cache *cache;
+  VALUE self;
+
+  self = TypedData_Make_Struct(klass, Cache, &cache_type, cache);
+  pthread_mutex_init(&cache->lock, NULL);
+
+  pthread_mutex_lock(&caches_lock);
+  cache->next = caches;
+  if (caches)
+    caches->prev = cache;
+  caches = cache;
+  pthread_mutex_unlock(&caches_lock);
+
+  return self;
+}
+
+static Cache *cache_get(VALUE self) {
+  Cache *cache;
+
+  TypedData_Get_Struct(self, Cache, &cache_type, cache);
+  if (!cache->manager)
+    rb_raise(eFt2Error, "FT2::Cache not initialized.");
+
+  return cache;
+}
+
+/* the face id `id' as a FTC_FaceID, checking it was added */
+static FTC_FaceID cache_face_id(Cache *cache, VALUE id) {
+  long i = NUM2LONG(id) - 1;
+  int known;
+
+  /* FT2::Cache#add_face may be moving `faces' */
+  lock_acquire(&cache->lock);
+  known = i >= 0 && i < cache->num_faces && cache->faces[i].path;
+  pthread_mutex_unlock(&cache->lock);
+  if (!known)
+    rb_raise(rb_eArgError, "unknown face id %ld", i + 1);
+
+  return (FTC_FaceID) (uintptr_t) (i + 1);
+}
+
+/*
+ * Constructor for FT2::Cache.
+ *
+ * Description:
+ *   Creates a cache of glyph images, small bitmaps and charmap lookups
+ *   built on the FreeType cache subsystem (FTC).  Fonts are added with
+ *   FT2::Cache#add_face, which returns a face id; the cache opens them
+ *   when first needed, and closes them again as needed to stay within
+ *   its limits.  A zero limit selects the FreeType default.
+ *
+ *   max_faces: maximum number of open faces (FreeType default: 2)
+ *   max_sizes: maximum number of sizes (FreeType default: 4)
+ *   max_bytes: maximum number of bytes of cached data (FreeType
+ *              default: 200000)
+ *
+ * Note:
+ *   Every FT2::Cache has its own FreeType library.  Lookups release the
+ *   GVL, and may be called from several threads.
+ *
+ * Examples:
+ *   cache = FT2::Cache.new
+ *   cache = FT2::Cache.new max_faces: 8, max_bytes: 4 << 20
+ *
+ */
+static VALUE ft_cache_init(int argc, VALUE *argv, VALUE self) {
+  static const char *names[] = { "max_faces", "max_sizes", "max_bytes" };
+  VALUE opts, vals[3] = { Qundef, Qundef, Qundef };
+  unsigned long limits[3] = { 0, 0, 0 };
+  ID kws[3];
+  Cache *cache;
+  FT_Error err;
+  int i;
+
+  rb_scan_args(argc, argv, ":", &opts);
+  if (opts != Qnil) {
+    for (i = 0; i < 3; i++)
+      kws[i] = rb_intern(names[i]);
+    rb_get_kwargs(opts, kws, 0, 3, vals);
+  }
+  for (i = 0; i < 3; i++)
+    if (vals[i] != Qundef && vals[i] != Qnil)
+      limits[i] = NUM2ULONG(vals[i]);
+
+  TypedData_Get_Struct(self, Cache, &cache_type, cache);
+  if (cache->library)
+    rb_raise(eFt2Error, "FT2::Cache already initialized.");
+
+  if ((err = memory_new_library(default_memory, &cache->library)) != FT_Err_Ok)
+    handle_error(err);
+  err = FTC_Manager_New(cache->library, limits[0], limits[1], limits[2],
+                        cache_face_requester, cache, &cache->manager);
+  if (err == FT_Err_Ok)
+    err = FTC_ImageCache_New(cache->manager, &cache->images);
+  if (err == FT_Err_Ok)
+    err = FTC_SBitCache_New(cache->manager, &cache->sbits);
+  if (err == FT_Err_Ok)
+    err = FTC_CMapCache_New(cache->manager, &cache->cmaps);
+  memory_gc_flush();
+  if (err != FT_Err_Ok)
+    handle_error(err);
+
+  return self;
+}
+
+/*
+ * Add a font to a FT2::Cache, and return its face id.
+ *
+ * Description:
+ *   The font isn't opened until a lookup needs it, so errors opening
+ *   it are raised by the lookups.
+ *
+ * Examples:
+ *   id = cache.add_face 'yudit.ttf'
+ *   id = cache.add_face 'fonts.ttc', 2
+ *
+ */
+static VALUE ft_cache_add_face(int argc, VALUE *argv, VALUE self) {
+  Cache *cache = cache_get(self);
+  VALUE path, index;
+  CacheFace *faces;
+  long id, face_index, capa;
+  char *face_path;
+
+  /* nothing may raise while the lock is held */
+  rb_scan_args(argc, argv, "11", &path, &index);
+  FilePathValue(path);
+  face_index = (index == Qnil) ? 0 : NUM2LONG(index);
+
+  lock_acquire(&cache->lock);
+  if ((face_path = strdup(RSTRING_PTR(path))) == NULL) {
+    pthread_mutex_unlock(&cache->lock);
+    rb_memerror();
+  }
+  if (cache->num_faces == cache->capa) {
+    capa = cache->capa ? cache->capa * 2 : 8;
+    if ((faces = realloc(cache->faces, capa * sizeof(CacheFace))) == NULL) {
+      pthread_mutex_unlock(&cache->lock);
+      free(face_path);
+      rb_memerror();
+    }
+    cache->faces = faces;
+    cache->capa = capa;
+  }
+  cache->faces[cache->num_faces].path = face_path;
+  cache->faces[cache->num_faces].face_index = face_index;
+  id = ++cache->num_faces;
+  pthread_mutex_unlock(&cache->lock);
+
+  return LONG2NUM(id);
+}
+
+/*
+ * Remove a font from a FT2::Cache, dropping everything cached for it.
+ *
+ * Examples:
+ *   cache.remove_face id
+ *
+ */
+static VALUE ft_cache_remove_face(VALUE self, VALUE id) {
+  Cache *cache = cache_get(self);
+  FTC_FaceID face_id = cache_face_id(cache, id);
+  long i = (long) (uintptr_t) face_id - 1;
+
+  lock_acquire(&cache->lock);
+  FTC_Manager_RemoveFaceID(cache->manager, face_id);
+  free(cache->faces[i].path);
+  cache->faces[i].path = NULL;
+  pthread_mutex_unlock(&cache->lock);
+
+  return self;
+}
+
+typedef struct {
+  Cache         *cache;
+  FTC_ScalerRec  scaler;
+  FT_UInt        gindex;
+  FT_ULong       flags;
+  FT_Glyph       glyph;     /* a copy of the cached image */
+  FTC_SBitRec    sbit;
+  FT_Byte       *buffer;    /* a copy of the bitmap of `sbit' */
+  size_t         size;
+  FT_Error       err;
+  int            nomem;     /* copying the bitmap failed */
+} CacheLookup;
+
+/*
+ * FTC frees a size twice after failing to set it up once its list of
+ * sizes is full (FreeType 2.12 at least), so make sure the face opens
+ * and has the size first.  Call with the cache lock held.
+ */
+static FT_Error cache_check_scaler(Cache *cache, FTC_Scaler scaler) {
+  FT_Bitmap_Size *bsize;
+  FT_Error err;
+  FT_Face face;
+  int i;
+
+  if ((err = FTC_Manager_LookupFace(cache->manager, scaler->face_id, &face)) != FT_Err_Ok)
+    return err;
+  if (FT_IS_SCALABLE(face))
+    return FT_Err_Ok;
+
+  for (i = 0; i < face->num_fixed_sizes; i++) {
+    bsize = &face->available_sizes[i];
+    if (((bsize->x_ppem + 32) & ~63) == (FT_Pos) scaler->width << 6 &&
+        ((bsize->y_ppem + 32) & ~63) == (FT_Pos) scaler->height << 6)
+      return FT_Err_Ok;
+  }
+
+  return FT_Err_Invalid_Pixel_Size;
+}
+
+static void *cache_lookup_glyph_nogvl(void *ptr) {
+  CacheLookup *look = (CacheLookup *) ptr;
+  FT_Glyph glyph;
+
+  pthread_mutex_lock(&look->cache->lock);
+  look->err = cache_check_scaler(look->cache, &look->scaler);
+  if (look->err == FT_Err_Ok)
+    look->err = FTC_ImageCache_LookupScaler(look->cache->images, &look->scaler,
+                                            look->flags, look->gindex,
+                                            &glyph, NULL);
+  /* without a node, the cached glyph is only valid until the next lookup */
+  if (look->err == FT_Err_Ok)
+    look->err = FT_Glyph_Copy(glyph, &look->glyph);
+  pthread_mutex_unlock(&look->cache->lock);
+
+  return NULL;
+}
+
+static void *cache_lookup_sbit_nogvl(void *ptr) {
+  CacheLookup *look = (CacheLookup *) ptr;
+  FTC_SBit sbit;
+
+  pthread_mutex_lock(&look->cache->lock);
+  look->err = cache_check_scaler(look->cache, &look->scaler);
+  if (look->err == FT_Err_Ok)
+    look->err = FTC_SBitCache_LookupScaler(look->cache->sbits, &look->scaler,
+                                           look->flags, look->gindex,
+                                           &sbit, NULL);
+  if (look->err == FT_Err_Ok) {
+    look->sbit = *sbit;
+    look->size = sbit->buffer ? (size_t) abs(sbit->pitch) * sbit->height : 0;
+    if (look->size) {
+      if ((look->buffer = malloc(look->size)) != NULL)
+        memcpy(look->buffer, sbit->buffer, look->size);
+      else
+        look->nomem = 1;
+    }
+  }
+  pthread_mutex_unlock(&look->cache->lock);
+
+  return NULL;
+}
+
+static void cache_lookup_init(CacheLookup *look, VALUE self, int argc, VALUE *argv) {
+  VALUE id, size, glyph_index, flags;
+
+  memset(look, 0, sizeof(CacheLookup));
+  rb_scan_args(argc, argv, "31", &id, &size, &glyph_index, &flags);
+
+  look->cache = cache_get(self);
+  look->scaler.face_id = cache_face_id(look->cache, id);
+  look->scaler.width = look->scaler.height = NUM2UINT(size);
+  if (look->scaler.height < 1)
+    rb_raise(rb_eArgError, "size must be positive");
+  look->scaler.pixel = 1;
+  look->gindex = NUM2UINT(glyph_index);
+  look->flags = (flags == Qnil) ? FT_LOAD_DEFAULT : NUM2ULONG(flags);
+}
+
+/*
+ * Look up a glyph image in a FT2::Cache.
+ *
+ * Description:
+ *   Returns a FT2::Glyph of glyph `glyph_index' of the font `face_id'
+ *   at `size' pixels per EM, loaded with the FT2::Load flags `flags'.
+ *   Only the first lookup of a glyph loads (and hints) it; later ones
+ *   copy the cached image.
+ *
+ * Examples:
+ *   glyph = cache.lookup_glyph id, 16, 36
+ *   glyph = cache.lookup_glyph id, 16, 36, FT2::Load::NO_HINTING
+ *
+ */
+static VALUE ft_cache_lookup_glyph(int argc, VALUE *argv, VALUE self) {
+  CacheLookup look;
+
+  cache_lookup_init(&look, self, argc, argv);
+  nogvl_call(cache_lookup_glyph_nogvl, &look);
+  if (look.err != FT_Err_Ok)
+    handle_error(look.err);
+
+  return glyph_wrap(cGlyph, look.glyph);
+}
+
+/*
+ * Look up a small rendered bitmap in a FT2::Cache.
+ *
+ * Description:
+ *   Returns a FT2::Cache::SBit (width, height, left, top, format,
+ *   max_grays, pitch, x_advance, y_advance, buffer) for glyph
+ *   `glyph_index' of the font `face_id' at `size' pixels per EM.  The
+ *   glyph is rendered with the FT2::Load flags `flags' (anti-aliased,
+ *   unless FT2::Load::MONOCHROME is given) on the first lookup only.
+ *
+ * Note:
+ *   Bitmaps too large for a small bitmap (over 255 pixels wide or high)
+ *   aren't cached, and have an empty buffer; use FT2::Cache#lookup_glyph
+ *   for those.
+ *
+ * Examples:
+ *   sbit = cache.lookup_sbit id, 16, 36
+ *   pen_x += sbit.x_advance
+ *
+ */
+static VALUE ft_cache_lookup_sbit(int argc, VALUE *argv, VALUE self) {
+  CacheLookup look;
+  VALUE buffer;
+
+  cache_lookup_init(&look, self, argc, argv);
+  nogvl_call(cache_lookup_sbit_nogvl, &look);
+  if (look.err != FT_Err_Ok)
+    handle_error(look.err);
+  if (look.nomem)
+    rb_memerror();
+
+  buffer = rb_str_new((const char *) look.buffer, look.size);
+  free(look.buffer);
+
+  return rb_struct_new(sCacheSBit,
+                       INT2FIX(look.sbit.width),
+                       INT2FIX(look.sbit.height),
+                       INT2FIX(look.sbit.left),
+                       INT2FIX(look.sbit.top),
+                       INT2FIX(look.sbit.format),
+                       INT2FIX(look.sbit.max_grays),
+                       INT2FIX(look.sbit.pitch),
+                       INT2FIX(look.sbit.xadvance),
+                       INT2FIX(look.sbit.yadvance),
+                       buffer);
+}
+
+typedef struct {
+  Cache      *cache;
+  FTC_FaceID  face_id;
+  FT_UInt32   code;
+  FT_UInt     gindex;
+} CacheCharIndex;
+
+static void *cache_char_index_nogvl(void *ptr) {
+  CacheCharIndex *look = (CacheCharIndex *) ptr;
+
+  pthread_mutex_lock(&look->cache->lock);
+  look->gindex = FTC_CMapCache_Lookup(look->cache->cmaps, look->face_id,
+                                      -1, look->code);
+  pthread_mutex_unlock(&look->cache->lock);
+
+  return NULL;
+}
+
+/*
+ * Look up the glyph index of a character code in a FT2::Cache.
+ *
+ * Description:
+ *   Uses the default charmap of the font `face_id'.  Returns 0 for
+ *   characters the font doesn't have.
+ *
+ * Examples:
+ *   glyph_index = cache.char_index id, 'A'.ord
+ *
+ */
+static VALUE ft_cache_char_index(VALUE self, VALUE id, VALUE char_code) {
+  CacheCharIndex look;
+
+  look.cache = cache_get(self);
+  look.face_id = cache_face_id(look.cache, id);
+  look.code = NUM2UINT(char_code);
+  look.gindex = 0;
+  nogvl_call(cache_char_index_nogvl, &look);
+
+  return UINT2NUM(look.gindex);
+}
+
+/*
+ * Drop everything cached by a FT2::Cache, and close its faces.
+ *
+ * Description:
+ *   The fonts added with FT2::Cache#add_face stay, and their face ids
+ *   remain valid.
+ *
+ * Examples:
+ *   cache.flush
+ *
+ */
+static VALUE ft_cache_flush(VALUE self) {
+  Cache *cache = cache_get(self);
+
+  lock_acquire(&cache->lock);
+  FTC_Manager_Reset(cache->manager);
+  pthread_mutex_unlock(&cache->lock);
+
+  return self;
+}
+
+/***************************/
+/* FT2::GlyphCache methods */
+/***************************/
+
+/*
+ * Everything a rendered glyph depends on.  Keys are compared and hashed
+ * as raw memory, so every field is pointer sized, leaving no padding.
+ * The size is identified by its ppem and scales rather than by its
+ * FT_Size, which may be freed and its address reused.
+ */
+typedef struct {
+  FT_Face   face;
+  FT_Long   x_ppem, y_ppem;
+  FT_Fixed  x_scale, y_scale;
+  FT_Fixed  xx, xy, yx, yy;     /* the transform */
+  FT_Pos    dx, dy;
+  FT_Long   glyph_index,
+            load_flags,
+            render_mode;
+} GlyphCacheKey;
+
+typedef struct GlyphCacheEntry {
+  GlyphCacheKey  key;
+  VALUE          face,      /* keeps key.face alive, so it isn't reused */
+                 glyph;     /* the frozen FT2::GlyphCache::Glyph */
+  size_t         bytes;
+  struct GlyphCacheEntry *prev, *next;
+} GlyphCacheEntry;
+
+/* most recently used first; `bytes' counts bitmaps and entries */
+typedef struct {
+  st_table         *table;
+  GlyphCacheEntry  *head, *tail;
+  size_t            bytes,
+                    max_bytes;
+  unsigned long     hits,
+                    misses,
+                    evictions;
+} GlyphCache;
+
+static VALUE sGlyphCacheGlyph;
+
+static int glyph_cache_key_cmp(st_data_t a, st_data_t b) {
+  return memcmp((const void *) a, (const void *) b, sizeof(GlyphCacheKey)) != 0;
+}
+
+static st_index_t glyph_cache_key_hash(st_data_t key) {
+  return rb_memhash((const void *) key, sizeof(GlyphCacheKey));
+}
+
+static const struct st_hash_type glyph_cache_hash_type = {
+  glyph_cache_key_cmp,
+  glyph_cache_key_hash,
+};
+
+static void glyph_cache_unlink(GlyphCache *cache, GlyphCacheEntry *entry) {
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    cache->head = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    cache->tail = entry->prev;
+  entry->prev = entry->next = NULL;
+}
+
+static void glyph_cache_push(GlyphCache *cache, GlyphCacheEntry *entry) {
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head)
+    cache->head->prev = entry;
+  cache->head = entry;
+  if (!cache->tail)
+    cache->tail = entry;
+}
+
+/* evict least recently used glyphs until at most `max_bytes' are held */
+static void glyph_cache_evict(GlyphCache *cache, size_t max_bytes) {
+  GlyphCacheEntry *entry;
+  st_data_t key;
+
+  while (cache->bytes > max_bytes && (entry = cache->tail) != NULL) {
+    glyph_cache_unlink(cache, entry);
+    key = (st_data_t) &entry->key;
+    st_delete(cache->table, &key, NULL);
+    cache->bytes -= entry->bytes;
+    cache->evictions++;
+    xfree(entry);
+  }
+}
+
+static void glyph_cache_mark(void *ptr) {
+  GlyphCache *cache = (GlyphCache *) ptr;
+  GlyphCacheEntry *entry;
+
+  for (entry = cache->head; entry; entry = entry->next) {
+    rb_gc_mark_movable(entry->face);
+    rb_gc_mark_movable(entry->glyph);
+  }
+}
+
+static void glyph_cache_free(void *ptr) {
+  GlyphCache *cache = (GlyphCache *) ptr;
+  GlyphCacheEntry *entry;
+
+  while ((entry = cache->head) != NULL) {
+    cache->head = entry->next;
+    xfree(entry);
+  }
+  if (cache->table)
+    st_free_table(cache->table);
+  xfree(ptr);
+}
+
+/* the bitmaps themselves are reported by their String objects */
+static size_t glyph_cache_memsize(const void *ptr) {
+  const GlyphCache *cache = (const GlyphCache *) ptr;
+  return sizeof(GlyphCache) + st_memsize(cache->table) +
+         cache->table->num_entries * sizeof(GlyphCacheEntry);
+}
+
+static void glyph_cache_compact(void *ptr) {
+  GlyphCache *cache = (GlyphCache *) ptr;
+  GlyphCacheEntry *entry;
+
+  for (entry = cache->head; entry; entry = entry->next) {
+    entry->face = rb_gc_location(entry->face);
+    entry->glyph = rb_gc_location(entry->glyph);
+  }
+}
+
+static const rb_data_type_t glyph_cache_type = {
+  "FT2::GlyphCache",
+  { glyph_cache_mark, glyph_cache_free, glyph_cache_memsize, glyph_cache_compact, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
+
+static VALUE ft_glyph_cache_alloc(VALUE klass) {
+  GlyphCache *cache;
+  VALUE self;
+
+  self = TypedData_Make_Struct(klass, GlyphCache, &glyph_cache_type, cache);
+  cache->table = st_init_table(&glyph_cache_hash_type);
+  cache->max_bytes = 4 << 20;
+
+  return self;
+}
+
+/*
+ * Constructor for FT2::GlyphCache.
+ *
+ * Description:
+ *   Creates a cache of rendered glyphs holding at most `max_bytes'
+ *   bytes of bitmaps (default: 4 MB), evicting the least recently used
+ *   glyphs beyond that.  Each cached glyph also counts the size of its
+ *   bookkeeping.
+ *
+ * Examples:
+ *   cache = FT2::GlyphCache.new
+ *   cache = FT2::GlyphCache.new max_bytes: 16 << 20
+ *
+ */
+static VALUE ft_glyph_cache_init(int argc, VALUE *argv, VALUE self) {
+  VALUE opts, max_bytes = Qundef;
+  GlyphCache *cache;
+  ID kw_max_bytes;
+
+  rb_scan_args(argc, argv, ":", &opts);
+  if (opts != Qnil) {
+    kw_max_bytes = rb_intern("max_bytes");
+    rb_get_kwargs(opts, &kw_max_bytes, 0, 1, &max_bytes);
+  }
+
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  if (max_bytes != Qundef && max_bytes != Qnil)
+    cache->max_bytes = NUM2SIZET(max_bytes);
+
+  return self;
+}
+
+/* fill in the parts of `key' which depend on the state of the face */
+static void glyph_cache_key_face(GlyphCacheKey *key, Face *face) {
+  FT_Size_Metrics *metrics = &face_size(face)->metrics;
+  FT_Matrix matrix;
+  FT_Vector delta;
+
+  FT_Get_Transform(face->face, &matrix, &delta);
+  key->face = face->face;
+  key->x_ppem = metrics->x_ppem;
+  key->y_ppem = metrics->y_ppem;
+  key->x_scale = metrics->x_scale;
+  key->y_scale = metrics->y_scale;
+  key->xx = matrix.xx;
+  key->xy = matrix.xy;
+  key->yx = matrix.yx;
+  key->yy = matrix.yy;
+  key->dx = delta.x;
+  key->dy = delta.y;
+}
+
+typedef struct {
+  Face           *face;
+  GlyphCacheKey   key;      /* as rendered */
+  FT_Bitmap       bitmap;   /* with a copy of the buffer */
+  FT_Int          left,
+                  top;
+  FT_Vector       advance;
+  FT_Error        err;
+} GlyphCacheRender;
+
+static void *glyph_cache_render_nogvl(void *ptr) {
+  GlyphCacheRender *render = (GlyphCacheRender *) ptr;
+  FT_GlyphSlot slot = render->face->face->glyph;
+  size_t size;
+
+  /* the key is taken again here, with the face lock held */
+  if ((render->err = face_activate(render->face)) != FT_Err_Ok)
+    return NULL;
+  glyph_cache_key_face(&render->key, render->face);
+
+  render->err = FT_Load_Glyph(render->face->face, render->key.glyph_index,
+                              (FT_Int32) render->key.load_flags);
+  if (render->err == FT_Err_Ok && slot->format != FT_GLYPH_FORMAT_BITMAP)
+    render->err = FT_Render_Glyph(slot, (FT_Render_Mode) render->key.render_mode);
+  if (render->err != FT_Err_Ok)
+    return NULL;
+
+  render->bitmap = slot->bitmap;
+  render->left = slot->bitmap_left;
+  render->top = slot->bitmap_top;
+  render->advance = slot->advance;
+
+  size = (size_t) abs(slot->bitmap.pitch) * slot->bitmap.rows;
+  render->bitmap.buffer = size ? malloc(size) : NULL;
+  if (size && !render->bitmap.buffer)
+    render->err = FT_Err_Out_Of_Memory;
+  else if (size)
+    memcpy(render->bitmap.buffer, slot->bitmap.buffer, size);
+
+  return NULL;
+}
+
+/*
+ * Render a glyph of a FT2::Face through a FT2::GlyphCache.
+ *
+ * Description:
+ *   Returns a frozen FT2::GlyphCache::Glyph (width, rows, pitch, left,
+ *   top, x_advance, y_advance, pixel_mode, num_grays, buffer) of glyph
+ *   `glyph_index', loaded with the FT2::Load flags `load_flags' and
+ *   rendered with the FT2::RenderMode `render_mode'.  Glyphs are cached
+ *   by face, size, glyph index, flags, render mode and transform, so
+ *   asking for the same glyph again returns the same object, without
+ *   loading, rendering or copying anything.  Advances are in 26.6
+ *   pixels; the buffer is a frozen String.
+ *
+ *   Faces sharing a font (see FT2::FaceCache and FT2::Face#share) share
+ *   its cached glyphs too.
+ *
+ * Note:
+ *   Cached glyphs keep their face alive until they are evicted.
+ *
+ * Examples:
+ *   g = cache.render face, 36
+ *   g = cache.render face, 36, FT2::Load::NO_HINTING, FT2::RenderMode::MONO
+ *
+ */
+static VALUE ft_glyph_cache_render(int argc, VALUE *argv, VALUE self) {
+  VALUE face_obj, glyph_index, load_flags, render_mode, glyph;
+  GlyphCacheEntry *entry;
+  GlyphCacheRender render;
+  GlyphCache *cache;
+  size_t size;
+  st_data_t found;
+
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  rb_scan_args(argc, argv, "22", &face_obj, &glyph_index, &load_flags, &render_mode);
+
+  memset(&render, 0, sizeof(render));
+  TypedData_Get_Struct(face_obj, Face, &face_type, render.face);
+  render.key.glyph_index = NUM2UINT(glyph_index);
+  render.key.load_flags = (load_flags == Qnil) ? FT_LOAD_DEFAULT : NUM2INT(load_flags);
+  render.key.render_mode = (render_mode == Qnil) ? FT_RENDER_MODE_NORMAL : NUM2INT(render_mode);
+  glyph_cache_key_face(&render.key, render.face);
+
+  if (st_lookup(cache->table, (st_data_t) &render.key, &found)) {
+    entry = (GlyphCacheEntry *) found;
+    cache->hits++;
+    glyph_cache_unlink(cache, entry);
+    glyph_cache_push(cache, entry);
+    return entry->glyph;
+  }
+
+  cache->misses++;
+  face_call(render.face->face, glyph_cache_render_nogvl, &render);
+  if (render.err != FT_Err_Ok)
+    handle_error(render.err);
+
+  size = (size_t) abs(render.bitmap.pitch) * render.bitmap.rows;
+  glyph = rb_struct_new(sGlyphCacheGlyph,
+                        UINT2NUM(render.bitmap.width),
+                        UINT2NUM(render.bitmap.rows),
+                        INT2NUM(render.bitmap.pitch),
+                        INT2NUM(render.left),
+                        INT2NUM(render.top),
+                        LONG2NUM(render.advance.x),
+                        LONG2NUM(render.advance.y),
+                        INT2FIX(render.bitmap.pixel_mode),
+                        INT2FIX(render.bitmap.num_grays),
+                        rb_obj_freeze(rb_str_new((const char *) render.bitmap.buffer, size)));
+  free(render.bitmap.buffer);
+  rb_obj_freeze(glyph);
+
+  /* another thread may have cached it (or the face changed) meanwhile */
+  if (st_lookup(cache->table, (st_data_t) &render.key, &found))
+    return glyph;
+
+  entry = ALLOC(GlyphCacheEntry);
+  memcpy(&entry->key, &render.key, sizeof(GlyphCacheKey));
+  entry->face = entry->glyph = Qnil;
+  entry->bytes = size + sizeof(GlyphCacheEntry);
+  RB_OBJ_WRITE(self, &entry->face, face_obj);
+  RB_OBJ_WRITE(self, &entry->glyph, glyph);
+  glyph_cache_push(cache, entry);
+  st_insert(cache->table, (st_data_t) &entry->key, (st_data_t) entry);
+  cache->bytes += entry->bytes;
+
+  /* a glyph larger than the budget is returned, but not kept */
+  glyph_cache_evict(cache, cache->max_bytes);
+
+  return glyph;
+}
+
+/*
+ * Return the number of FT2::GlyphCache#render calls served from the cache.
+ *
+ * Examples:
+ *   hits = cache.hits
+ *
+ */
+static VALUE ft_glyph_cache_hits(VALUE self) {
+  GlyphCache *cache;
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  return ULONG2NUM(cache->hits);
+}
+
+/*
+ * Return the number of FT2::GlyphCache#render calls which had to render the glyph.
+ *
+ * Examples:
+ *   misses = cache.misses
+ *
+ */
+static VALUE ft_glyph_cache_misses(VALUE self) {
+  GlyphCache *cache;
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  return ULONG2NUM(cache->misses);
+}
+
+/*
+ * Return the number of glyphs evicted from a FT2::GlyphCache to stay within its budget.
+ *
+ * Examples:
+ *   evictions = cache.evictions
+ *
+ */
+static VALUE ft_glyph_cache_evictions(VALUE self) {
+  GlyphCache *cache;
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  return ULONG2NUM(cache->evictions);
+}
+
+/*
+ * Return the number of bytes held by a FT2::GlyphCache.
+ *
+ * Examples:
+ *   bytes = cache.bytes
+ *
+ */
+static VALUE ft_glyph_cache_bytes(VALUE self) {
+  GlyphCache *cache;
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  return SIZET2NUM(cache->bytes);
+}
+
+/*
+ * Return the byte budget of a FT2::GlyphCache.
+ *
+ * Examples:
+ *   max = cache.max_bytes
+ *
+ */
+static VALUE ft_glyph_cache_max_bytes(VALUE self) {
+  GlyphCache *cache;
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  return SIZET2NUM(cache->max_bytes);
+}
+
+/*
+ * Return the number of glyphs held by a FT2::GlyphCache.
+ *
+ * Aliases:
+ *   FT2::GlyphCache#length
+ *
+ * Examples:
+ *   num_glyphs = cache.size
+ *
+ */
+static VALUE ft_glyph_cache_size(VALUE self) {
+  GlyphCache *cache;
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  return SIZET2NUM(cache->table->num_entries);
+}
+
+/*
+ * Drop every glyph held by a FT2::GlyphCache and reset its counters.
+ *
+ * Examples:
+ *   cache.clear
+ *
+ */
+static VALUE ft_glyph_cache_clear(VALUE self) {
+  GlyphCache *cache;
+  TypedData_Get_Struct(self, GlyphCache, &glyph_cache_type, cache);
+  glyph_cache_evict(cache, 0);
+  cache->hits = cache->misses = cache->evictions = 0;
+  return self;
+}
+
+/**************************/
+/* FT2::FontStack methods */
+/**************************/
+
+#define FONT_STACK_PAGES  0x1100    /* of 256 code points, to U+10FFFF */
+#define FONT_STACK_NONE   0xFFFF    /* no face covers the code point */
+
+/*
+ * The faces of a stack, and which one each code point resolved to: the
+ * face index plus one, FONT_STACK_NONE, or 0 if not resolved yet, in
+ * pages allocated as they are first used.  Only used with the GVL held.
+ */
+typedef struct {
+  VALUE             faces;      /* frozen Array of FT2::Face */
+  long              num_faces;
+  FT_Face          *ft_faces;
+  const FaceData  **data;       /* for face_char_index */
+  uint16_t         *pages[FONT_STACK_PAGES];
+  size_t            num_pages;
+} FontStack;
+
+static VALUE sFontStackRun;
+
+static void font_stack_mark(void *ptr) {
+  rb_gc_mark_movable(((FontStack *) ptr)->faces);
+}
+
+static void font_stack_free(void *ptr) {
+  FontStack *stack = (FontStack *) ptr;
+  long i;
+
+  for (i = 0; i < FONT_STACK_PAGES; i++)
+    xfree(stack->pages[i]);
+  xfree(stack->ft_faces);
+  xfree(stack->data);
+  xfree(ptr);
+}
+
+static size_t font_stack_memsize(const void *ptr) {
+  const FontStack *stack = (const FontStack *) ptr;
+  return sizeof(FontStack) + stack->num_pages * 256 * sizeof(uint16_t) +
+         stack->num_faces * (sizeof(FT_Face) + sizeof(FaceData *));
+}
+
+static void font_stack_compact(void *ptr) {
+  FontStack *stack = (FontStack *) ptr;
+  stack->faces = rb_gc_location(stack->faces);
+}
+
+static const rb_data_type_t font_stack_type = {
+  "FT2::FontStack",
+  { font_stack_mark, font_stack_free, font_stack_memsize, font_stack_compact, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
+
+static VALUE ft_font_stack_alloc(VALUE klass) {
+  FontStack *stack;
+  VALUE self;
+
+  self = TypedData_Make_Struct(klass, FontStack, &font_stack_type, stack);
+  stack->faces = Qnil;
+
+  return self;
+}
+
+static FontStack *font_stack_get(VALUE self) {
+  FontStack *stack;
+
+  TypedData_Get_Struct(self, FontStack, &font_stack_type, stack);
+  if (!stack->num_faces)
+    rb_raise(eFt2Error, "FT2::FontStack not initialized.");
+
+  return stack;
+}
+
+/*
+ * Constructor for FT2::FontStack.
+ *
+ * Description:
+ *   Creates a font fallback stack from an ordered array of FT2::Face
+ *   objects: each character goes to the first face with a glyph for
+ *   it, as FT2::Face#char_index maps its Unicode code point.
+ *
+ * Note:
+ *   Which face a code point goes to is worked out once, and kept in a
+ *   flat table, so the faces' selected charmaps should not be changed
+ *   afterwards.  The faces' own Unicode tables (see
+ *   FT2::Face#char_index) are built here.
+ *
+ * Examples:
+ *   stack = FT2::FontStack.new [latin_face, cjk_face, emoji_face]
+ *
+ */
+static VALUE ft_font_stack_init(VALUE self, VALUE faces) {
+  FontStack *stack;
+  FT_Face *face;
+  long i, num_faces;
+
+  TypedData_Get_Struct(self, FontStack, &font_stack_type, stack);
+  if (stack->num_faces)
+    rb_raise(eFt2Error, "FT2::FontStack already initialized.");
+
+  faces = rb_ary_freeze(rb_ary_dup(rb_Array(faces)));
+  num_faces = RARRAY_LEN(faces);
+  if (num_faces < 1 || num_faces >= FONT_STACK_NONE)
+    rb_raise(rb_eArgError, "Invalid face count: %ld.", num_faces);
+
+  stack->ft_faces = ALLOC_N(FT_Face, num_faces);
+  stack->data = ALLOC_N(const FaceData *, num_faces);
+  for (i = 0; i < num_faces; i++) {
+    TypedData_Get_Struct(RARRAY_AREF(faces, i), FT_Face, &face_type, face);
+    stack->ft_faces[i] = *face;
+    stack->data[i] = face_cmap(*face);
+  }
+
+  RB_OBJ_WRITE(self, &stack->faces, faces);
+  stack->num_faces = num_faces;
+
+  return self;
+}
+
+/* the index of the face `code' resolves to, or -1 if none covers it */
+static long font_stack_resolve(FontStack *stack, FT_ULong code) {
+  uint16_t *page = NULL;
+  long i;
+
+  if (code < FONT_STACK_PAGES * 256) {
+    page = stack->pages[code >> 8];
+    if (page && page[code & 0xFF])
+      return page[code & 0xFF] == FONT_STACK_NONE ? -1 : page[code & 0xFF] - 1;
+  }
+
+  for (i = 0; i < stack->num_faces; i++)
+    if (face_char_index(stack->ft_faces[i], stack->data[i], code))
+      break;
+  if (i == stack->num_faces)
+    i = -1;
+
+  if (code < FONT_STACK_PAGES * 256) {
+    if (!page) {
+      page = stack->pages[code >> 8] = ZALLOC_N(uint16_t, 256);
+      stack->num_pages++;
+    }
+    page[code & 0xFF] = i < 0 ? FONT_STACK_NONE : (uint16_t) (i + 1);
+  }
+
+  return i;
+}
+
+/*
+ * Return the faces of a FT2::FontStack, in order.
+ *
+ * Examples:
+ *   faces = stack.faces
+ *
+ */
+static VALUE ft_font_stack_faces(VALUE self) {
+  return font_stack_get(self)->faces;
+}
+
+/*
+ * Return the face of a FT2::FontStack used for a character.
+ *
+ * Description:
+ *   Return the first face of the stack with a glyph for `char' (a
+ *   string, whose first character is used, or a Unicode code point),
+ *   or nil if none has one.
+ *
+ * Examples:
+ *   face = stack.face_for '漢'
+ *   face = stack.face_for 0x1F600
+ *
+ */
+static VALUE ft_font_stack_face_for(VALUE self, VALUE chr) {
+  FontStack *stack = font_stack_get(self);
+  FT_ULong code;
+  long i;
+  int n;
+
+  if (RB_TYPE_P(chr, T_STRING)) {
+    chr = str_unicode(chr);
+    if (!RSTRING_LEN(chr))
+      rb_raise(rb_eArgError, "Empty string.");
+    code = str_codepoint(RSTRING_PTR(chr), RSTRING_END(chr), &n);
+  } else {
+    code = NUM2ULONG(chr);
+  }
+
+  i = font_stack_resolve(stack, code);
+  return i < 0 ? Qnil : RARRAY_AREF(stack->faces, i);
+}
+
+/*
+ * Split a string into runs of characters sharing a face of a FT2::FontStack.
+ *
+ * Description:
+ *   Split `str' into runs of consecutive characters which go to the
+ *   same face (see FT2::FontStack#face_for).  Returns an array of
+ *   FT2::FontStack::Run structs, with members:
+ *
+ *   face: The face, or nil for characters no face covers.
+ *   start: The position of the run's first character in `str'.
+ *   length: The number of characters in the run.
+ *   text: The run, as a UTF-8 string.
+ *
+ *   Strings in encodings other than UTF-8 and US-ASCII are converted to
+ *   UTF-8 first.
+ *
+ * Examples:
+ *   stack.runs('Tokyo 東京 😀').each do |run|
+ *     ids = run.face.glyph_indices run.text if run.face
+ *   end
+ *
+ */
+static VALUE ft_font_stack_runs(VALUE self, VALUE str) {
+  FontStack *stack = font_stack_get(self);
+  const char *p, *end, *run_p = NULL;
+  long i, run_face = -2, run_start = 0, pos;
+  rb_encoding *enc;
+  VALUE rtn;
+  int n;
+
+  str = str_unicode(str);
+  enc = rb_enc_get(str);
+  rtn = rb_ary_new();
+
+  p = RSTRING_PTR(str);
+  end = RSTRING_END(str);
+  for (pos = 0; p <= end; pos++, p += n) {
+    if (p < end) {
+      i = font_stack_resolve(stack, str_codepoint(p, end, &n));
+      if (i == run_face)
+        continue;
+    } else {
+      i = -2;
+      n = 1;
+    }
+
+    if (run_face != -2)
+      rb_ary_push(rtn, rb_struct_new(sFontStackRun,
+                                     run_face < 0 ? Qnil : RARRAY_AREF(stack->faces, run_face),
+                                     LONG2NUM(run_start),
+                                     LONG2NUM(pos - run_start),
+                                     rb_enc_str_new(run_p, p - run_p, enc)));
+    run_face = i;
+    run_start = pos;
+    run_p = p;
+  }
+  RB_GC_GUARD(str);
+
+  return rtn;
+}
+
+/************************/
+/* FT2::Catalog methods */
+/************************/
+
+/*
+ * One face of a cataloged font file.  Files FreeType can't open are
+ * kept as a single entry with a negative face index, so they aren't
+ * parsed again on every scan.
+ */
+typedef struct {
+  char    *path;
+  long     face_index;
+  int64_t  mtime,
+           size;
+  char    *name,
+          *family,
+          *style;
+  long     face_flags,
+           style_flags,
+           num_glyphs,
+           units_per_em;
+} CatalogEntry;
+
+typedef struct {
+  char         *path;       /* index file, or NULL */
+  CatalogEntry *entries;
+  long          num_entries,
+                capa,
+                parsed;     /* font files parsed by the last scan */
+  int           scanning;   /* a FT2::Catalog#scan is running */
+} Catalog;
+
+#define CATALOG_MAGIC   "FT2C"
+#define CATALOG_VERSION 1
+#define CATALOG_NO_STR  0xffffffffU
+
+static VALUE sCatalogEntry;
+
+static char *catalog_strdup(const char *str) {
+  return str ? strdup(str) : NULL;
+}
+
+static void catalog_entry_clear(CatalogEntry *entry) {
+  free(entry->path);
+  free(entry->name);
+  free(entry->family);
+  free(entry->style);
+  memset(entry, 0, sizeof(CatalogEntry));
+}
+
+static void catalog_clear(Catalog *cat) {
+  long i;
+
+  for (i = 0; i < cat->num_entries; i++)
+    catalog_entry_clear(&cat->entries[i]);
+  free(cat->entries);
+  cat->entries = NULL;
+  cat->num_entries = cat->capa = 0;
+}
+
+/* make room for `capa' entries; returns zero if out of memory */
+static int catalog_reserve(Catalog *cat, long capa) {
+  CatalogEntry *entries;
+
+  if (capa <= cat->capa)
+    return 1;
+  if ((entries = realloc(cat->entries, capa * sizeof(CatalogEntry))) == NULL)
+    return 0;
+  cat->entries = entries;
+  cat->capa = capa;
+  return 1;
+}
+
+/* returns NULL if out of memory */
+static CatalogEntry *catalog_push(Catalog *cat) {
+  CatalogEntry *entry, *entries;
+  long capa;
+
+  if (cat->num_entries == cat->capa) {
+    capa = cat->capa ? cat->capa * 2 : 64;
+    if ((entries = realloc(cat->entries, capa * sizeof(CatalogEntry))) == NULL)
+      return NULL;
+    cat->entries = entries;
+    cat->capa = capa;
+  }
+
+  entry = &cat->entries[cat->num_entries++];
+  memset(entry, 0, sizeof(CatalogEntry));
+  return entry;
+}
+
+static void catalog_free(void *ptr) {
+  Catalog *cat = (Catalog *) ptr;
+  catalog_clear(cat);
+  free(cat->path);
+  xfree(cat);
+}
+
+static size_t catalog_strsize(const char *str) {
+  return str ? strlen(str) + 1 : 0;
+}
+
+static size_t catalog_memsize(const void *ptr) {
+  const Catalog *cat = (const Catalog *) ptr;
+  const CatalogEntry *entry;
+  size_t size;
+  long i;
+
+  size = sizeof(Catalog) + cat->capa * sizeof(CatalogEntry) +
+         catalog_strsize(cat->path);
+  for (i = 0; i < cat->num_entries; i++) {
+    entry = &cat->entries[i];
+    size += catalog_strsize(entry->path) + catalog_strsize(entry->name) +
+            catalog_strsize(entry->family) + catalog_strsize(entry->style);
+  }
+
+  return size;
+}
+
+static const rb_data_type_t catalog_type = {
+  "FT2::Catalog",
+  { 0, catalog_free, catalog_memsize, },
+  0, 0,
+  RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
+
+/* fill everything but the path, mtime and size from an open face */
+static void catalog_entry_fill(CatalogEntry *entry, FT_Face face) {
+  entry->face_index = face->face_index;
+  entry->name = catalog_strdup(FT_Get_Postscript_Name(face));
+  entry->family = catalog_strdup(face->family_name);
+  entry->style = catalog_strdup(face->style_name);
+  entry->face_flags = face->face_flags;
+  entry->style_flags = face->style_flags;
+  entry->num_glyphs = face->num_glyphs;
+  entry->units_per_em = face->units_per_EM;
+}
+
+/*
+ * Parse every face of font file `path' into catalog entries.  Returns
+ * the number of entries added, or -1 if out of memory.  Doesn't touch
+ * any Ruby state, so it may run without the GVL.
+ */
+static long catalog_parse_file(Catalog *cat, FT_Library lib, const char *path, const struct stat *st) {
+  CatalogEntry *entry;
+  FT_Face face;
+  FT_Long i, num_faces = 1;
+
+  for (i = 0; i < num_faces; i++) {
+    if (FT_New_Face(lib, path, i, &face) != FT_Err_Ok) {
+      if (i > 0)
+        continue;
+      /* remember unreadable files so they aren't parsed again */
+      if ((entry = catalog_push(cat)) == NULL)
+        return -1;
+      entry->face_index = -1;
+    } else {
+      num_faces = face->num_faces;
+      if ((entry = catalog_push(cat)) == NULL) {
+        FT_Done_Face(face);
+        return -1;
+      }
+      catalog_entry_fill(entry, face);
+      FT_Done_Face(face);
+    }
+
+    if ((entry->path = strdup(path)) == NULL) {
+      cat->num_entries--;
+      catalog_entry_clear(entry);
+      return -1;
+    }
+    entry->mtime = st->st_mtime;
+    entry->size = st->st_size;
+  }
+
+  return i;
+}
+
+/* return nonzero to stop the walk */
+typedef int (*font_dir_cb)(void *data, const char *path, const struct stat *st);
+
+/*
+ * Recursively walk `dir', calling `cb' for each regular file.  Dot
+ * files are skipped.  Returns -1 if out of memory, or the nonzero value
+ * `cb' stopped the walk with.  Doesn't touch any Ruby state, so it may
+ * run without the GVL.
+ */
+static int walk_font_dir(const char *dir, font_dir_cb cb, void *data) {
+  struct dirent *ent;
+  struct stat st;
+  size_t dir_len;
+  char *path;
+  DIR *dh;
+  int rtn = 0;
+
+  if ((dh = opendir(dir)) == NULL)
+    return 0;
+
+  dir_len = strlen(dir);
+  while (rtn == 0 && (ent = readdir(dh)) != NULL) {
+    if (ent->d_name[0] == '.')
+      continue;
+
+    if ((path = malloc(dir_len + strlen(ent->d_name) + 2)) == NULL) {
+      rtn = -1;
+      break;
+    }
+    sprintf(path, "%s/%s", dir, ent->d_name);
+
+    /* don't follow symlinked directories, they may loop */
+    if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+      rtn = walk_font_dir(path, cb, data);
+    else if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+      rtn = cb(data, path, &st);
+
+    free(path);
+  }
+
+  closedir(dh);
+  return rtn;
+}
+
+/*
+ * Font directory scans, shared by FT2::Catalog#scan and FT2.scan.  The
+ * directories are walked into a list of files first, then the files
+ * are parsed on a pool of native threads, each with its own FreeType
+ * library; both run without the GVL.
+ */
+typedef struct {
+  char         *path;
+  struct stat   st;
+  long          old_index;  /* first entry in an old catalog to keep, or -1 to parse */
+  CatalogEntry *entries;    /* filled in by a worker */
+  long          num_entries;
+} ScanFile;
+
+typedef struct {
+  char           **dirs;
+  long             num_dirs;
+  ScanFile        *files;
+  long             num_files,
+                   capa,
+                   next;      /* next file to claim */
+  long             next_dir;  /* next directory to walk */
+  int              num_threads;
+  volatile int     canceled,
+                   nomem;     /* a worker ran out of memory */
+  pthread_mutex_t  lock;
+} ScanJob;
+
+static int scan_collect_file(void *data, const char *path, const struct stat *st) {
+  ScanJob *job = (ScanJob *) data;
+  ScanFile *file, *files;
+  long capa;
+
+  if (job->num_files == job->capa) {
+    capa = job->capa ? job->capa * 2 : 256;
+    if ((files = realloc(job->files, capa * sizeof(ScanFile))) == NULL)
+      return -1;
+    job->files = files;
+    job->capa = capa;
+  }
+
+  file = &job->files[job->num_files];
+  if ((file->path = strdup(path)) == NULL)
+    return -1;
+  file->st = *st;
+  file->old_index = -1;
+  file->entries = NULL;
+  file->num_entries = 0;
+  job->num_files++;
+
+  return 0;
+}
+
+static void *scan_worker(void *arg) {
+  ScanJob *job = (ScanJob *) arg;
+  FT_Library lib;
+  Catalog cat;
+  long i;
+
+  /* FT_Library objects can't be shared between threads */
+  if (FT_Init_FreeType(&lib) != FT_Err_Ok) {
+    job->nomem = 1;
+    return NULL;
+  }
+
+  while (!job->canceled && !job->nomem) {
+    pthread_mutex_lock(&job->lock);
+    i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->num_files)
+      break;
+    if (job->files[i].old_index >= 0)
+      continue;
+
+    memset(&cat, 0, sizeof(cat));
+    if (catalog_parse_file(&cat, lib, job->files[i].path, &job->files[i].st) < 0)
+      job->nomem = 1;
+    job->files[i].entries = cat.entries;
+    job->files[i].num_entries = cat.num_entries;
+  }
+
+  FT_Done_FreeType(lib);
+  return NULL;
+}
+
+/*
+ * Walk the directories into the file list.  Stops early if canceled,
+ * and picks up where it stopped when called again: a directory is
+ * walked in full, so a canceled walk resumes at the next one.
+ */
+static void *scan_walk(void *arg) {
+  ScanJob *job = (ScanJob *) arg;
+
+  for (; job->next_dir < job->num_dirs && !job->canceled; job->next_dir++) {
+    if (walk_font_dir(job->dirs[job->next_dir], scan_collect_file, job) != 0) {
+      job->nomem = 1;
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Parse the files of the list on a pool of threads.  Stops early if
+ * canceled, and picks up where it stopped when called again.
+ */
+static void *scan_parse(void *arg) {
+  ScanJob *job = (ScanJob *) arg;
+  pthread_t *threads;
+  int i, num_started = 0;
+
+  if (job->num_threads > job->num_files)
+    job->num_threads = job->num_files ? (int) job->num_files : 1;
+
+  if (job->num_threads == 1) {
+    scan_worker(job);
+    return NULL;
+  }
+
+  if ((threads = malloc(job->num_threads * sizeof(pthread_t))) == NULL) {
+    job->nomem = 1;
+    return NULL;
+  }
+  for (i = 0; i < job->num_threads; i++)
+    if (pthread_create(&threads[num_started], NULL, scan_worker, job) == 0)
+      num_started++;
+
+  /* if no thread could be started, do the work on this one */
+  if (!num_started)
+    scan_worker(job);
+
+  for (i = 0; i < num_started; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+
+  return NULL;
+}
+
+static void scan_cancel(void *arg) {
+  ((ScanJob *) arg)->canceled = 1;
+}
+
+static void scan_job_free(ScanJob *job) {
+  Catalog cat;
+  long i;
+
+  for (i = 0; i < job->num_files; i++) {
+    cat.entries = job->files[i].entries;
+    cat.num_entries = job->files[i].num_entries;
+    catalog_clear(&cat);
+    free(job->files[i].path);
+  }
+  free(job->files);
+
+  for (i = 0; i < job->num_dirs; i++)
+    free(job->dirs[i]);
+  free(job->dirs);
+
+  pthread_mutex_destroy(&job->lock);
+}
+
+/* `dirs' must already be path strings, see FilePathValue */
+static void scan_job_init(ScanJob *job, long num_dirs, const VALUE *dirs, int num_threads) {
+  memset(job, 0, sizeof(ScanJob));
+  job->num_threads = num_threads;
+  pthread_mutex_init(&job->lock, NULL);
+
+  if ((job->dirs = calloc(num_dirs + 1, sizeof(char *))) == NULL) {
+    scan_job_free(job);
+    rb_memerror();
+  }
+  for (job->num_dirs = 0; job->num_dirs < num_dirs; job->num_dirs++) {
+    if ((job->dirs[job->num_dirs] = strdup(RSTRING_PTR(dirs[job->num_dirs]))) == NULL) {
+      scan_job_free(job);
+      rb_memerror();
+    }
+  }
+}
+
+/*
+ * Run `func' (scan_walk or scan_parse) without the GVL.  Interrupts
+ * cancel it; if they don't raise (a trap handler returning,
+ * Thread#wakeup), it is resumed.  Raises if a worker ran out of memory.
+ */
+static void scan_job_call(ScanJob *job, void *(*func)(void *)) {
+  for (;;) {
+    rb_thread_call_without_gvl(func, job, scan_cancel, job);
+    if (job->nomem)
+      rb_memerror();
+    if (!job->canceled)
+      return;
+    /* raises if the interrupt was an exception (Thread#raise, Timeout, etc) */
+    rb_thread_check_ints();
+    job->canceled = 0;
+  }
+}
+
+static int catalog_write_str(FILE *fh, const char *str) {
+  uint32_t len = str ? (uint32_t) strlen(str) : CATALOG_NO_STR;
+
+  if (fwrite(&len, sizeof(len), 1, fh) != 1)
+    return 0;
+  return !str || fwrite(str, 1, len, fh) == len;
+}
+
+/* `max' bounds the length, so a corrupt index can't ask for 4GB */
+static int catalog_read_str(FILE *fh, char **str, int64_t max) {
+  uint32_t len;
+
+  *str = NULL;
+  if (fread(&len, sizeof(len), 1, fh) != 1)
+    return 0;
+  if (len == CATALOG_NO_STR)
+    return 1;
+  if (len > max || (*str = malloc(len + 1)) == NULL)
+    return 0;
+
+  (*str)[len] = '\0';
+  return fread(*str, 1, len, fh) == len;
+}
+
+/*
+ * On-disk index layout (native byte order; an index written on a host
+ * with a different layout fails the header check and is rebuilt):
+ *
+ *   "FT2C" u32:version u32:sizeof(CatalogEntry) i64:count
+ *   count * { str:path i64:face_index i64:mtime i64:size
+ *             i64:face_flags i64:style_flags i64:num_glyphs
+ *             i64:units_per_em str:name str:family str:style }
+ *
+ * where str is u32:length (0xffffffff for nil) followed by the bytes.
+ */
+static int catalog_write(Catalog *cat, FILE *fh) {
+  uint32_t hdr[2] = { CATALOG_VERSION, sizeof(CatalogEntry) };
+  int64_t num[7], count = cat->num_entries;
+  CatalogEntry *entry;
+  long i;
+
+  if (fwrite(CATALOG_MAGIC, 1, 4, fh) != 4 ||
+      fwrite(hdr, sizeof(hdr), 1, fh) != 1 ||
+      fwrite(&count, sizeof(count), 1, fh) != 1)
+    return 0;
+
+  for (i = 0; i < cat->num_entries; i++) {
+    entry = &cat->entries[i];
+    num[0] = entry->face_index;
+    num[1] = entry->mtime;
+    num[2] = entry->size;
+    num[3] = entry->face_flags;
+    num[4] = entry->style_flags;
+    num[5] = entry->num_glyphs;
+    num[6] = entry->units_per_em;
+
+    if (!catalog_write_str(fh, entry->path) ||
+        fwrite(num, sizeof(num), 1, fh) != 1 ||
+        !catalog_write_str(fh, entry->name) ||
+        !catalog_write_str(fh, entry->family) ||
+        !catalog_write_str(fh, entry->style))
+      return 0;
+  }
+
+  return 1;
+}
+
+/* `size' is the size of the index file, which bounds every count and length */
+static int catalog_read(Catalog *cat, FILE *fh, int64_t size) {
+  uint32_t hdr[2];
+  int64_t num[7], count, i;
+  CatalogEntry *entry;
+  char magic[4];
+
+  if (fread(magic, 1, 4, fh) != 4 || memcmp(magic, CATALOG_MAGIC, 4) ||
+      fread(hdr, sizeof(hdr), 1, fh) != 1 ||
+      hdr[0] != CATALOG_VERSION || hdr[1] != sizeof(CatalogEntry) ||
+      fread(&count, sizeof(count), 1, fh) != 1 || count < 0 ||
+      count > size / (int64_t) (4 * sizeof(uint32_t) + sizeof(num)))
+    return 0;
+
+  for (i = 0; i < count; i++) {
+    if ((entry = catalog_push(cat)) == NULL ||
+        !catalog_read_str(fh, &entry->path, size) || !entry->path ||
+        fread(num, sizeof(num), 1, fh) != 1 ||
+        !catalog_read_str(fh, &entry->name, size) ||
+        !catalog_read_str(fh, &entry->family, size) ||
+        !catalog_read_str(fh, &entry->style, size))
+      return 0;
+
+    entry->face_index = num[0];
+    entry->mtime = num[1];
+    entry->size = num[2];
+    entry->face_flags = num[3];
+    entry->style_flags = num[4];
+    entry->num_glyphs = num[5];
+    entry->units_per_em = num[6];
+  }
+
+  return 1;
+}
+
+static VALUE catalog_str_new(const char *str) {
+  return str ? rb_str_new2(str) : Qnil;
+}
+
+static VALUE catalog_entry_to_struct(CatalogEntry *entry) {
+  return rb_struct_new(sCatalogEntry,
+                       rb_str_new2(entry->path),
+                       LONG2NUM(entry->face_index),
+                       catalog_str_new(entry->name),
+                       catalog_str_new(entry->family),
+                       catalog_str_new(entry->style),
+                       LONG2NUM(entry->face_flags),
+                       LONG2NUM(entry->style_flags),
+                       LONG2NUM(entry->num_glyphs),
+                       LONG2NUM(entry->units_per_em),
+                       LL2NUM(entry->mtime),
+                       LL2NUM(entry->size));
+}
+
+static VALUE ft_catalog_alloc(VALUE klass) {
+  Catalog *cat;
+  return TypedData_Make_Struct(klass, Catalog, &catalog_type, cat);
+}
+
+/*
+ * Constructor for FT2::Catalog.
+ *
+ * Description:
+ *   Creates a font catalog, loading the index file at `path' if it
+ *   exists.  A missing, truncated or incompatible index file is
+ *   ignored; the next FT2::Catalog#scan rebuilds it from scratch.
+ *
+ * Examples:
+ *   catalog = FT2::Catalog.new '/var/cache/fonts.idx'
+ *   catalog = FT2::Catalog.new  # in-memory only
+ *
+ */
+static VALUE ft_catalog_init(int argc, VALUE *argv, VALUE self) {
+  Catalog *cat;
+  VALUE path;
+  struct stat st;
+  FILE *fh;
+
+  TypedData_Get_Struct(self, Catalog, &catalog_type, cat);
+  rb_scan_args(argc, argv, "01", &path);
+  if (path == Qnil)
+    return self;
+
+  FilePathValue(path);
+  if ((cat->path = strdup(RSTRING_PTR(path))) == NULL)
+    rb_memerror();
+
+  if ((fh = fopen(cat->path, "rb")) != NULL) {
+    if (fstat(fileno(fh), &st) != 0 || !catalog_read(cat, fh, st.st_size))
+      catalog_clear(cat);
+    fclose(fh);
+  }
+
+  return self;
+}
+
+typedef struct {
+  Catalog   *cat;
+  Catalog    fresh;      /* the new entries, swapped into cat on success */
+  st_table  *old_paths;  /* path => index of its first entry in cat */
+  ScanJob    job;
+} CatalogScan;
+
+/* the number of entries of `file', parsed or kept from the catalog */
+static long catalog_scan_count(CatalogScan *scan, ScanFile *file) {
+  Catalog *cat = scan->cat;
+  long i;
+
+  if (file->old_index < 0)
+    return file->num_entries;
+  for (i = file->old_index; i < cat->num_entries; i++)
+    if (strcmp(cat->entries[i].path, file->path))
+      break;
+  return i - file->old_index;
+}
+
+/*
+ * Move the entries of `file', parsed or kept from the catalog, to the
+ * new entries, which have room for them.
+ */
+static void catalog_scan_add(CatalogScan *scan, ScanFile *file) {
+  CatalogEntry *entry;
+  long i;
+
+  if (file->old_index < 0) {
+    for (i = 0; i < file->num_entries; i++) {
+      *catalog_push(&scan->fresh) = file->entries[i];
+      memset(&file->entries[i], 0, sizeof(CatalogEntry));
+    }
+    scan->fresh.parsed++;
+    return;
+  }
+
+  /* a path visited twice is moved on its first visit */
+  for (i = file->old_index; i < scan->cat->num_entries; i++) {
+    entry = &scan->cat->entries[i];
+    if (!entry->path || strcmp(entry->path, file->path))
+      break;
+    *catalog_push(&scan->fresh) = *entry;
+    memset(entry, 0, sizeof(CatalogEntry));
+  }
+}
+
+static VALUE catalog_scan_run(VALUE arg) {
+  CatalogScan *scan = (CatalogScan *) arg;
+  ScanJob *job = &scan->job;
+  Catalog *cat = scan->cat;
+  CatalogEntry *entry;
+  ScanFile *file;
+  st_data_t idx;
+  long i, count = 0;
+
+  scan_job_call(job, scan_walk);
+
+  /* files unchanged since they were last cataloged aren't parsed again */
+  for (i = 0; i < job->num_files; i++) {
+    file = &job->files[i];
+    if (st_lookup(scan->old_paths, (st_data_t) file->path, &idx)) {
+      entry = &cat->entries[idx];
+      if (entry->mtime == file->st.st_mtime && entry->size == file->st.st_size)
+        file->old_index = (long) idx;
+    }
+  }
+
+  scan_job_call(job, scan_parse);
+
+  /* nothing may fail once entries start leaving the catalog */
+  for (i = 0; i < job->num_files; i++)
+    count += catalog_scan_count(scan, &job->files[i]);
+  if (!catalog_reserve(&scan->fresh, count))
+    rb_memerror();
+
+  for (i = 0; i < job->num_files; i++)
+    catalog_scan_add(scan, &job->files[i]);
+
+  /* the entries which weren't kept go with the old array */
+  catalog_clear(cat);
+  cat->entries = scan->fresh.entries;
+  cat->num_entries = scan->fresh.num_entries;
+  cat->capa = scan->fresh.capa;
+  cat->parsed = scan->fresh.parsed;
+  memset(&scan->fresh, 0, sizeof(Catalog));
+
+  return Qnil;
+}
+
+/* if the scan raised, the catalog keeps its entries */
+static VALUE catalog_scan_cleanup(VALUE arg) {
+  CatalogScan *scan = (CatalogScan *) arg;
+
+  st_free_table(scan->old_paths);
+  catalog_clear(&scan->fresh);
+  scan_job_free(&scan->job);
+  scan->cat->scanning = 0;
+
+  return Qnil;
+}
+
+/*
+ * Scan font directories and update a FT2::Catalog.
+ *
+ * Description:
+ *   Walks each directory recursively (skipping dot files) and catalogs
+ *   every face of every font file found.  Files whose modification
+ *   time and size are unchanged since they were last cataloged are not
+ *   opened again.  Entries for files which no longer exist (or are
+ *   outside the scanned directories) are dropped.
+ *
+ *   Returns the number of font files which had to be parsed.
  *
  * Note:
- *   If the face doesn't provide glyph names or if the glyph index is
- *   invalid, nil is returned.  The glyph name is truncated if it is
- *   longer than 1024 characters.
+ *   The directories are walked and the font files parsed without the
+ *   GVL, so other Ruby threads keep running during a long scan.  The
+ *   catalog keeps its old entries until the scan completes, and keeps
+ *   them if it raises.  A catalog can only be scanned by one thread at
+ *   a time.
  *
  * Examples:
- *   glyph_index = 45
- *   glyph_name = face.glyph_name glyph_index
+ *   catalog.scan '/usr/share/fonts', '/opt/fonts'
+ *   catalog.save
  *
  */
-static VALUE ft_face_glyph_name(VALUE self, VALUE glyph_index) {
-  FT_Face *face;
-  FT_Error err;
-  char buf[1024];
-  Data_Get_Struct(self, FT_Face, face);
-  err = FT_Get_Glyph_Name(*face, NUM2INT(glyph_index), buf, sizeof(buf));
-  if (err != FT_Err_Ok)
-    handle_error(err);
+static VALUE ft_catalog_scan(int argc, VALUE *argv, VALUE self) {
+  CatalogScan scan;
+  Catalog *cat;
+  long i;
 
-  return (buf && strlen(buf)) ? rb_str_new2(buf) : Qnil;
+  TypedData_Get_Struct(self, Catalog, &catalog_type, cat);
+  if (cat->scanning)
+    rb_raise(eFt2Error, "FT2::Catalog is already being scanned.");
+
+  for (i = 0; i < argc; i++)
+    FilePathValue(argv[i]);
+
+  /*
+   * a single worker, with a private library, so scanning doesn't have
+   * to wait for (or hold up) other threads opening faces
+   */
+  scan_job_init(&scan.job, argc, argv, 1);
+
+  scan.cat = cat;
+  memset(&scan.fresh, 0, sizeof(Catalog));
+  scan.old_paths = st_init_strtable();
+  for (i = cat->num_entries - 1; i >= 0; i--)
+    st_insert(scan.old_paths, (st_data_t) cat->entries[i].path, (st_data_t) i);
+
+  cat->scanning = 1;
+
+  rb_ensure(catalog_scan_run, (VALUE) &scan, catalog_scan_cleanup, (VALUE) &scan);
+
+  return LONG2NUM(cat->parsed);
 }
 
 /*
- * Get the ASCII Postscript name of a FT2::Face object.
+ * Write a FT2::Catalog to its index file.
  *
- * Note:
- *   This should only work with Postscript and TrueType fonts. If the
- *   PostScript name is un-avaialble, nil is returned.
+ * Description:
+ *   Writes to `path', or to the path the catalog was created with.
+ *   The index is written to a temporary file which then replaces the
+ *   old index, so readers never see a partial index.
  *
  * Examples:
- *   ps_name = face.postscript_name
- *   name = face.name
+ *   catalog.save
+ *   catalog.save '/tmp/fonts.idx'
  *
  */
-static VALUE ft_face_ps_name(VALUE self) {
-  FT_Face *face;
-  const char *str;
-  Data_Get_Struct(self, FT_Face, face);
+static VALUE ft_catalog_save(int argc, VALUE *argv, VALUE self) {
+  Catalog *cat;
+  VALUE path, tmp;
+  FILE *fh;
+  int ok;
+
+  TypedData_Get_Struct(self, Catalog, &catalog_type, cat);
+  rb_scan_args(argc, argv, "01", &path);
+  if (path == Qnil) {
+    if (!cat->path)
+      rb_raise(rb_eArgError, "No index path given.");
+    path = rb_str_new2(cat->path);
+  }
+  FilePathValue(path);
+
+  tmp = rb_str_dup(path);
+  rb_str_cat2(tmp, ".tmp");
+
+  if ((fh = fopen(RSTRING_PTR(tmp), "wb")) == NULL)
+    rb_sys_fail(RSTRING_PTR(tmp));
+  ok = catalog_write(cat, fh);
+  if (fclose(fh) != 0)
+    ok = 0;
+  if (!ok || rename(RSTRING_PTR(tmp), RSTRING_PTR(path)) != 0) {
+    unlink(RSTRING_PTR(tmp));
+    rb_sys_fail(RSTRING_PTR(path));
+  }
 
-  if ((str = FT_Get_Postscript_Name(*face)) != NULL)
-    return rb_str_new2(str);
-  else
-    return Qnil;
+  return self;
 }
 
 /*
- * Select a FT2::Face object's charmap by its encoding tag.
+ * Iterate over the faces in a FT2::Catalog.
  *
- * Encoding Tags:
- *   FT2::Encoding::NONE
- *   FT2::Encoding::SYMBOL
- *   FT2::Encoding::UNICODE
- *   FT2::Encoding::LATIN_1
+ * Description:
+ *   Yields a FT2::Catalog::Entry for each cataloged face.  Files which
+ *   FreeType could not open are skipped.
  *
  * Examples:
- *   face.select_charmap FT2::Encoding::UNICODE
+ *   catalog.each { |e| puts "#{e.family} #{e.style}: #{e.path}" }
  *
  */
-static VALUE ft_face_select_charmap(VALUE self, VALUE encoding) {
-  FT_Face *face;
-  FT_Error err;
-  Data_Get_Struct(self, FT_Face, face);
-  err = FT_Select_Charmap(*face, NUM2INT(encoding));
-  if (err != FT_Err_Ok)
-    handle_error(err);
+static VALUE ft_catalog_each(VALUE self) {
+  Catalog *cat;
+  long i;
+
+  RETURN_ENUMERATOR(self, 0, 0);
+  TypedData_Get_Struct(self, Catalog, &catalog_type, cat);
+
+  for (i = 0; i < cat->num_entries; i++)
+    if (cat->entries[i].face_index >= 0)
+      rb_yield(catalog_entry_to_struct(&cat->entries[i]));
+
   return self;
 }
 
 /*
- * Select the FT2::Face object's charmap for character code to glyph index decoding.
+ * Return an array of FT2::Catalog::Entry objects for a FT2::Catalog.
  *
  * Examples:
- *   charmap = face.charmaps[0]
- *   face.set_charmap charmap
- *
- *   charmap = face.charmaps[0]
- *   face.charmap = charmap
+ *   bold = catalog.entries.select { |e| e.style_flags & FT2::Face::BOLD != 0 }
  *
  */
-static VALUE ft_face_set_charmap(VALUE self, VALUE charmap) {
-  FT_Face *face;
-  FT_CharMap *cm;
-  FT_Error err;
-  Data_Get_Struct(self, FT_Face, face);
-  Data_Get_Struct(charmap, FT_CharMap, cm);
-  err = FT_Set_Charmap(*face, *cm);
-  if (err != FT_Err_Ok)
-    handle_error(err);
-  return self;
+static VALUE ft_catalog_entries(VALUE self) {
+  Catalog *cat;
+  VALUE ary;
+  long i;
+
+  TypedData_Get_Struct(self, Catalog, &catalog_type, cat);
+  ary = rb_ary_new2(cat->num_entries);
+  for (i = 0; i < cat->num_entries; i++)
+    if (cat->entries[i].face_index >= 0)
+      rb_ary_push(ary, catalog_entry_to_struct(&cat->entries[i]));
+
+  return ary;
 }
 
 /*
- * Return the first character code of the selected charmap and corresponding glyph index of a FT2::Face object.
- *
- * Note:
- *   Using this with FT2::Face#next_char will allow you to iterate
- *   through the charmap => glyph index mapping for the selected
- *   charmap.
+ * Return the number of faces in a FT2::Catalog.
  *
- *   You should probably use the method FT2::Face#current_charmap
- *   instead.
+ * Aliases:
+ *   FT2::Catalog#length
  *
  * Examples:
- *   c_code, g_idx = face.first_char
- *   while g_idx != 0
- *     puts "#{c_code} => #{g_idx}"
- *     c_code, g_idx = face.next_char
- *   end
+ *   puts "#{catalog.size} faces"
  *
  */
-static VALUE ft_face_first_char(VALUE self) {
-  FT_Face *face;
-  VALUE ary;
-  FT_ULong char_code;
-  FT_UInt  glyph_index;
-  Data_Get_Struct(self, FT_Face, face);
-  ary = rb_ary_new();
+static VALUE ft_catalog_size(VALUE self) {
+  Catalog *cat;
+  long i, n = 0;
 
-  char_code = FT_Get_First_Char(*face, &glyph_index);
-  rb_ary_push(ary, UINT2NUM(char_code));
-  rb_ary_push(ary, UINT2NUM(glyph_index));
+  TypedData_Get_Struct(self, Catalog, &catalog_type, cat);
+  for (i = 0; i < cat->num_entries; i++)
+    if (cat->entries[i].face_index >= 0)
+      n++;
 
-  return ary;
+  return LONG2NUM(n);
 }
 
 /*
- * Return the next character code of the selected charmap and corresponding glyph index of a FT2::Face object.
+ * Return the number of font files parsed by the last FT2::Catalog#scan.
  *
- * Note:
- *   Using this with FT2::Face#first_char will allow you to iterate
- *   through the charmap => glyph index mapping for the selected
- *   charmap.  Returns 0 if the charmap is empty, or if there are no
- *   more codes in the charmap.
+ * Examples:
+ *   catalog.scan dir
+ *   puts "#{catalog.parsed} new or changed files"
  *
- *   You should probably use the method FT2::Face#current_charmap
- *   instead.
+ */
+static VALUE ft_catalog_parsed(VALUE self) {
+  Catalog *cat;
+  TypedData_Get_Struct(self, Catalog, &catalog_type, cat);
+  return LONG2NUM(cat->parsed);
+}
+
+/*
+ * Return the index file path of a FT2::Catalog, or nil.
  *
  * Examples:
- *   c_code, g_idx = face.first_char
- *   while g_idx != 0
- *     puts "#{c_code} => #{g_idx}"
- *     c_code, g_idx = face.next_char
- *   end
+ *   path = catalog.path
  *
  */
-static VALUE ft_face_next_char(VALUE self, VALUE char_code) {
-  FT_Face *face;
+static VALUE ft_catalog_path(VALUE self) {
+  Catalog *cat;
+  TypedData_Get_Struct(self, Catalog, &catalog_type, cat);
+  return catalog_str_new(cat->path);
+}
+
+/****************************/
+/* FT2.scan (parallel scan) */
+/****************************/
+
+static VALUE scan_job_run(VALUE arg) {
+  ScanJob *job = (ScanJob *) arg;
   VALUE ary;
-  FT_ULong ret_char_code;
-  FT_UInt  glyph_index;
-  Data_Get_Struct(self, FT_Face, face);
-  ary = rb_ary_new();
+  long i, j;
 
-  ret_char_code = FT_Get_Next_Char(*face, char_code, &glyph_index);
-  rb_ary_push(ary, UINT2NUM(ret_char_code));
-  rb_ary_push(ary, UINT2NUM(glyph_index));
+  scan_job_call(job, scan_walk);
+  scan_job_call(job, scan_parse);
+
+  ary = rb_ary_new();
+  for (i = 0; i < job->num_files; i++)
+    for (j = 0; j < job->files[i].num_entries; j++)
+      if (job->files[i].entries[j].face_index >= 0)
+        rb_ary_push(ary, catalog_entry_to_struct(&job->files[i].entries[j]));
 
   return ary;
 }
 
+static VALUE scan_job_ensure(VALUE arg) {
+  scan_job_free((ScanJob *) arg);
+  return Qnil;
+}
+
 /*
- * Return the character code to glyph index map of the selected charmap of a FT2::Face object.
+ * Scan font directories in parallel.
  *
- * Note:
- *   Returns nil if the selected charmap is empty.
+ * Description:
+ *   Walks each directory recursively (skipping dot files) and opens
+ *   every face of every font file found on a pool of native threads,
+ *   each with its own FreeType library.  The GVL is released for the
+ *   whole scan, so other Ruby threads keep running.
+ *
+ *   Returns an array of FT2::Catalog::Entry objects, in directory walk
+ *   order.  Files FreeType can't open are skipped.
+ *
+ *   threads: number of worker threads (default: number of online CPUs)
  *
  * Examples:
- *   mapping = face.charmap
+ *   entries = FT2.scan '/usr/share/fonts'
+ *   entries = FT2.scan '/usr/share/fonts', '/opt/fonts', threads: 8
  *
  */
-static VALUE ft_face_current_charmap(VALUE self) {
-  FT_Face *face;
-  FT_ULong c_code;
-  FT_UInt g_idx;
-  VALUE rtn;
+static VALUE ft_scan(int argc, VALUE *argv, VALUE klass) {
+  VALUE dirs, dir, opts, threads = Qundef;
+  ID kw_threads;
+  ScanJob job;
+  long i, n;
+  UNUSED(klass);
 
-  rtn = Qnil;
-  Data_Get_Struct(self, FT_Face, face);
+  rb_scan_args(argc, argv, "*:", &dirs, &opts);
+  if (opts != Qnil) {
+    kw_threads = rb_intern("threads");
+    rb_get_kwargs(opts, &kw_threads, 0, 1, &threads);
+  }
 
-  c_code = FT_Get_First_Char(*face, &g_idx);
-  if (!g_idx || !c_code)
-    return rtn;
+  if (threads != Qundef && threads != Qnil) {
+    if ((n = NUM2LONG(threads)) < 1 || n > 1024)
+      rb_raise(rb_eArgError, "Invalid thread count: %ld.", n);
+  } else {
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1)
+      n = 1;
+  }
 
-  rtn = rb_hash_new();
-  while (c_code != 0) {
-    rb_hash_aset(rtn, UINT2NUM(c_code), UINT2NUM(g_idx));
-    c_code = FT_Get_Next_Char(*face, c_code, &g_idx);
+  for (i = 0; i < RARRAY_LEN(dirs); i++) {
+    dir = RARRAY_AREF(dirs, i);
+    FilePathValue(dir);
+    rb_ary_store(dirs, i, dir);
   }
 
-  return rtn;
+  scan_job_init(&job, RARRAY_LEN(dirs), RARRAY_CONST_PTR(dirs), (int) n);
+
+  return rb_ensure(scan_job_run, (VALUE) &job, scan_job_ensure, (VALUE) &job);
 }
 
 
@@ -1657,7 +7968,7 @@ static VALUE ft_glyphmetrics_init(VALUE self) {
  */
 static VALUE ft_glyphmetrics_width(VALUE self) {
   FT_Glyph_Metrics *glyph;
-  Data_Get_Struct(self, FT_Glyph_Metrics, glyph);
+  glyph = view_get(self, &glyph_metrics_type)->ptr;
   return INT2NUM(glyph->width);
 }
 
@@ -1678,7 +7989,7 @@ static VALUE ft_glyphmetrics_width(VALUE self) {
  */
 static VALUE ft_glyphmetrics_height(VALUE self) {
   FT_Glyph_Metrics *glyph;
-  Data_Get_Struct(self, FT_Glyph_Metrics, glyph);
+  glyph = view_get(self, &glyph_metrics_type)->ptr;
   return INT2NUM(glyph->height);
 }
 
@@ -1703,7 +8014,7 @@ static VALUE ft_glyphmetrics_height(VALUE self) {
  */
 static VALUE ft_glyphmetrics_h_bear_x(VALUE self) {
   FT_Glyph_Metrics *glyph;
-  Data_Get_Struct(self, FT_Glyph_Metrics, glyph);
+  glyph = view_get(self, &glyph_metrics_type)->ptr;
   return INT2NUM(glyph->horiBearingX);
 }
 
@@ -1728,7 +8039,7 @@ static VALUE ft_glyphmetrics_h_bear_x(VALUE self) {
  */
 static VALUE ft_glyphmetrics_h_bear_y(VALUE self) {
   FT_Glyph_Metrics *glyph;
-  Data_Get_Struct(self, FT_Glyph_Metrics, glyph);
+  glyph = view_get(self, &glyph_metrics_type)->ptr;
   return INT2NUM(glyph->horiBearingY);
 }
 
@@ -1751,7 +8062,7 @@ static VALUE ft_glyphmetrics_h_bear_y(VALUE self) {
  */
 static VALUE ft_glyphmetrics_h_advance(VALUE self) {
   FT_Glyph_Metrics *glyph;
-  Data_Get_Struct(self, FT_Glyph_Metrics, glyph);
+  glyph = view_get(self, &glyph_metrics_type)->ptr;
   return INT2NUM(glyph->horiAdvance);
 }
 
@@ -1776,7 +8087,7 @@ static VALUE ft_glyphmetrics_h_advance(VALUE self) {
  */
 static VALUE ft_glyphmetrics_v_bear_x(VALUE self) {
   FT_Glyph_Metrics *glyph;
-  Data_Get_Struct(self, FT_Glyph_Metrics, glyph);
+  glyph = view_get(self, &glyph_metrics_type)->ptr;
   return INT2NUM(glyph->vertBearingX);
 }
 
@@ -1801,7 +8112,7 @@ static VALUE ft_glyphmetrics_v_bear_x(VALUE self) {
  */
 static VALUE ft_glyphmetrics_v_bear_y(VALUE self) {
   FT_Glyph_Metrics *glyph;
-  Data_Get_Struct(self, FT_Glyph_Metrics, glyph);
+  glyph = view_get(self, &glyph_metrics_type)->ptr;
   return INT2NUM(glyph->vertBearingY);
 }
 
@@ -1824,7 +8135,7 @@ static VALUE ft_glyphmetrics_v_bear_y(VALUE self) {
  */
 static VALUE ft_glyphmetrics_v_advance(VALUE self) {
   FT_Glyph_Metrics *glyph;
-  Data_Get_Struct(self, FT_Glyph_Metrics, glyph);
+  glyph = view_get(self, &glyph_metrics_type)->ptr;
   return INT2NUM(glyph->vertAdvance);
 }
 
@@ -1865,21 +8176,39 @@ static VALUE ft_glyphslot_init(VALUE self) {
  *   FT2::RenderMode::NORMAL
  *   FT2::RenderMode::MONO
  *
+ * Note:
+ *   Other Ruby threads keep running while the glyph is rendered.
+ *
  * Examples:
  *   slot.render FT2::RenderMode::NORMAL
  *
  */
+typedef struct {
+  FT_GlyphSlot    slot;
+  FT_Render_Mode  mode;
+  FT_Error        err;
+} SlotRender;
+
+static void *slot_render_nogvl(void *ptr) {
+  SlotRender *render = (SlotRender *) ptr;
+  render->err = FT_Render_Glyph(render->slot, render->mode);
+  return NULL;
+}
+
 static VALUE ft_glyphslot_render(VALUE self, VALUE render_mode) {
-  FT_Error err;
   FT_GlyphSlot *glyph;
+  SlotRender render;
 
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
+  rb_check_frozen(view_get(self, &glyphslot_type)->owner);
   if (render_mode == Qnil)
     render_mode = INT2FIX(ft_render_mode_normal);
 
-  err = FT_Render_Glyph(*glyph, NUM2INT(render_mode));
-  if (err != FT_Err_Ok)
-    handle_error(err);
+  render.slot = *glyph;
+  render.mode = NUM2INT(render_mode);
+  face_call((*glyph)->face, slot_render_nogvl, &render);
+  if (render.err != FT_Err_Ok)
+    handle_error(render.err);
 
   return self;
 }
@@ -1887,17 +8216,16 @@ static VALUE ft_glyphslot_render(VALUE self, VALUE render_mode) {
 static VALUE ft_glyphslot_glyph(VALUE self) {
   FT_Error err;
   FT_GlyphSlot *slot;
-  FT_Glyph *glyph;
+  FT_Glyph glyph;
 
-  glyph = malloc(sizeof(FT_Glyph));
-  Data_Get_Struct(self, FT_GlyphSlot, slot);
-  err = FT_Get_Glyph(*slot, glyph);
-  if (err != FT_Err_Ok) {
-    free(glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, slot);
+  lock_acquire(face_lock((*slot)->face));
+  err = FT_Get_Glyph(*slot, &glyph);
+  pthread_mutex_unlock(face_lock((*slot)->face));
+  if (err != FT_Err_Ok)
     handle_error(err);
-  }
 
-  return Data_Wrap_Struct(cGlyph, 0, glyph_free, glyph);
+  return glyph_wrap(cGlyph, glyph);
 }
 
 /*
@@ -1909,13 +8237,8 @@ static VALUE ft_glyphslot_glyph(VALUE self) {
  */
 static VALUE ft_glyphslot_library(VALUE self) {
   FT_GlyphSlot *glyph;
-  FT_Library *lib;
-
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
-  lib = malloc(sizeof(FT_Library));
-  *lib = (*glyph)->library;
-
-  return Data_Wrap_Struct(cLibrary, 0, dont_free, lib);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
+  return library_wrap((*glyph)->library);
 }
 
 /*
@@ -1926,15 +8249,8 @@ static VALUE ft_glyphslot_library(VALUE self) {
  *
  */
 static VALUE ft_glyphslot_face(VALUE self) {
-  FT_GlyphSlot *glyph;
-  FT_Face *face;
-
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
-  face = malloc(sizeof(FT_Face));
-  *face = (*glyph)->face;
-
-  /* do we really want to dont_free() cb here? */
-  return Data_Wrap_Struct(cFace, 0, dont_free, face);
+  /* the slot belongs to, and keeps alive, the face it was taken from */
+  return view_get(self, &glyphslot_type)->owner;
 }
 
 /*
@@ -1952,32 +8268,33 @@ static VALUE ft_glyphslot_face(VALUE self) {
  */
 static VALUE ft_glyphslot_next(VALUE self) {
   FT_GlyphSlot *glyph;
-  FT_GlyphSlot *next;
 
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
-  next = malloc(sizeof(FT_GlyphSlot));
-  *next = (*glyph)->next;
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
+  if (!(*glyph)->next)
+    return Qnil;
 
-  /* do we really want to dont_free() cb here? */
-  return Data_Wrap_Struct(cGlyphSlot, 0, dont_free, next);
+  /* the slots of a face all live as long as the face itself */
+  return view_wrap(cGlyphSlot, &glyphslot_type, (*glyph)->next,
+                   view_get(self, &glyphslot_type)->owner);
 }
 
 /*
  * Get the FT2::GlyphMetrics of a FT2::GlyphSlot object.
  *
+ * Note:
+ *   The metrics are a view of the slot, not a copy: they're allocated
+ *   once per slot and change when another glyph is loaded into it.
+ *
  * Examples:
  *   metrics = slot.metrics
  *
  */
 static VALUE ft_glyphslot_metrics(VALUE self) {
-  FT_GlyphSlot *glyph;
-  FT_Glyph_Metrics *metrics;
-
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
-  metrics = malloc(sizeof(FT_Glyph_Metrics));
-  *metrics = (*glyph)->metrics;
+  View *slot = view_get(self, &glyphslot_type);
+  FT_GlyphSlot glyph = (FT_GlyphSlot) slot->ptr;
 
-  return Data_Wrap_Struct(cGlyphMetrics, 0, dont_free, metrics);
+  return view_cached(self, &slot->views[VIEW_METRICS], cGlyphMetrics, &glyph_metrics_type,
+                     &glyph->metrics, slot->owner);
 }
 
 /*
@@ -2007,7 +8324,7 @@ static VALUE ft_glyphslot_metrics(VALUE self) {
 static VALUE ft_glyphslot_h_advance(VALUE self) {
   FT_GlyphSlot *glyph;
 
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   return rb_float_new(FTFIX2DBL((*glyph)->linearHoriAdvance));
 }
 
@@ -2038,7 +8355,7 @@ static VALUE ft_glyphslot_h_advance(VALUE self) {
 static VALUE ft_glyphslot_v_advance(VALUE self) {
   FT_GlyphSlot *glyph;
 
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   return rb_float_new(ft_fixed_to_double((*glyph)->linearVertAdvance));
 }
 
@@ -2053,7 +8370,7 @@ static VALUE ft_glyphslot_advance(VALUE self) {
   FT_GlyphSlot *glyph;
   VALUE ary;
 
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   ary = rb_ary_new();
 
   rb_ary_push(ary, INT2NUM((*glyph)->advance.x));
@@ -2076,26 +8393,27 @@ static VALUE ft_glyphslot_advance(VALUE self) {
  */
 static VALUE ft_glyphslot_format(VALUE self) {
   FT_GlyphSlot *glyph;
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   return INT2NUM((*glyph)->format);
 }
 
 /*
  * Get the bitmap of a bitmap format FT2::GlyphSlot object.
  *
+ * Note:
+ *   Like FT2::GlyphSlot#metrics, this is a view of the slot which
+ *   changes when another glyph is loaded or rendered into it.
+ *
  * Examples:
  *   bmap = slot.bitmap
  *
  */
 static VALUE ft_glyphslot_bitmap(VALUE self) {
-  FT_GlyphSlot *glyph;
-  FT_Bitmap *bitmap;
+  View *slot = view_get(self, &glyphslot_type);
+  FT_GlyphSlot glyph = (FT_GlyphSlot) slot->ptr;
 
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
-  bitmap = malloc(sizeof(FT_Bitmap));
-  *bitmap = (*glyph)->bitmap;
-
-  return Data_Wrap_Struct(cBitmap, 0, dont_free, bitmap);
+  return view_cached(self, &slot->views[VIEW_BITMAP], cBitmap, &bitmap_type,
+                     &glyph->bitmap, slot->owner);
 }
 
 /*
@@ -2110,7 +8428,7 @@ static VALUE ft_glyphslot_bitmap(VALUE self) {
  */
 static VALUE ft_glyphslot_bitmap_left(VALUE self) {
   FT_GlyphSlot *glyph;
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   return INT2NUM((*glyph)->bitmap_left);
 }
 
@@ -2128,7 +8446,7 @@ static VALUE ft_glyphslot_bitmap_left(VALUE self) {
  */
 static VALUE ft_glyphslot_bitmap_top(VALUE self) {
   FT_GlyphSlot *glyph;
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   return INT2NUM((*glyph)->bitmap_top);
 }
 
@@ -2136,21 +8454,19 @@ static VALUE ft_glyphslot_bitmap_top(VALUE self) {
  * Get the outline of a bitmap outline format FT2::GlyphSlot object.
  *
  * Note:
- *   Only valid if the format is FT2::GlyphFormat::OUTLINE.
+ *   Only valid if the format is FT2::GlyphFormat::OUTLINE.  Like
+ *   FT2::GlyphSlot#metrics, this is a view of the slot.
  *
  * Examples:
  *   outline = slot.outline
  *
  */
 static VALUE ft_glyphslot_outline(VALUE self) {
-  FT_GlyphSlot *glyph;
-  FT_Outline *outline;
-
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
-  outline = malloc(sizeof(FT_Outline));
-  *outline = (*glyph)->outline;
+  View *slot = view_get(self, &glyphslot_type);
+  FT_GlyphSlot glyph = (FT_GlyphSlot) slot->ptr;
 
-  return Data_Wrap_Struct(cOutline, 0, dont_free, outline);
+  return view_cached(self, &slot->views[VIEW_OUTLINE], cOutline, &outline_type,
+                     &glyph->outline, slot->owner);
 }
 
 /*
@@ -2165,7 +8481,7 @@ static VALUE ft_glyphslot_outline(VALUE self) {
  */
 static VALUE ft_glyphslot_num_subglyphs(VALUE self) {
   FT_GlyphSlot *glyph;
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   return INT2NUM((*glyph)->num_subglyphs);
 }
 
@@ -2185,7 +8501,7 @@ static VALUE ft_glyphslot_subglyphs(VALUE self) {
   VALUE rtn;
   int num;
 
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   if ((num = (*glyph)->num_subglyphs) < 1)
     return Qnil;
 
@@ -2214,7 +8530,7 @@ static VALUE ft_glyphslot_subglyphs(VALUE self) {
  */
 static VALUE ft_glyphslot_control_data(VALUE self) {
   FT_GlyphSlot *glyph;
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   return rb_str_new((*glyph)->control_data, (*glyph)->control_len);
 }
 
@@ -2227,7 +8543,7 @@ static VALUE ft_glyphslot_control_data(VALUE self) {
  */
 static VALUE ft_glyphslot_control_len(VALUE self) {
   FT_GlyphSlot *glyph;
-  Data_Get_Struct(self, FT_GlyphSlot, glyph);
+  TypedData_Get_Struct(self, FT_GlyphSlot, &glyphslot_type, glyph);
   return INT2NUM((*glyph)->control_len);
 }
 
@@ -2236,6 +8552,78 @@ static VALUE ft_glyphslot_control_len(VALUE self) {
 /* FT2::Size methods */
 /*********************/
 
+/*
+ * The data of FT2::Size objects created by FT2::Size.new, which own
+ * their FT_Size.  The view comes first, so they're also size views.
+ */
+typedef struct {
+  View        view;     /* ptr is the FT_Size, owner the FT2::Face */
+  FT_Face     face;     /* referenced, the size can't outlive it */
+  FT_Library  library;
+} OwnedSize;
+
+static void owned_size_free(void *ptr) {
+  OwnedSize *size = (OwnedSize *) ptr;
+
+  if (size->library)
+    face_release(size->face, (FT_Size) size->view.ptr, size->library);
+  xfree(ptr);
+}
+
+static size_t owned_size_memsize(const void *ptr) {
+  UNUSED(ptr);
+  return sizeof(OwnedSize);
+}
+
+static const rb_data_type_t owned_size_type = {
+  "FT2::Size",
+  { view_mark, owned_size_free, owned_size_memsize, view_compact, },
+  &size_type, 0,
+  RUBY_TYPED_FROZEN_SHAREABLE | RUBY_TYPED_FREE_IMMEDIATELY |
+  RUBY_TYPED_WB_PROTECTED,
+};
+
+/*
+ * Allocate and initialize a new FT2::Size object for a FT2::Face.
+ *
+ * Description:
+ *   Creates a new size for `face' with FT_New_Size.  Its dimensions are
+ *   unset; use FT2::Size#activate, then FT2::Face#set_char_size or
+ *   FT2::Face#set_pixel_sizes.  Switching between the sizes of a face
+ *   with FT2::Size#activate costs nothing, unlike setting the size of
+ *   the face again.
+ *
+ * Examples:
+ *   small = FT2::Size.new face
+ *   small.activate
+ *   face.set_pixel_sizes 0, 12
+ *
+ */
+static VALUE ft_size_new(VALUE klass, VALUE face_obj) {
+  OwnedSize *size;
+  FT_Size ft_size;
+  FT_Error err;
+  Face *face;
+  VALUE self;
+
+  TypedData_Get_Struct(face_obj, Face, &face_type, face);
+  self = TypedData_Make_Struct(klass, OwnedSize, &owned_size_type, size);
+  face_reference(face->face, face->library);
+  size->face = face->face;
+  size->library = face->library;
+  RB_OBJ_WRITE(self, &size->view.owner, face_obj);
+
+  lock_acquire(face_lock(face->face));
+  err = FT_New_Size(face->face, &ft_size);
+  pthread_mutex_unlock(face_lock(face->face));
+  if (err != FT_Err_Ok)
+    handle_error(err);
+  size->view.ptr = ft_size;
+
+  rb_obj_call_init(self, 0, NULL);
+  return self;
+}
+
 /*
  * Constructor for FT2::Size class.
  *
@@ -2256,32 +8644,53 @@ static VALUE ft_size_init(VALUE self) {
  *
  */
 static VALUE ft_size_face(VALUE self) {
-  FT_Size *size;
-  FT_Face *face;
-
-  Data_Get_Struct(self, FT_Size, size);
-  face = malloc(sizeof(FT_Face));
-  *face = (*size)->face;
-
-  return Data_Wrap_Struct(cFace, 0, dont_free, face);
+  return view_get(self, &size_type)->owner;
 }
 
 /*
  * Get the FT2::SizeMetrics associated with a FT2::Size object.
  *
+ * Note:
+ *   This is a view of the size, so it follows FT2::Face#set_char_size.
+ *
  * Examples:
  *   s_metrics = size.metrics
  *
  */
 static VALUE ft_size_metrics(VALUE self) {
-  FT_Size *size;
-  FT_Size_Metrics *metrics;
+  View *size = view_get(self, &size_type);
+
+  return view_cached(self, &size->views[VIEW_METRICS], cSizeMetrics,
+                     &size_metrics_type, &((FT_Size) size->ptr)->metrics,
+                     size->owner);
+}
+
+/*
+ * Make this FT2::Size the size of the FT2::Face object it belongs to.
+ *
+ * Description:
+ *   Glyphs are loaded, and FT2::Face#set_char_size and
+ *   FT2::Face#set_pixel_sizes apply, at the size of the face object.
+ *   Other FT2::Face objects sharing the same font (see FT2::Face#share
+ *   and FT2::FaceCache) keep theirs.
+ *
+ * Examples:
+ *   size = FT2::Size.new face
+ *   size.activate
+ *
+ */
+static VALUE ft_size_activate(VALUE self) {
+  View *size = view_get(self, &size_type);
+  Face *face;
+
+  TypedData_Get_Struct(size->owner, Face, &face_type, face);
+  rb_check_frozen(size->owner);
 
-  Data_Get_Struct(self, FT_Size, size);
-  metrics = malloc(sizeof(FT_Size_Metrics));
-  *metrics = (*size)->metrics;
+  /* the face keeps the active FT2::Size object alive */
+  face->size = (FT_Size) size->ptr;
+  RB_OBJ_WRITE(size->owner, &face->views[FACE_VIEW_SIZE], self);
 
-  return Data_Wrap_Struct(cSizeMetrics, 0, dont_free, metrics);
+  return self;
 }
 
 
@@ -2314,7 +8723,7 @@ static VALUE ft_size_metrics_init(VALUE self) {
  */
 static VALUE ft_size_metrics_x_ppem(VALUE self) {
   FT_Size_Metrics *size_metrics;
-  Data_Get_Struct(self, FT_Size_Metrics, size_metrics);
+  size_metrics = view_get(self, &size_metrics_type)->ptr;
   return INT2FIX((int) (*size_metrics).x_ppem);
 }
 
@@ -2331,7 +8740,7 @@ static VALUE ft_size_metrics_x_ppem(VALUE self) {
  */
 static VALUE ft_size_metrics_y_ppem(VALUE self) {
   FT_Size_Metrics *size_metrics;
-  Data_Get_Struct(self, FT_Size_Metrics, size_metrics);
+  size_metrics = view_get(self, &size_metrics_type)->ptr;
   return INT2FIX((int) (*size_metrics).y_ppem);
 }
 
@@ -2348,7 +8757,7 @@ static VALUE ft_size_metrics_y_ppem(VALUE self) {
  */
 static VALUE ft_size_metrics_x_scale(VALUE self) {
   FT_Size_Metrics *size_metrics;
-  Data_Get_Struct(self, FT_Size_Metrics, size_metrics);
+  size_metrics = view_get(self, &size_metrics_type)->ptr;
   return INT2FIX((int) (*size_metrics).x_scale);
 }
 
@@ -2365,7 +8774,7 @@ static VALUE ft_size_metrics_x_scale(VALUE self) {
  */
 static VALUE ft_size_metrics_y_scale(VALUE self) {
   FT_Size_Metrics *size_metrics;
-  Data_Get_Struct(self, FT_Size_Metrics, size_metrics);
+  size_metrics = view_get(self, &size_metrics_type)->ptr;
   return INT2FIX((int) (*size_metrics).y_scale);
 }
 
@@ -2374,11 +8783,68 @@ static VALUE ft_size_metrics_y_scale(VALUE self) {
 /* FT2::Glyph methods */
 /**********************/
 static void glyph_free(void *ptr) {
-  FT_Glyph glyph = *((FT_Glyph *) ptr);
-  FT_Done_Glyph(glyph);
+  Glyph *glyph = (Glyph *) ptr;
+
+  FT_Done_Glyph(glyph->glyph);
+  if (glyph->library)
+    face_release(NULL, NULL, glyph->library);
   free(ptr);
 }
 
+/* glyphs own their bitmap or outline, so count those too */
+static size_t glyph_memsize(const void *ptr) {
+  const Glyph *glyph = (const Glyph *) ptr;
+  size_t size = sizeof(Glyph);
+  FT_Bitmap *bitmap;
+  FT_Outline *outline;
+
+  switch (glyph->glyph->format) {
+  case FT_GLYPH_FORMAT_BITMAP:
+    bitmap = &((FT_BitmapGlyph) glyph->glyph)->bitmap;
+    size += sizeof(FT_BitmapGlyphRec) +
+            (size_t) abs(bitmap->pitch) * bitmap->rows;
+    break;
+  case FT_GLYPH_FORMAT_OUTLINE:
+    outline = &((FT_OutlineGlyph) glyph->glyph)->outline;
+    size += sizeof(FT_OutlineGlyphRec) +
+            outline->n_points * (sizeof(FT_Vector) + sizeof(char)) +
+            outline->n_contours * sizeof(short);
+    break;
+  default:
+    break;
+  }
+
+  return size;
+}
+
+/* frozen glyphs may be shared between Ractors */
+static const rb_data_type_t glyph_type = {
+  "FT2::Glyph",
+  { 0, glyph_free, glyph_memsize, },
+  0, 0,
+  RUBY_TYPED_FROZEN_SHAREABLE | RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_WB_PROTECTED,
+};
+
+/* wrap a FT_Glyph in a new object of class `klass', which owns it */
+static VALUE glyph_wrap(VALUE klass, FT_Glyph ft_glyph) {
+  VALUE self;
+  Glyph *glyph;
+
+  if ((glyph = malloc(sizeof(Glyph))) == NULL) {
+    FT_Done_Glyph(ft_glyph);
+    rb_memerror();
+  }
+  glyph->glyph = ft_glyph;
+  glyph->library = NULL;
+  self = TypedData_Wrap_Struct(klass, &glyph_type, glyph);
+
+  /* the glyph is owned by `self' from here, even if this raises */
+  face_reference(NULL, ft_glyph->library);
+  glyph->library = ft_glyph->library;
+
+  return self;
+}
+
 
 /*
  * Constructor for FT2::Glyph class.
@@ -2404,8 +8870,8 @@ static VALUE ft_glyph_init(VALUE self) {
  */
 static VALUE ft_glyph_library(VALUE self) {
   FT_Glyph *glyph;
-  Data_Get_Struct(self, FT_Glyph, glyph);
-  return Data_Wrap_Struct(cLibrary, 0, dont_free, (*glyph)->library);
+  TypedData_Get_Struct(self, FT_Glyph, &glyph_type, glyph);
+  return library_wrap((*glyph)->library);
 }
 
 /*
@@ -2423,8 +8889,8 @@ static VALUE ft_glyph_library(VALUE self) {
  */
 static VALUE ft_glyph_class(VALUE self) {
   FT_Glyph *glyph;
-  Data_Get_Struct(self, FT_Glyph, glyph);
-  return Data_Wrap_Struct(cGlyphClass, 0, dont_free, &(*glyph)->clazz);
+  TypedData_Get_Struct(self, FT_Glyph, &glyph_type, glyph);
+  return view_wrap(cGlyphClass, &glyph_class_type, (void *) (*glyph)->clazz, self);
 }
 
 /*
@@ -2442,7 +8908,7 @@ static VALUE ft_glyph_class(VALUE self) {
  */
 static VALUE ft_glyph_format(VALUE self) {
   FT_Glyph *glyph;
-  Data_Get_Struct(self, FT_Glyph, glyph);
+  TypedData_Get_Struct(self, FT_Glyph, &glyph_type, glyph);
   return INT2NUM((*glyph)->format);
 }
 
@@ -2460,7 +8926,7 @@ static VALUE ft_glyph_advance(VALUE self) {
   FT_Glyph *glyph;
   VALUE ary;
 
-  Data_Get_Struct(self, FT_Glyph, glyph);
+  TypedData_Get_Struct(self, FT_Glyph, &glyph_type, glyph);
   ary = rb_ary_new();
   rb_ary_push(ary, INT2FIX((*glyph)->advance.x));
   rb_ary_push(ary, INT2FIX((*glyph)->advance.y));
@@ -2480,15 +8946,14 @@ static VALUE ft_glyph_advance(VALUE self) {
  */
 static VALUE ft_glyph_dup(VALUE self) {
   FT_Error err;
-  FT_Glyph *glyph, *new_glyph;
+  FT_Glyph *glyph, new_glyph;
 
-  new_glyph = malloc(sizeof(FT_Glyph));
-  Data_Get_Struct(self, FT_Glyph, glyph);
-  err = FT_Glyph_Copy(*glyph, new_glyph);
+  TypedData_Get_Struct(self, FT_Glyph, &glyph_type, glyph);
+  err = FT_Glyph_Copy(*glyph, &new_glyph);
   if (err != FT_Err_Ok)
     handle_error(err);
 
-  return Data_Wrap_Struct(cGlyph, 0, glyph_free, new_glyph);
+  return glyph_wrap(cGlyph, new_glyph);
 }
 
 /*
@@ -2525,7 +8990,8 @@ static VALUE ft_glyph_transform(VALUE self, VALUE matrix_ary, VALUE delta_ary) {
   delta.x = NUM2INT(rb_ary_entry(delta_ary, 0));
   delta.y = NUM2INT(rb_ary_entry(delta_ary, 1));
 
-  Data_Get_Struct(self, FT_Glyph, glyph);
+  TypedData_Get_Struct(self, FT_Glyph, &glyph_type, glyph);
+  rb_check_frozen(self);
   err = FT_Glyph_Transform(*glyph, &matrix, &delta);
   if (err != FT_Err_Ok)
     handle_error(err);
@@ -2594,7 +9060,7 @@ static VALUE ft_glyph_cbox(VALUE self, VALUE bbox_mode) {
   FT_BBox  bbox;
   VALUE    ary;
 
-  Data_Get_Struct(self, FT_Glyph, glyph);
+  TypedData_Get_Struct(self, FT_Glyph, &glyph_type, glyph);
   FT_Glyph_Get_CBox(*glyph, FIX2INT(bbox_mode), &bbox);
 
   ary = rb_ary_new();
@@ -2633,11 +9099,16 @@ static VALUE ft_glyph_to_bmap(VALUE self, VALUE render_mode, VALUE origin, VALUE
   FT_Vector v;
   FT_Bool d;
 
-  Data_Get_Struct(self, FT_Glyph, glyph);
+  TypedData_Get_Struct(self, FT_Glyph, &glyph_type, glyph);
+  rb_check_frozen(self);
   v.x = NUM2INT(rb_ary_entry(origin, 0));
   v.y = NUM2INT(rb_ary_entry(origin, 1));
   d = (destroy != Qnil) ? 1 : 0;
 
+  /*
+   * keeps the GVL: the glyph of this object is replaced (and maybe
+   * freed) in place, and other threads may be using the object
+   */
   err = FT_Glyph_To_Bitmap(glyph, FIX2INT(render_mode), &v, d);
   if (err != FT_Err_Ok)
     handle_error(err);
@@ -2679,7 +9150,7 @@ static VALUE ft_bmapglyph_init(VALUE self) {
  */
 static VALUE ft_bmapglyph_top(VALUE self) {
   FT_BitmapGlyph *glyph;
-  Data_Get_Struct(self, FT_BitmapGlyph, glyph);
+  TypedData_Get_Struct(self, FT_BitmapGlyph, &glyph_type, glyph);
   return INT2FIX((*glyph)->top);
 }
 
@@ -2699,7 +9170,7 @@ static VALUE ft_bmapglyph_top(VALUE self) {
  */
 static VALUE ft_bmapglyph_left(VALUE self) {
   FT_BitmapGlyph *glyph;
-  Data_Get_Struct(self, FT_BitmapGlyph, glyph);
+  TypedData_Get_Struct(self, FT_BitmapGlyph, &glyph_type, glyph);
   return INT2FIX((*glyph)->left);
 }
 
@@ -2712,8 +9183,8 @@ static VALUE ft_bmapglyph_left(VALUE self) {
  */
 static VALUE ft_bmapglyph_bitmap(VALUE self) {
   FT_BitmapGlyph *glyph;
-  Data_Get_Struct(self, FT_BitmapGlyph, glyph);
-  return Data_Wrap_Struct(cBitmapGlyph, 0, glyph_free, &(*glyph)->bitmap);
+  TypedData_Get_Struct(self, FT_BitmapGlyph, &glyph_type, glyph);
+  return view_wrap(cBitmap, &bitmap_type, &(*glyph)->bitmap, self);
 }
 
 
@@ -2745,8 +9216,8 @@ static VALUE ft_outlineglyph_init(VALUE self) {
  */
 static VALUE ft_outlineglyph_outline(VALUE self) {
   FT_OutlineGlyph *glyph;
-  Data_Get_Struct(self, FT_OutlineGlyph, glyph);
-  return Data_Wrap_Struct(cOutline, 0, dont_free, &(*glyph)->outline);
+  TypedData_Get_Struct(self, FT_OutlineGlyph, &glyph_type, glyph);
+  return view_wrap(cOutline, &outline_type, &(*glyph)->outline, self);
 }
 static void define_constants(void) {
   /***********************************/
@@ -2859,9 +9330,41 @@ static void define_constants(void) {
 
 void Init_ft2(void) {
   FT_Error err;
+  int i;
 
-  if ((err = FT_Init_FreeType(&library)) != FT_Err_Ok)
+#ifdef HAVE_RUBY_RACTOR_H
+  /*
+   * Every Ractor gets its own libraries (see current_library) and
+   * default face cache, the little global state left (lock stripes,
+   * pinned objects, font mappings) is guarded by mutexes, and only
+   * frozen faces, glyphs and libraries can be shared.
+   */
+  rb_ext_ractor_safe(true);
+#endif /* HAVE_RUBY_RACTOR_H */
+
+  /* the default libraries report their memory use to the GC */
+  default_memory = memory_new(0);
+  if ((err = memory_new_library(default_memory, &library)) != FT_Err_Ok)
     handle_error(err);
+  /* extensions are loaded by the main Ractor */
+  library_thread = rb_thread_main();
+  rb_global_variable(&library_thread);
+
+  for (i = 0; i < LOCK_STRIPES; i++) {
+    pthread_mutex_init(&face_locks[i], NULL);
+    pthread_mutex_init(&library_locks[i], NULL);
+  }
+  pthread_atfork(NULL, NULL, ft2_atfork_child);
+
+  /* the GC skips the mark function of objects with a NULL data pointer */
+  pinned_objects_holder = TypedData_Wrap_Struct(0, &pinned_objects_type, &pinned_objects);
+  rb_global_variable(&pinned_objects_holder);
+  rb_define_finalizer(pinned_objects_holder, rb_proc_new(pinned_objects_at_exit, Qnil));
+
+  id_seek = rb_intern("seek");
+  id_read = rb_intern("read");
+  id_size = rb_intern("size");
+  id_pos = rb_intern("pos");
 
   /* define top-level FT2 module */
   mFt2 = rb_define_module("FT2");
@@ -2869,6 +9372,9 @@ void Init_ft2(void) {
   eFt2Error = rb_define_class_under(mFt2, "Error", rb_eStandardError);
 
   rb_define_singleton_method(mFt2, "version", ft_version, 0);
+  id_thread_library = rb_intern("__ft2_library__");
+  rb_define_singleton_method(mFt2, "scan", ft_scan, -1);
+  rb_define_singleton_method(mFt2, "preload", ft_preload, -1);
 
   define_constants();
 
@@ -2876,6 +9382,7 @@ void Init_ft2(void) {
   /* define FT2::Bitmap class */
   /****************************/
   cBitmap = rb_define_class_under(mFt2, "Bitmap", rb_cObject);
+  rb_undef_alloc_func(cBitmap);
   rb_define_singleton_method(cBitmap, "initialize", ft_bitmap_init, 0);
   rb_define_method(cBitmap, "rows", ft_bitmap_rows, 0);
   rb_define_method(cBitmap, "width", ft_bitmap_width, 0);
@@ -2890,14 +9397,18 @@ void Init_ft2(void) {
   /* define FT2::CharMap class */
   /*****************************/
   cCharMap = rb_define_class_under(mFt2, "CharMap", rb_cObject);
+  rb_undef_alloc_func(cCharMap);
 
   /**************************/
   /* define FT2::Face class */
   /**************************/
   cFace = rb_define_class_under(mFt2, "Face", rb_cObject);
+  rb_undef_alloc_func(cFace);
   rb_define_singleton_method(cFace, "new", ft_face_new, -1);
   rb_define_singleton_method(cFace, "load", ft_face_new, -1);
   rb_define_singleton_method(cFace, "new_from_memory", ft_face_new_from_memory, -1);
+  rb_define_singleton_method(cFace, "open_mapped", ft_face_open_mapped, -1);
+  rb_define_singleton_method(cFace, "from_io", ft_face_from_io, -1);
 
   rb_define_singleton_method(cFace, "initialize", ft_face_init, 0);
 
@@ -2969,6 +9480,7 @@ void Init_ft2(void) {
   rb_define_method(cFace, "underline_thickness", ft_face_underline_thickness, 0);
   rb_define_method(cFace, "glyph", ft_face_glyph, 0);
   rb_define_method(cFace, "size", ft_face_size, 0);
+  rb_define_method(cFace, "share", ft_face_share, 0);
   rb_define_method(cFace, "charmap", ft_face_charmap, 0);
 
   rb_define_method(cFace, "attach", ft_face_attach, 1);
@@ -2978,10 +9490,21 @@ void Init_ft2(void) {
   rb_define_method(cFace, "load_char", ft_face_load_char, 2);
 
   rb_define_method(cFace, "char_index", ft_face_char_index, 1);
+  rb_define_method(cFace, "glyph_indices", ft_face_glyph_indices, -1);
+  rb_define_method(cFace, "coverage", ft_face_coverage, 0);
+  rb_define_method(cFace, "covers?", ft_face_covers, 1);
+  rb_define_method(cFace, "missing_chars", ft_face_missing_chars, 1);
+
+  sFaceMeasurement = rb_struct_define_under(cFace, "Measurement", "advance",
+                                            "x_min", "y_min", "x_max", "y_max",
+                                            "ascent", "descent", NULL);
+  rb_define_method(cFace, "measure", ft_face_measure, -1);
+  rb_define_method(cFace, "fit", ft_face_fit, -1);
   rb_define_method(cFace, "name_index", ft_face_name_index, 1);
 
   rb_define_method(cFace, "kerning", ft_face_kerning, 3);
   rb_define_alias(cFace, "get_kerning", "kerning");
+  rb_define_method(cFace, "kerning_run", ft_face_kerning_run, -1);
 
   rb_define_method(cFace, "glyph_name", ft_face_glyph_name, 1);
   rb_define_method(cFace, "postscript_name", ft_face_ps_name, 0);
@@ -2995,15 +9518,122 @@ void Init_ft2(void) {
   rb_define_method(cFace, "next_char", ft_face_next_char, 1);
 
   rb_define_method(cFace, "current_charmap", ft_face_current_charmap, 0);
+  rb_define_method(cFace, "charmap_pairs", ft_face_charmap_pairs, 0);
+  rb_define_method(cFace, "each_char_mapping", ft_face_each_char_mapping, 0);
+  rb_define_method(cFace, "advance", ft_face_advance, -1);
+  rb_define_method(cFace, "advances", ft_face_advances, -1);
 
   rb_define_method(cFace, "set_char_size", ft_face_set_char_size, 4);
   rb_define_method(cFace, "set_pixel_sizes", ft_face_set_pixel_sizes, 2);
   rb_define_method(cFace, "set_transform", ft_face_set_transform, 2);
 
+  /*******************************/
+  /* define FT2::FaceCache class */
+  /*******************************/
+  cFaceCache = rb_define_class_under(mFt2, "FaceCache", rb_cObject);
+  rb_define_alloc_func(cFaceCache, ft_face_cache_alloc);
+  rb_define_method(cFaceCache, "initialize", ft_face_cache_init, -1);
+  rb_define_singleton_method(cFaceCache, "default", ft_face_cache_default, 0);
+#ifdef HAVE_RUBY_RACTOR_H
+  default_face_cache_key = rb_ractor_local_storage_value_newkey();
+#else
+  rb_global_variable(&default_face_cache);
+#endif /* HAVE_RUBY_RACTOR_H */
+
+  rb_define_method(cFaceCache, "open", ft_face_cache_open, -1);
+  rb_define_method(cFaceCache, "hits", ft_face_cache_hits, 0);
+  rb_define_method(cFaceCache, "misses", ft_face_cache_misses, 0);
+  rb_define_method(cFaceCache, "size", ft_face_cache_size, 0);
+  rb_define_alias(cFaceCache, "length", "size");
+  rb_define_method(cFaceCache, "max_faces", ft_face_cache_max_faces, 0);
+  rb_define_method(cFaceCache, "clear", ft_face_cache_clear, 0);
+
+  /***************************/
+  /* define FT2::Cache class */
+  /***************************/
+  cCache = rb_define_class_under(mFt2, "Cache", rb_cObject);
+  rb_define_alloc_func(cCache, ft_cache_alloc);
+  rb_define_method(cCache, "initialize", ft_cache_init, -1);
+
+  sCacheSBit = rb_struct_define_under(cCache, "SBit",
+                                      "width", "height", "left", "top",
+                                      "format", "max_grays", "pitch",
+                                      "x_advance", "y_advance", "buffer",
+                                      NULL);
+
+  rb_define_method(cCache, "add_face", ft_cache_add_face, -1);
+  rb_define_method(cCache, "remove_face", ft_cache_remove_face, 1);
+  rb_define_method(cCache, "lookup_glyph", ft_cache_lookup_glyph, -1);
+  rb_define_method(cCache, "lookup_sbit", ft_cache_lookup_sbit, -1);
+  rb_define_method(cCache, "char_index", ft_cache_char_index, 2);
+  rb_define_method(cCache, "flush", ft_cache_flush, 0);
+
+  /********************************/
+  /* define FT2::GlyphCache class */
+  /********************************/
+  cGlyphCache = rb_define_class_under(mFt2, "GlyphCache", rb_cObject);
+  rb_define_alloc_func(cGlyphCache, ft_glyph_cache_alloc);
+  rb_define_method(cGlyphCache, "initialize", ft_glyph_cache_init, -1);
+
+  sGlyphCacheGlyph = rb_struct_define_under(cGlyphCache, "Glyph",
+                                            "width", "rows", "pitch",
+                                            "left", "top", "x_advance",
+                                            "y_advance", "pixel_mode",
+                                            "num_grays", "buffer", NULL);
+
+  rb_define_method(cGlyphCache, "render", ft_glyph_cache_render, -1);
+  rb_define_method(cGlyphCache, "hits", ft_glyph_cache_hits, 0);
+  rb_define_method(cGlyphCache, "misses", ft_glyph_cache_misses, 0);
+  rb_define_method(cGlyphCache, "evictions", ft_glyph_cache_evictions, 0);
+  rb_define_method(cGlyphCache, "bytes", ft_glyph_cache_bytes, 0);
+  rb_define_method(cGlyphCache, "max_bytes", ft_glyph_cache_max_bytes, 0);
+  rb_define_method(cGlyphCache, "size", ft_glyph_cache_size, 0);
+  rb_define_alias(cGlyphCache, "length", "size");
+  rb_define_method(cGlyphCache, "clear", ft_glyph_cache_clear, 0);
+
+  /*******************************/
+  /* define FT2::FontStack class */
+  /*******************************/
+  cFontStack = rb_define_class_under(mFt2, "FontStack", rb_cObject);
+  rb_define_alloc_func(cFontStack, ft_font_stack_alloc);
+  rb_define_method(cFontStack, "initialize", ft_font_stack_init, 1);
+
+  sFontStackRun = rb_struct_define_under(cFontStack, "Run", "face", "start",
+                                         "length", "text", NULL);
+
+  rb_define_method(cFontStack, "faces", ft_font_stack_faces, 0);
+  rb_define_method(cFontStack, "face_for", ft_font_stack_face_for, 1);
+  rb_define_method(cFontStack, "runs", ft_font_stack_runs, 1);
+
+  /*****************************/
+  /* define FT2::Catalog class */
+  /*****************************/
+  cCatalog = rb_define_class_under(mFt2, "Catalog", rb_cObject);
+  rb_include_module(cCatalog, rb_mEnumerable);
+  rb_define_alloc_func(cCatalog, ft_catalog_alloc);
+  rb_define_method(cCatalog, "initialize", ft_catalog_init, -1);
+
+  sCatalogEntry = rb_struct_define_under(cCatalog, "Entry",
+                                         "path", "index", "name", "family",
+                                         "style", "face_flags", "style_flags",
+                                         "num_glyphs", "units_per_em",
+                                         "mtime", "size", NULL);
+
+  rb_define_method(cCatalog, "scan", ft_catalog_scan, -1);
+  rb_define_method(cCatalog, "save", ft_catalog_save, -1);
+  rb_define_method(cCatalog, "each", ft_catalog_each, 0);
+  rb_define_method(cCatalog, "entries", ft_catalog_entries, 0);
+  rb_define_alias(cCatalog, "to_a", "entries");
+  rb_define_method(cCatalog, "size", ft_catalog_size, 0);
+  rb_define_alias(cCatalog, "length", "size");
+  rb_define_method(cCatalog, "parsed", ft_catalog_parsed, 0);
+  rb_define_method(cCatalog, "path", ft_catalog_path, 0);
+
   /**********************************/
   /* define FT2::GlyphMetrics class */
   /**********************************/
   cGlyphMetrics = rb_define_class_under(mFt2, "GlyphMetrics", rb_cObject);
+  rb_undef_alloc_func(cGlyphMetrics);
   rb_define_singleton_method(cGlyphMetrics, "initialize", ft_glyphmetrics_init, 0);
 
   rb_define_method(cGlyphMetrics, "width", ft_glyphmetrics_width, 0);
@@ -3039,6 +9669,7 @@ void Init_ft2(void) {
   /* define FT2::GlyphSlot class */
   /*******************************/
   cGlyphSlot = rb_define_class_under(mFt2, "GlyphSlot", rb_cObject);
+  rb_undef_alloc_func(cGlyphSlot);
   rb_define_singleton_method(cGlyphSlot, "initialize", ft_glyphslot_init, 0);
 
   rb_define_method(cGlyphSlot, "library", ft_glyphslot_library, 0);
@@ -3077,29 +9708,52 @@ void Init_ft2(void) {
   /* define FT2::Library class */
   /*****************************/
   cLibrary = rb_define_class_under(mFt2, "Library", rb_cObject);
+  rb_define_alloc_func(cLibrary, ft_library_alloc);
+  rb_define_method(cLibrary, "initialize", ft_library_init, -1);
+  rb_define_singleton_method(cLibrary, "default", ft_library_default, 0);
+  rb_define_method(cLibrary, "version", ft_library_version, 0);
+  rb_define_method(cLibrary, "==", ft_library_eq, 1);
 
   /****************************/
   /* define FT2::Memory class */
   /****************************/
   cMemory = rb_define_class_under(mFt2, "Memory", rb_cObject);
+  rb_define_alloc_func(cMemory, ft_memory_alloc);
+  rb_define_method(cMemory, "initialize", ft_memory_init, -1);
+  rb_define_singleton_method(cMemory, "default", ft_memory_default, 0);
+  rb_define_method(cMemory, "bytes", ft_memory_bytes, 0);
+  rb_define_method(cMemory, "peak_bytes", ft_memory_peak_bytes, 0);
+  rb_define_method(cMemory, "blocks", ft_memory_blocks, 0);
+  rb_define_method(cMemory, "allocations", ft_memory_allocations, 0);
+  rb_define_method(cMemory, "arena_bytes", ft_memory_arena_bytes, 0);
+
+  default_memory_object = ft_memory_alloc(cMemory);
+  *((Memory **) DATA_PTR(default_memory_object)) = default_memory;
+  rb_obj_freeze(default_memory_object);
+  rb_global_variable(&default_memory_object);
 
   /*****************************/
   /* define FT2::Outline class */
   /*****************************/
   cOutline = rb_define_class_under(mFt2, "Outline", rb_cObject);
+  rb_undef_alloc_func(cOutline);
 
   /**************************/
   /* define FT2::Size class */
   /**************************/
   cSize = rb_define_class_under(mFt2, "Size", rb_cObject);
+  rb_undef_alloc_func(cSize);
+  rb_define_singleton_method(cSize, "new", ft_size_new, 1);
   rb_define_singleton_method(cSize, "initialize", ft_size_init, 0);
   rb_define_method(cSize, "face", ft_size_face, 0);
   rb_define_method(cSize, "metrics", ft_size_metrics, 0);
+  rb_define_method(cSize, "activate", ft_size_activate, 0);
 
   /*********************************/
   /* define FT2::SizeMetrics class */
   /*********************************/
   cSizeMetrics = rb_define_class_under(mFt2, "SizeMetrics", rb_cObject);
+  rb_undef_alloc_func(cSizeMetrics);
   rb_define_singleton_method(cSizeMetrics, "initialize", ft_size_metrics_init, 0);
   rb_define_method(cSizeMetrics, "x_ppem", ft_size_metrics_x_ppem, 0);
   rb_define_method(cSizeMetrics, "y_ppem", ft_size_metrics_y_ppem, 0);
@@ -3110,6 +9764,7 @@ void Init_ft2(void) {
   /* define FT2::Glyph class */
   /***************************/
   cGlyph = rb_define_class_under(mFt2, "Glyph", rb_cObject);
+  rb_undef_alloc_func(cGlyph);
   rb_define_singleton_method(cGlyph, "initialize", ft_glyph_init, 0);
   rb_define_method(cGlyph, "library", ft_glyph_library, 0);
   rb_define_method(cGlyph, "class", ft_glyph_class, 0);
@@ -3148,6 +9803,7 @@ void Init_ft2(void) {
   /* define FT2::GlyphClass class */
   /********************************/
   cGlyphClass = rb_define_class_under(mFt2, "GlyphClass", rb_cObject);
+  rb_undef_alloc_func(cGlyphClass);
 
   /******************************/
   /* define FT2::SubGlyph class */
@@ -0,0 +1,37 @@
+require_relative 'test_helper'
+
+class TestAdvances < Minitest::Test
+  include FT2Test
+
+  def test_advance_matches_unscaled_load
+    f = face
+    'AWil .'.each_char do |c|
+      index = f.char_index c.ord
+      f.load_glyph index, FT2::Load::NO_SCALE
+      assert_equal f.glyph.advance[0], f.advance(index)
+    end
+  end
+
+  def test_advance_scales
+    f = face
+    index = f.char_index 'W'.ord
+    assert_in_delta f.advance(index) * 16.0 / f.units_per_em, f.advance(index, 16), 1e-9
+  end
+
+  def test_advances
+    f = face
+    ids = 'Hello'.each_char.map { |c| f.char_index c.ord }
+    total = ids.sum { |i| f.advance i }
+
+    assert_equal total, f.advances(ids)
+    assert_equal total, f.advances(f.glyph_indices('Hello'))
+    assert_in_delta total * 32.0 / f.units_per_em, f.advances(ids, 32), 1e-9
+  end
+
+  def test_advances_are_shared
+    f = face
+    shared = f.share
+    index = f.char_index 'A'.ord
+    assert_equal f.advance(index), shared.advance(index)
+  end
+end
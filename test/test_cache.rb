@@ -0,0 +1,72 @@
+require_relative 'test_helper'
+
+class TestCache < Minitest::Test
+  include FT2Test
+
+  def setup
+    @cache = FT2::Cache.new
+    @id = @cache.add_face YUDIT
+    @gindex = @cache.char_index @id, 'A'.ord
+  end
+
+  def test_char_index
+    assert_equal face.char_index('A'.ord), @gindex
+    assert_equal 0, @cache.char_index(@id, 0x10FFFF)
+  end
+
+  def test_lookup_glyph
+    glyph = @cache.lookup_glyph @id, 16, @gindex
+    assert_kind_of FT2::Glyph, glyph
+    assert_operator glyph.advance[0], :>, 0
+  end
+
+  def test_lookup_sbit
+    sbit = @cache.lookup_sbit @id, 16, @gindex, FT2::Load::RENDER
+    assert_operator sbit.width, :>, 0
+    assert_operator sbit.height, :>, 0
+    assert_equal sbit.pitch.abs * sbit.height, sbit.buffer.bytesize
+    assert_operator sbit.x_advance, :>, 0
+
+    assert_equal sbit, @cache.lookup_sbit(@id, 16, @gindex, FT2::Load::RENDER)
+  end
+
+  def test_sizes
+    small = @cache.lookup_sbit @id, 12, @gindex
+    large = @cache.lookup_sbit @id, 48, @gindex
+    assert_operator large.height, :>, small.height
+    assert_raises(ArgumentError) { @cache.lookup_sbit @id, 0, @gindex }
+  end
+
+  def test_remove_face_and_flush
+    other = @cache.add_face YUDIT
+    @cache.lookup_sbit other, 16, @gindex
+    @cache.remove_face other
+    assert_raises(ArgumentError, FT2::Error) { @cache.lookup_sbit other, 16, @gindex }
+
+    @cache.flush
+    assert_operator @cache.lookup_sbit(@id, 16, @gindex).width, :>, 0
+  end
+
+  def test_missing_font
+    id = @cache.add_face File.join(FONT_DIR, 'missing.ttf')
+    assert_raises(FT2::Error) { @cache.lookup_glyph id, 16, 1 }
+  end
+
+  def test_limits
+    cache = FT2::Cache.new max_faces: 1, max_sizes: 1, max_bytes: 4096
+    ids = 3.times.map { cache.add_face YUDIT }
+    3.times do
+      ids.each do |id|
+        [12, 16].each { |px| assert_operator cache.lookup_sbit(id, px, @gindex).width, :>, 0 }
+      end
+    end
+  end
+
+  def test_threads
+    expected = @cache.lookup_sbit @id, 16, @gindex
+    results = 4.times.map do
+      Thread.new { 100.times.map { @cache.lookup_sbit @id, 16, @gindex }.uniq }
+    end.map(&:value)
+    results.each { |r| assert_equal [expected], r }
+  end
+end
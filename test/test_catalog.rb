@@ -0,0 +1,121 @@
+require_relative 'test_helper'
+
+class TestCatalog < Minitest::Test
+  include FT2Test
+
+  def setup
+    @dir = Dir.mktmpdir
+    @fonts = File.join(@dir, 'fonts')
+    FileUtils.mkdir_p @fonts
+    FileUtils.cp YUDIT, @fonts
+    File.write File.join(@fonts, 'notes.txt'), 'not a font'
+    @index = File.join(@dir, 'fonts.idx')
+  end
+
+  def teardown
+    FileUtils.rm_rf @dir
+  end
+
+  def test_round_trip
+    catalog = FT2::Catalog.new @index
+    assert_equal 2, catalog.scan(@fonts)
+    catalog.save
+
+    loaded = FT2::Catalog.new @index
+    assert_equal catalog.entries.map(&:to_a), loaded.entries.map(&:to_a)
+
+    entry = loaded.entries.first
+    assert_equal File.join(@fonts, 'yudit.ttf'), entry.path
+    assert_equal FT2::Face.new(YUDIT).num_glyphs, entry.num_glyphs
+
+    # unchanged files aren't parsed again
+    assert_equal 0, loaded.scan(@fonts)
+    assert_equal catalog.entries.map(&:to_a), loaded.entries.map(&:to_a)
+  end
+
+  def test_corrupt_index
+    catalog = FT2::Catalog.new @index
+    catalog.scan @fonts
+    catalog.save
+
+    data = File.binread(@index)
+    data[20, 4] = [0xfffffff0].pack('L')
+    File.binwrite @index, data
+    assert_equal 0, FT2::Catalog.new(@index).size
+
+    File.binwrite @index, data[0, 30]
+    assert_equal 0, FT2::Catalog.new(@index).size
+  end
+
+  def test_rescan_changed_and_removed_files
+    copy = File.join(@fonts, 'copy.ttf')
+    FileUtils.cp YUDIT, copy
+    catalog = FT2::Catalog.new
+    assert_equal 3, catalog.scan(@fonts)
+    assert_equal 2, catalog.size
+
+    File.utime Time.now, Time.now + 60, copy
+    assert_equal 1, catalog.scan(@fonts)
+    assert_equal 2, catalog.size
+
+    File.unlink copy
+    assert_equal 0, catalog.scan(@fonts)
+    assert_equal [File.join(@fonts, 'yudit.ttf')], catalog.entries.map(&:path)
+  end
+
+  def test_overlapping_directories
+    catalog = FT2::Catalog.new
+    catalog.scan @fonts
+    catalog.scan @fonts, @fonts
+    assert_equal 1, catalog.size
+  end
+
+  def test_scan_releases_the_gvl
+    200.times { |i| FileUtils.cp YUDIT, File.join(@fonts, "copy#{i}.ttf") }
+    ticks = 0
+    ticker = Thread.new { loop { ticks += 1; Thread.pass } }
+
+    catalog = FT2::Catalog.new
+    catalog.scan @fonts
+    ticker.kill.join
+
+    assert_equal 201, catalog.size
+    assert_operator ticks, :>, 0
+  end
+
+  def test_interrupted_scan_keeps_the_entries
+    catalog = FT2::Catalog.new
+    catalog.scan @fonts
+    fonts = @fonts
+
+    assert_raises(Interrupt) { interrupted { catalog.scan fonts } }
+    assert_equal 1, catalog.size
+    assert_equal 0, catalog.scan(@fonts)
+  end
+
+  def test_entries_stay_during_a_scan
+    200.times { |i| FileUtils.cp YUDIT, File.join(@fonts, "copy#{i}.ttf") }
+    catalog = FT2::Catalog.new
+    catalog.scan @fonts
+    200.times { |i| FileUtils.cp YUDIT, File.join(@fonts, "more#{i}.ttf") }
+
+    sizes, rejected = [], 0
+    scan = Thread.new { catalog.scan @fonts }
+    while scan.alive?
+      sizes << catalog.size
+      # a second scan is refused before its arguments are checked
+      begin
+        catalog.scan nil
+      rescue FT2::Error
+        rejected += 1
+      rescue TypeError
+      end
+      Thread.pass
+    end
+
+    assert_equal 200, scan.value
+    assert_equal [201], sizes.uniq - [401]
+    assert_operator rejected, :>, 0
+    assert_equal 401, catalog.size
+  end
+end
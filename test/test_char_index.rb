@@ -0,0 +1,37 @@
+require_relative 'test_helper'
+
+class TestCharIndex < Minitest::Test
+  include FT2Test
+
+  def test_char_index_matches_charmap
+    f = face
+    codes, glyphs = f.charmap_pairs
+    codes.unpack('L*').zip(glyphs.unpack('L*')) do |code, glyph|
+      assert_equal glyph, f.char_index(code)
+    end
+  end
+
+  def test_missing_code_points
+    f = face
+    assert_equal 0, f.char_index(0x2603)
+    assert_equal 0, f.char_index(0x10FFFF)
+    assert_equal 0, f.char_index(0x110000)
+  end
+
+  def test_tables_built_by_several_threads
+    expected = face.char_index('A'.ord)
+    20.times do
+      f = face
+      results = 4.times.map do |i|
+        Thread.new do
+          case i
+          when 0 then f.advance(expected)
+          when 1 then f.coverage
+          end
+          f.char_index('A'.ord)
+        end
+      end.map(&:value)
+      assert_equal [expected], results.uniq
+    end
+  end
+end
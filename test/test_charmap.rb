@@ -0,0 +1,23 @@
+require_relative 'test_helper'
+
+class TestCharmap < Minitest::Test
+  include FT2Test
+
+  def test_charmap_pairs
+    f = face
+    codes, glyphs = f.charmap_pairs
+    codes = codes.unpack('L*')
+
+    assert_equal codes.sort, codes
+    assert_equal f.current_charmap, codes.zip(glyphs.unpack('L*')).to_h
+  end
+
+  def test_each_char_mapping
+    f = face
+    codes, glyphs = f.charmap_pairs
+    pairs = codes.unpack('L*').zip(glyphs.unpack('L*'))
+
+    assert_equal pairs, f.each_char_mapping.to_a
+    assert_equal pairs.first(10), f.each_char_mapping.first(10)
+  end
+end
@@ -0,0 +1,27 @@
+require_relative 'test_helper'
+
+class TestCoverage < Minitest::Test
+  include FT2Test
+
+  def test_coverage
+    f = face
+    ranges = f.coverage.unpack('L*').each_slice(2).to_a
+
+    assert f.coverage.frozen?
+    assert_includes ranges, [32, 126]
+    ranges.each { |first, last| assert_operator first, :<=, last }
+    ranges.flatten.each_cons(2) { |a, b| assert_operator a, :<=, b }
+    ranges.each do |first, last|
+      assert_operator f.char_index(first), :>, 0
+      assert_operator f.char_index(last), :>, 0
+    end
+  end
+
+  def test_covers
+    f = face
+    assert f.covers?('Hello, World')
+    refute f.covers?("Hello ☃")
+    assert_equal ["☃", "東"], f.missing_chars("Hello ☃ 東☃")
+    assert_equal [], f.missing_chars('Hello')
+  end
+end
@@ -0,0 +1,144 @@
+require_relative 'test_helper'
+
+class TestFaceCache < Minitest::Test
+  include FT2Test
+
+  def setup
+    @dir = Dir.mktmpdir
+    @fonts = 3.times.map do |i|
+      path = File.join(@dir, "font#{i}.ttf")
+      FileUtils.cp YUDIT, path
+      path
+    end
+  end
+
+  def teardown
+    FileUtils.rm_rf @dir
+  end
+
+  def test_hits
+    cache = FT2::FaceCache.new
+    first = cache.open @fonts[0]
+    second = cache.open @fonts[0]
+
+    assert_equal 1, cache.misses
+    assert_equal 1, cache.hits
+    assert_equal 1, cache.size
+    assert_equal first.num_glyphs, second.num_glyphs
+  end
+
+  def test_hits_skip_the_file_system
+    cache = FT2::FaceCache.new
+    cache.open @fonts[0]
+    File.unlink @fonts[0]
+
+    cache.open @fonts[0]
+    assert_equal 1, cache.hits
+  end
+
+  def test_eviction
+    cache = FT2::FaceCache.new 2
+    faces = @fonts.map { |path| cache.open path }
+
+    assert_equal 2, cache.size
+    assert_equal 3, cache.misses
+
+    # the least recently used font went, the others are still cached
+    cache.open @fonts[2]
+    cache.open @fonts[1]
+    assert_equal 2, cache.hits
+    cache.open @fonts[0]
+    assert_equal 4, cache.misses
+
+    # evicted faces stay usable
+    faces.each { |f| f.load_char 'A'.ord, FT2::Load::DEFAULT }
+  end
+
+  def test_revalidate
+    cache = FT2::FaceCache.new
+    cache.open @fonts[0]
+    File.utime Time.now, Time.now + 60, @fonts[0]
+
+    cache.open @fonts[0]
+    assert_equal 1, cache.misses
+    cache.open @fonts[0], revalidate: true
+    assert_equal 2, cache.misses
+    cache.open @fonts[0], revalidate: true
+    assert_equal 2, cache.misses
+  end
+
+  def test_ttl
+    cache = FT2::FaceCache.new 4, ttl: 0
+    cache.open @fonts[0]
+    File.utime Time.now, Time.now + 60, @fonts[0]
+
+    cache.open @fonts[0]
+    assert_equal 2, cache.misses
+  end
+
+  def test_clear
+    cache = FT2::FaceCache.new
+    face = cache.open @fonts[0]
+    cache.clear
+
+    assert_equal 0, cache.size
+    assert_equal 0, cache.hits + cache.misses
+    face.load_char 'A'.ord, FT2::Load::DEFAULT
+  end
+
+  def test_threads_share_one_entry
+    cache = FT2::FaceCache.new
+    faces = 16.times.map { Thread.new { cache.open @fonts[0] } }.map(&:value)
+
+    assert_equal 1, cache.size
+    assert_equal 16, cache.hits + cache.misses
+    faces.each { |f| f.load_char 'A'.ord, FT2::Load::DEFAULT }
+  end
+
+  def test_threads_open_and_evict
+    cache = FT2::FaceCache.new 1
+    threads = 8.times.map do |i|
+      Thread.new do
+        200.times do |n|
+          face = cache.open @fonts[(i + n) % 2]
+          face.load_char 'A'.ord, FT2::Load::DEFAULT
+          cache.clear if n % 7 == i
+        end
+      end
+    end
+    threads.each(&:join)
+
+    assert_operator cache.size, :<=, 1
+    face = cache.open @fonts[0]
+    face.load_char 'A'.ord, FT2::Load::DEFAULT
+    cache.clear
+    assert_equal 0, cache.size
+  end
+
+  def test_relative_paths
+    cache = FT2::FaceCache.new
+    other = File.join(@dir, 'other')
+    FileUtils.mkdir_p other
+    FileUtils.cp KERNED, File.join(other, 'font0.ttf')
+
+    yudit = Dir.chdir(@dir) { cache.open 'font0.ttf' }
+    kerned = Dir.chdir(other) { cache.open 'font0.ttf' }
+    refute_equal yudit.num_glyphs, kerned.num_glyphs
+    assert_equal 2, cache.misses
+
+    cache.open @fonts[0]
+    assert_equal 1, cache.hits
+  end
+
+  def test_faces_have_their_own_size
+    cache = FT2::FaceCache.new
+    small = cache.open @fonts[0]
+    large = cache.open @fonts[0]
+    small.set_pixel_sizes 0, 12
+    large.set_pixel_sizes 0, 48
+
+    assert_equal 12, small.size.metrics.x_ppem
+    assert_equal 48, large.size.metrics.x_ppem
+    assert_equal 0, cache.open(@fonts[0]).size.metrics.x_ppem
+  end
+end
@@ -0,0 +1,64 @@
+require_relative 'test_helper'
+
+class TestFit < Minitest::Test
+  include FT2Test
+
+  def test_fit
+    f = face
+    size = f.fit 'Hello', width: 100, height: 40
+    assert size
+
+    f.set_pixel_sizes 0, size
+    assert_operator f.measure('Hello').advance, :<=, 100 * 64
+    f.set_pixel_sizes 0, size + 1
+    m = f.measure 'Hello'
+    assert(m.advance > 100 * 64 || m.ascent + m.descent > 40 * 64)
+  end
+
+  def test_fit_bounds
+    f = face
+    assert_nil f.fit('Hello', width: 2, height: 2, min: 8)
+    assert_equal 10, f.fit('Hello', width: 1000, height: 1000, max: 10)
+  end
+
+  def test_invalid_box
+    f = face
+    [Float::NAN, Float::INFINITY, -Float::INFINITY].each do |bad|
+      assert_raises(ArgumentError) { f.fit 'Hello', width: bad, height: 40 }
+      assert_raises(ArgumentError) { f.fit 'Hello', width: 100, height: bad }
+      assert_raises(ArgumentError) { f.fit 'Hello', width: 100, height: 40, line_gap: bad }
+    end
+  end
+
+  def test_huge_box
+    f = face
+    assert_equal 0xFFFF, f.fit('Hi', width: 1e300, height: 1e300, max: 0xFFFF, min: 0xFFFF)
+    assert_nil f.fit('Hi', width: 100, height: -1e300)
+  end
+
+  # a copy of yudit.ttf with zero line metrics in its hhea and OS/2 tables
+  def zero_metrics_face(dir)
+    data = File.binread(YUDIT)
+    tables = data[4, 2].unpack1('n').times.to_h do |i|
+      tag, _, offset, length = data[12 + 16 * i, 16].unpack('a4NNN')
+      [tag, [offset, length]]
+    end
+    hhea, = tables['hhea']
+    data[hhea + 4, 6] = "\0" * 6
+    if (os2, length = tables['OS/2']) && length >= 78
+      data[os2 + 68, 10] = "\0" * 10
+    end
+    path = File.join(dir, 'zero.ttf')
+    File.binwrite path, data
+    face path
+  end
+
+  def test_zero_line_metrics
+    Dir.mktmpdir do |dir|
+      f = zero_metrics_face(dir)
+      skip 'FreeType made up line metrics' unless f.ascender == 0 && f.descender == 0
+      assert_equal f.fit('Hello', width: 100, height: 1000),
+                   f.fit('Hello', width: 100, height: 1)
+    end
+  end
+end
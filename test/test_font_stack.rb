@@ -0,0 +1,43 @@
+require_relative 'test_helper'
+
+class TestFontStack < Minitest::Test
+  include FT2Test
+
+  def test_runs
+    yudit = face
+    stack = FT2::FontStack.new [yudit]
+    runs = stack.runs "ab☃c"
+
+    assert_equal [[yudit, 0, 2, 'ab'], [nil, 2, 1, "☃"], [yudit, 3, 1, 'c']],
+                 runs.map(&:to_a)
+    runs.each { |run| assert_equal Encoding::UTF_8, run.text.encoding }
+  end
+
+  def test_fallback
+    skip 'no second font found' unless KERNED
+    first, second = face, face(KERNED)
+    stack = FT2::FontStack.new [first, second]
+    str = "Hi Ж!"
+
+    # characters go to the first face covering them
+    assert_same first, stack.face_for('H')
+    if first.covers?("Ж")
+      assert_same first, stack.face_for("Ж")
+    else
+      assert second.covers?("Ж")
+      assert_same second, stack.face_for("Ж")
+    end
+
+    runs = stack.runs str
+    assert_equal str, runs.map(&:text).join
+    assert_equal str.length, runs.sum(&:length)
+    runs.each_cons(2) do |a, b|
+      assert_equal a.start + a.length, b.start
+      refute_same a.face, b.face
+    end
+  end
+
+  def test_empty
+    assert_equal [], FT2::FontStack.new([face]).runs('')
+  end
+end
@@ -0,0 +1,50 @@
+require_relative 'test_helper'
+require 'stringio'
+
+class TestFromIO < Minitest::Test
+  include FT2Test
+
+  class FailingIO < StringIO
+    def read(*)
+      raise IOError, 'disk on fire'
+    end
+  end
+
+  def test_file
+    File.open(YUDIT, 'rb') do |io|
+      f = FT2::Face.from_io io
+      f.set_char_size 0, 16 * 64, 72, 72
+      f.load_char 'A'.ord, FT2::Load::RENDER
+
+      assert_equal FT2::Face.new(YUDIT).num_glyphs, f.num_glyphs
+      assert_operator f.glyph.bitmap.rows, :>, 0
+    end
+  end
+
+  def test_font_after_the_start_of_the_io
+    io = StringIO.new('junk' + File.binread(YUDIT))
+    io.read 4
+    assert_equal FT2::Face.new(YUDIT).num_glyphs, FT2::Face.from_io(io).num_glyphs
+  end
+
+  def test_pipe
+    IO.pipe do |r, w|
+      w.binmode
+      writer = Thread.new { w.write File.binread(YUDIT); w.close }
+      f = FT2::Face.from_io r
+      writer.join
+
+      assert_equal FT2::Face.new(YUDIT).num_glyphs, f.num_glyphs
+    end
+  end
+
+  def test_io_exceptions_propagate
+    assert_raises(IOError) { FT2::Face.from_io FailingIO.new(File.binread(YUDIT)) }
+  end
+
+  def test_positioned_past_the_end
+    io = StringIO.new('abc')
+    io.seek 10
+    assert_raises(ArgumentError) { FT2::Face.from_io io }
+  end
+end
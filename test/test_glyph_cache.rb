@@ -0,0 +1,83 @@
+require_relative 'test_helper'
+
+class TestGlyphCache < Minitest::Test
+  include FT2Test
+
+  def setup
+    @face = face
+    @gindex = @face.char_index 'A'.ord
+  end
+
+  def test_hits_and_misses
+    cache = FT2::GlyphCache.new
+    g = cache.render @face, @gindex
+    assert_same g, cache.render(@face, @gindex)
+    assert_equal 1, cache.misses
+    assert_equal 1, cache.hits
+    assert_equal 1, cache.size
+    assert_operator cache.bytes, :>, g.buffer.bytesize
+  end
+
+  def test_glyph
+    g = FT2::GlyphCache.new.render @face, @gindex
+    assert_predicate g, :frozen?
+    assert_predicate g.buffer, :frozen?
+    assert_equal g.pitch.abs * g.rows, g.buffer.bytesize
+
+    @face.load_glyph @gindex, FT2::Load::RENDER
+    bitmap = @face.glyph.bitmap
+    assert_equal [bitmap.width, bitmap.rows], [g.width, g.rows]
+    assert_equal @face.glyph.advance[0], g.x_advance
+  end
+
+  def test_keys
+    cache = FT2::GlyphCache.new
+    cache.render @face, @gindex
+    cache.render @face, @gindex, FT2::Load::NO_HINTING
+    cache.render @face, @gindex, FT2::Load::DEFAULT, FT2::RenderMode::MONO
+    @face.set_char_size 0, 32 * 64, 72, 72
+    cache.render @face, @gindex
+    assert_equal 4, cache.misses
+    assert_equal 4, cache.size
+  end
+
+  def test_shared_faces_share_glyphs
+    cache = FT2::GlyphCache.new
+    cache.render @face, @gindex
+    cache.render @face.share, @gindex
+    assert_equal 1, cache.hits
+  end
+
+  def test_evictions
+    cache = FT2::GlyphCache.new max_bytes: 4096
+    assert_equal 4096, cache.max_bytes
+    ('A'..'Z').each { |c| cache.render @face, @face.char_index(c.ord) }
+    assert_operator cache.evictions, :>, 0
+    assert_operator cache.bytes, :<=, 4096
+    assert_equal 26, cache.size + cache.evictions
+
+    # the most recently used glyph stays
+    hits = cache.hits
+    cache.render @face, @face.char_index('Z'.ord)
+    assert_equal hits + 1, cache.hits
+  end
+
+  def test_clear
+    cache = FT2::GlyphCache.new
+    cache.render @face, @gindex
+    cache.render @face, @gindex
+    cache.clear
+    assert_equal [0, 0, 0, 0], [cache.size, cache.bytes, cache.hits, cache.misses]
+    cache.render @face, @gindex
+    assert_equal 1, cache.misses
+  end
+
+  def test_threads
+    cache = FT2::GlyphCache.new
+    expected = cache.render(@face, @gindex)
+    results = 4.times.map do
+      Thread.new { 100.times.map { cache.render @face, @gindex }.uniq }
+    end.map(&:value)
+    results.each { |r| assert_equal [expected], r }
+  end
+end
@@ -0,0 +1,27 @@
+require_relative 'test_helper'
+
+class TestGlyphIndices < Minitest::Test
+  include FT2Test
+
+  def test_glyph_indices
+    f = face
+    str = 'Hello, World'
+    expected = str.each_char.map { |c| f.char_index c.ord }
+    assert_equal expected, f.glyph_indices(str).unpack('L*')
+  end
+
+  def test_missing
+    f = face
+    ids, missing = f.glyph_indices "a☃b☃", missing: true
+    assert_equal 4, ids.unpack('L*').size
+    assert_equal [1, 3], missing
+  end
+
+  def test_other_encodings
+    f = face
+    str = 'Hello'
+    assert_equal f.glyph_indices(str),
+                 f.glyph_indices(str.encode(Encoding::UTF_16LE))
+    assert_equal '', f.glyph_indices('')
+  end
+end
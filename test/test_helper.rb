@@ -0,0 +1,41 @@
+require 'minitest/autorun'
+require 'tmpdir'
+require 'fileutils'
+require 'ft2'
+
+module FT2Test
+  FONT_DIR = File.expand_path('../examples/fonts', __dir__)
+  YUDIT = File.join(FONT_DIR, 'yudit.ttf')
+
+  # yudit.ttf has no kerning, so kerning tests use a common system font
+  KERNED = %w[
+    /usr/share/fonts/truetype/dejavu/DejaVuSans.ttf
+    /usr/share/fonts/TTF/DejaVuSans.ttf
+    /usr/share/fonts/dejavu/DejaVuSans.ttf
+    /usr/local/share/fonts/dejavu/DejaVuSans.ttf
+    /Library/Fonts/Arial.ttf
+    /System/Library/Fonts/Supplemental/Arial.ttf
+  ].find { |path| File.exist?(path) }
+
+  def face(path = YUDIT, size = 16)
+    face = FT2::Face.new path
+    face.set_char_size 0, size * 64, 72, 72
+    face
+  end
+
+  def kerned_face
+    skip 'no font with kerning found' unless KERNED
+    face KERNED
+  end
+
+  # run the block with an exception pending, raised by the first
+  # blocking operation (such as waiting for a FreeType lock); any Ruby
+  # method called first may drop it, so pass the block only constants
+  # and local variables
+  def interrupted
+    Thread.handle_interrupt(Object => :never) do
+      Thread.current.raise Interrupt
+      Thread.handle_interrupt(Object => :on_blocking) { yield }
+    end
+  end
+end
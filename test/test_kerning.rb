@@ -0,0 +1,59 @@
+require_relative 'test_helper'
+
+class TestKerning < Minitest::Test
+  include FT2Test
+
+  def glyph_ids(face, str)
+    str.each_char.map { |c| face.char_index c.ord }
+  end
+
+  def test_kerning_run_matches_kerning
+    f = kerned_face
+    ids = glyph_ids(f, 'AVATAR Ty. To, WAVE LT')
+
+    [FT2::KerningMode::DEFAULT, FT2::KerningMode::UNFITTED,
+     FT2::KerningMode::UNSCALED].each do |mode|
+      expected = ids.each_cons(2).map { |l, r| f.kerning(l, r, mode)[0] }
+      assert_equal expected, f.kerning_run(ids, mode).unpack('l*')
+    end
+    refute_equal [0], f.kerning_run(ids).unpack('l*').uniq
+  end
+
+  def test_kerning_run_without_kerning
+    f = face
+    ids = glyph_ids(f, 'AVATAR')
+    assert_equal [0] * 5, f.kerning_run(ids).unpack('l*')
+  end
+
+  # a copy of the kerned font with the kern subtables' coverage replaced
+  def kern_coverage_face(dir, coverage)
+    data = File.binread(KERNED)
+    num_tables = data[4, 2].unpack1('n')
+    offset = num_tables.times.map { |i| data[12 + 16 * i, 16].unpack('a4NNN') }
+                       .find { |tag, *| tag == 'kern' }&.at(2)
+    skip 'no kern table' unless offset
+
+    p = offset + 4
+    data[offset + 2, 2].unpack1('n').times do
+      data[p + 4, 2] = [coverage].pack('n')
+      p += data[p + 2, 2].unpack1('n')
+    end
+    path = File.join(dir, "kern#{coverage}.ttf")
+    File.binwrite path, data
+    face path
+  end
+
+  def test_kerning_run_skips_subtables_like_freetype
+    kerned_face
+    Dir.mktmpdir do |dir|
+      # override, cross-stream, reserved bits, minimum values, formats 1 and 2
+      [0x0009, 0x0005, 0x0011, 0x0041, 0x0003, 0x0101, 0x0201].each do |coverage|
+        f = kern_coverage_face(dir, coverage)
+        ids = glyph_ids(f, 'AVATAR To')
+        mode = FT2::KerningMode::DEFAULT
+        expected = ids.each_cons(2).map { |l, r| f.kerning(l, r, mode)[0] }
+        assert_equal expected, f.kerning_run(ids, mode).unpack('l*'), coverage.to_s(16)
+      end
+    end
+  end
+end
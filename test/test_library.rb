@@ -0,0 +1,55 @@
+require_relative 'test_helper'
+
+class TestLibrary < Minitest::Test
+  include FT2Test
+
+  def test_default_is_per_thread
+    main = FT2::Library.default
+    assert_equal main, FT2::Library.default
+
+    other = Thread.new { [FT2::Library.default, FT2::Library.default] }.value
+    assert_equal other[0], other[1]
+    refute_equal main, other[0]
+  end
+
+  def test_fibers_share_the_thread_library
+    assert_equal FT2::Library.default, Fiber.new { FT2::Library.default }.resume
+  end
+
+  def test_faces_use_the_thread_library
+    f = face
+    f.load_char 'A'.ord, FT2::Load::DEFAULT
+    assert_equal FT2::Library.default, f.glyph.library
+
+    slot_lib = Thread.new do
+      g = face
+      g.load_char 'A'.ord, FT2::Load::DEFAULT
+      [g.glyph.library, FT2::Library.default]
+    end.value
+    assert_equal slot_lib[1], slot_lib[0]
+  end
+
+  def test_new_library
+    lib = FT2::Library.new
+    f = FT2::Face.new lib, YUDIT
+    f.load_char 'A'.ord, FT2::Load::DEFAULT
+
+    refute_equal FT2::Library.default, lib
+    assert_equal lib, f.glyph.library
+    assert_match(/\A\d+\.\d+\.\d+\z/, lib.version)
+  end
+
+  def test_faces_keep_their_library
+    f = FT2::Face.new FT2::Library.new, YUDIT
+    GC.start
+    f.set_char_size 0, 16 * 64, 72, 72
+    f.load_char 'A'.ord, FT2::Load::RENDER
+    assert_operator f.glyph.bitmap.rows, :>, 0
+  end
+
+  def test_uninitialized
+    lib = FT2::Library.allocate
+    assert_raises(FT2::Error) { lib.version }
+    assert_raises(FT2::Error) { FT2::Library.new.send(:initialize) }
+  end
+end
@@ -0,0 +1,30 @@
+require_relative 'test_helper'
+
+class TestMeasure < Minitest::Test
+  include FT2Test
+
+  def test_measure
+    f = face
+    str = 'Hello'
+    m = f.measure str, kerning: false
+
+    advance = str.each_char.sum do |c|
+      f.load_char c.ord, FT2::Load::DEFAULT
+      f.glyph.advance[0]
+    end
+    assert_equal advance, m.advance
+    assert_operator m.x_max, :>, m.x_min
+    assert_operator m.y_max, :>, 0
+    assert_operator m.ascent, :>, 0
+    assert_operator m.descent, :>, 0
+  end
+
+  def test_measure_kerns
+    f = kerned_face
+    ids = 'AVATAR'.each_char.map { |c| f.char_index c.ord }
+    kerned = f.measure('AVATAR').advance
+    plain = f.measure('AVATAR', kerning: false).advance
+
+    assert_equal f.kerning_run(ids).unpack('l*').sum, kerned - plain
+  end
+end
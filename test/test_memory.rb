@@ -0,0 +1,61 @@
+require_relative 'test_helper'
+
+class TestMemory < Minitest::Test
+  include FT2Test
+
+  def test_default
+    assert_same FT2::Memory.default, FT2::Memory.default
+    assert_kind_of FT2::Memory, FT2::Memory.default
+    assert_nil FT2::Memory.default.arena_bytes
+  end
+
+  def test_stats_follow_the_library
+    mem = FT2::Memory.new
+    assert_equal 0, mem.bytes
+    assert_equal 0, mem.blocks
+
+    lib = FT2::Library.new memory: mem
+    assert_operator mem.bytes, :>, 0
+    assert_operator mem.blocks, :>, 0
+
+    before = mem.bytes
+    f = FT2::Face.new lib, YUDIT
+    f.set_char_size 0, 16 * 64, 72, 72
+    f.load_char 'A'.ord, FT2::Load::RENDER
+    assert_operator mem.bytes, :>, before
+    assert_operator mem.peak_bytes, :>=, mem.bytes
+    assert_operator mem.allocations, :>=, mem.blocks
+    assert_equal f.glyph.library, lib
+  end
+
+  def test_peak_and_allocations_only_grow
+    mem = FT2::Memory.new
+    lib = FT2::Library.new memory: mem
+    3.times { FT2::Face.new(lib, YUDIT).load_char 'A'.ord, FT2::Load::DEFAULT }
+    peak, allocations = mem.peak_bytes, mem.allocations
+    GC.start
+    assert_equal peak, mem.peak_bytes
+    assert_equal allocations, mem.allocations
+    assert_operator mem.bytes, :<=, peak
+  end
+
+  def test_arena
+    mem = FT2::Memory.new arena: 64 * 1024
+    assert_equal 0, mem.arena_bytes
+    f = FT2::Face.new FT2::Library.new(memory: mem), YUDIT
+    f.set_char_size 0, 16 * 64, 72, 72
+    f.load_char 'A'.ord, FT2::Load::RENDER
+    assert_operator mem.arena_bytes, :>=, mem.bytes
+    assert_operator mem.arena_bytes, :>=, 64 * 1024
+  end
+
+  def test_invalid_arena
+    assert_raises(ArgumentError) { FT2::Memory.new arena: 16 }
+  end
+
+  def test_default_library_memory
+    before = FT2::Memory.default.allocations
+    FT2::Library.new
+    assert_operator FT2::Memory.default.allocations, :>, before
+  end
+end
@@ -0,0 +1,49 @@
+require_relative 'test_helper'
+
+class TestNewFromMemory < Minitest::Test
+  include FT2Test
+
+  def test_string
+    data = File.binread(YUDIT)
+    f = FT2::Face.new_from_memory data, data.bytesize
+
+    assert data.frozen?
+    assert_equal FT2::Face.new(YUDIT).num_glyphs, f.num_glyphs
+  end
+
+  def test_string_outlives_references
+    f = FT2::Face.new_from_memory File.binread(YUDIT), File.size(YUDIT)
+    GC.start
+    GC.compact if GC.respond_to?(:compact)
+
+    f.set_char_size 0, 16 * 64, 72, 72
+    f.load_char 'A'.ord, FT2::Load::RENDER
+    assert_operator f.glyph.bitmap.rows, :>, 0
+  end
+
+  def test_size_past_the_buffer
+    data = File.binread(YUDIT)
+    assert_raises(ArgumentError) { FT2::Face.new_from_memory data, data.bytesize + 1 }
+  end
+
+  def test_io_buffer
+    skip 'needs IO::Buffer' unless defined?(IO::Buffer)
+
+    buf = IO::Buffer.for(File.binread(YUDIT)).dup
+    f = FT2::Face.new_from_memory buf, buf.size
+
+    assert buf.locked?
+    assert_equal FT2::Face.new(YUDIT).num_glyphs, f.num_glyphs
+  end
+
+  def test_interrupted_open_unlocks
+    skip 'needs IO::Buffer' unless defined?(IO::Buffer)
+
+    buf = IO::Buffer.for(File.binread(YUDIT)).dup
+    size = buf.size
+    assert_raises(Interrupt) do
+      interrupted { FT2::Face.new_from_memory buf, size }
+    end
+    refute buf.locked?
+  end
+end
@@ -0,0 +1,52 @@
+require_relative 'test_helper'
+
+class TestOpenMapped < Minitest::Test
+  include FT2Test
+
+  # a copy of its own, since FreeType maps the fonts it opens too
+  def setup
+    @dir = Dir.mktmpdir
+    @font = File.join(@dir, 'mapped.ttf')
+    FileUtils.cp YUDIT, @font
+  end
+
+  def teardown
+    FileUtils.rm_rf @dir
+  end
+
+  def mappings
+    File.read('/proc/self/maps').lines.count { |l| l.include?(@font) }
+  end
+
+  def test_open_mapped
+    f = FT2::Face.open_mapped @font
+    plain = FT2::Face.new YUDIT
+
+    assert_equal plain.num_glyphs, f.num_glyphs
+    assert_equal plain.family, f.family
+    f.set_char_size 0, 16 * 64, 72, 72
+    f.load_char 'A'.ord, FT2::Load::RENDER
+    assert_operator f.glyph.bitmap.rows, :>, 0
+  end
+
+  def test_missing_file
+    assert_raises(Errno::ENOENT) { FT2::Face.open_mapped @font + '.missing' }
+  end
+
+  def test_faces_share_a_mapping
+    skip 'needs /proc/self/maps' unless File.exist?('/proc/self/maps')
+
+    faces = 3.times.map { FT2::Face.open_mapped @font }
+    assert_equal 1, mappings
+    faces.each { |f| f.load_char 'A'.ord, FT2::Load::DEFAULT }
+  end
+
+  def test_interrupted_open_unmaps
+    skip 'needs /proc/self/maps' unless File.exist?('/proc/self/maps')
+
+    font = @font
+    assert_raises(Interrupt) { interrupted { FT2::Face.open_mapped font } }
+    GC.start
+    assert_equal 0, mappings
+  end
+end
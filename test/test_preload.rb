@@ -0,0 +1,63 @@
+require_relative 'test_helper'
+
+class TestPreload < Minitest::Test
+  include FT2Test
+
+  def setup
+    @dir = Dir.mktmpdir
+    @path = File.join(@dir, 'preload.ttf')
+    FileUtils.cp YUDIT, @path
+  end
+
+  def teardown
+    FT2::FaceCache.default.clear
+    FileUtils.rm_rf @dir
+  end
+
+  def test_preload
+    faces = FT2.preload [@path, [@path, 0]], size: 16
+    assert_equal 2, faces.size
+    assert_equal faces[0].num_glyphs, faces[1].num_glyphs
+
+    hits = FT2::FaceCache.default.hits
+    FT2::FaceCache.default.open @path
+    assert_equal hits + 1, FT2::FaceCache.default.hits
+  end
+
+  def test_invalid_size
+    assert_raises(ArgumentError) { FT2.preload @path, size: 0 }
+  end
+
+  def test_faces_start_at_the_preloaded_size
+    FT2.preload @path, size: 20
+    f = FT2::FaceCache.default.open @path
+    assert_equal 20, f.size.metrics.x_ppem
+
+    f.set_pixel_sizes 0, 40
+    assert_equal 20, FT2::FaceCache.default.open(@path).size.metrics.x_ppem
+  end
+
+  def test_fork
+    skip 'needs fork' unless Process.respond_to?(:fork)
+    FT2.preload @path, size: 16
+
+    rd, wr = IO.pipe
+    pid = fork do
+      rd.close
+      cache = FT2::FaceCache.default
+      hits = cache.hits
+      f = cache.open @path
+      f.set_char_size 0, 16 * 64, 72, 72
+      f.load_char 'A'.ord, FT2::Load::RENDER
+      wr.puts [cache.hits - hits, f.glyph.bitmap.width > 0].inspect
+      exit! 0
+    end
+    wr.close
+
+    assert_equal '[1, true]', rd.read.chomp
+    Process.wait pid
+    assert_predicate $?, :success?
+  ensure
+    rd&.close
+  end
+end
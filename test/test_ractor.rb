@@ -0,0 +1,48 @@
+require_relative 'test_helper'
+
+class TestRactor < Minitest::Test
+  include FT2Test
+
+  def setup
+    skip 'needs Ractor' unless defined?(Ractor)
+    @experimental = Warning[:experimental]
+    Warning[:experimental] = false
+  end
+
+  def teardown
+    Warning[:experimental] = @experimental if defined?(Ractor)
+  end
+
+  def test_ractors_get_their_own_library
+    main = FT2::Library.default.freeze
+    ractors = 4.times.map do
+      # no threads inside the ractors: they hang some rubies (3.3.0)
+      Ractor.new(main) { |lib| FT2::Library.default == lib }
+    end
+
+    ractors.each { |r| refute r.take }
+  end
+
+  def test_faces_in_parallel
+    num_glyphs = FT2::Face.new(YUDIT).num_glyphs
+    ractors = 4.times.map do
+      Ractor.new(YUDIT) do |path|
+        20.times.map do
+          f = FT2::Face.new path
+          f.set_char_size 0, 16 * 64, 72, 72
+          f.load_char 'A'.ord, FT2::Load::RENDER
+          f.num_glyphs
+        end.uniq
+      end
+    end
+
+    ractors.each { |r| assert_equal [num_glyphs], r.take }
+  end
+
+  def test_frozen_faces_are_shareable
+    f = FT2::Face.new(YUDIT).freeze
+    assert Ractor.shareable?(f)
+    assert_equal f.num_glyphs, Ractor.new(f) { |shared| shared.num_glyphs }.take
+    refute Ractor.shareable?(FT2::Face.new(YUDIT))
+  end
+end
@@ -0,0 +1,62 @@
+require_relative 'test_helper'
+
+class TestScan < Minitest::Test
+  include FT2Test
+
+  def setup
+    @dir = Dir.mktmpdir
+    %w[a b/c].each { |sub| FileUtils.mkdir_p File.join(@dir, sub) }
+    @fonts = 150.times.map do |i|
+      path = File.join(@dir, ['a', 'b/c', ''][i % 3], "font#{i}.ttf").squeeze('/')
+      FileUtils.cp YUDIT, path
+      path
+    end
+    File.write File.join(@dir, 'a', 'notes.txt'), 'not a font'
+    FileUtils.cp YUDIT, File.join(@dir, '.hidden.ttf')
+  end
+
+  def teardown
+    FileUtils.rm_rf @dir
+  end
+
+  def test_scan
+    entries = FT2.scan @dir, threads: 4
+    num_glyphs = FT2::Face.new(YUDIT).num_glyphs
+
+    assert_equal @fonts.sort, entries.map(&:path).sort
+    entries.each { |e| assert_equal num_glyphs, e.num_glyphs }
+    assert_equal entries.map(&:to_a), FT2.scan(@dir, threads: 1).map(&:to_a)
+  end
+
+  def test_several_directories
+    entries = FT2.scan File.join(@dir, 'a'), File.join(@dir, 'b')
+    assert_equal @fonts.grep(%r{/(a|b/c)/}).sort, entries.map(&:path).sort
+  end
+
+  def test_invalid_thread_count
+    assert_raises(ArgumentError) { FT2.scan @dir, threads: 0 }
+  end
+
+  def test_trap_handlers_resume_the_scan
+    skip 'needs SIGUSR1' unless Signal.list['USR1']
+
+    traps = 0
+    old = trap('USR1') { traps += 1 }
+    signals = Thread.new { loop { Process.kill 'USR1', $$; sleep 0.001 } }
+    scans = 5.times.map { FT2.scan(@dir, threads: 2) }
+    signals.kill.join
+
+    assert_operator traps, :>, 0
+    scans.each { |entries| assert_equal @fonts.sort, entries.map(&:path).sort }
+  ensure
+    trap('USR1', old) if old
+  end
+
+  def test_exceptions_stop_the_scan
+    scan = Thread.new { FT2.scan(@dir) while true }
+    scan.report_on_exception = false
+    Thread.pass until scan.stop? || !scan.alive?
+    scan.raise Interrupt
+    assert_raises(Interrupt) { scan.join }
+  end
+end
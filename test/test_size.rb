@@ -0,0 +1,88 @@
+require_relative 'test_helper'
+
+class TestSize < Minitest::Test
+  include FT2Test
+
+  def ppem(face)
+    face.size.metrics.x_ppem
+  end
+
+  def test_share
+    f = face(YUDIT, 12)
+    g = f.share
+    refute_same f, g
+    assert_equal f.num_glyphs, g.num_glyphs
+    assert_equal 12, ppem(g)
+  end
+
+  def test_shared_faces_have_their_own_size
+    f = face(YUDIT, 12)
+    g = f.share
+    g.set_pixel_sizes 0, 48
+    assert_equal 12, ppem(f)
+    assert_equal 48, ppem(g)
+
+    f.load_char 'A'.ord, FT2::Load::RENDER
+    small = f.glyph.bitmap.rows
+    g.load_char 'A'.ord, FT2::Load::RENDER
+    assert_operator g.glyph.bitmap.rows, :>, small
+  end
+
+  def test_size_handles
+    f = face(YUDIT, 12)
+    s = FT2::Size.new f
+    assert_same f, s.face
+    assert_equal 0, s.metrics.x_ppem
+
+    s.activate
+    f.set_pixel_sizes 0, 30
+    assert_equal 30, s.metrics.x_ppem
+    assert_equal 30, ppem(f)
+  end
+
+  def test_switching_sizes
+    f = face(YUDIT, 12)
+    old = f.size
+    big = FT2::Size.new f
+    big.activate
+    f.set_pixel_sizes 0, 40
+
+    old.activate
+    assert_equal 12, ppem(f)
+    big.activate
+    assert_equal 40, ppem(f)
+  end
+
+  def test_shared_frozen_face
+    f = face.freeze
+    g = f.share
+    refute_predicate g, :frozen?
+    g.set_pixel_sizes 0, 20
+    assert_equal 20, ppem(g)
+  end
+
+  def test_sizes_are_collected
+    f = face
+    f.share
+    200.times { FT2::Size.new(f) }
+    GC.start
+    f.load_char 'A'.ord, FT2::Load::RENDER
+    assert_operator f.glyph.bitmap.rows, :>, 0
+  end
+
+  def test_threads_with_their_own_sizes
+    # the glyph slot is shared by the whole font, so only check sizes
+    f = face
+    ppems = [12, 24, 36, 48].map do |px|
+      Thread.new(f.share) do |g|
+        g.set_pixel_sizes 0, px
+        50.times.map do
+          g.load_char 'A'.ord, FT2::Load::RENDER
+          ppem(g)
+        end.uniq
+      end
+    end.map(&:value)
+
+    assert_equal [[12], [24], [36], [48]], ppems
+  end
+end
@@ -0,0 +1,81 @@
+require_relative 'test_helper'
+
+class TestThreads < Minitest::Test
+  include FT2Test
+
+  TEXT = 'The quick brown fox jumps over the lazy dog'
+
+  def render_all(f)
+    TEXT.each_char.map do |c|
+      f.load_char c.ord, FT2::Load::RENDER
+      f.glyph.bitmap.buffer
+    end
+  end
+
+  def test_concurrent_rendering
+    expected = render_all(face)
+
+    results = 8.times.map do
+      Thread.new { 20.times.map { render_all(face) }.uniq }
+    end.map(&:value)
+
+    results.each { |r| assert_equal [expected], r }
+  end
+
+  def test_shared_face
+    shared = face
+    threads = 8.times.map do
+      Thread.new do
+        200.times do |i|
+          shared.load_char TEXT[i % TEXT.size].ord, FT2::Load::RENDER
+          shared.glyph.bitmap.rows
+        end
+      end
+    end
+    threads.each(&:join)
+
+    assert_equal render_all(face), render_all(shared)
+  end
+
+  def test_concurrent_opening
+    glyphs = 8.times.map do
+      Thread.new { 20.times.map { FT2::Face.new(YUDIT).num_glyphs }.uniq }
+    end.map(&:value)
+
+    assert_equal [[FT2::Face.new(YUDIT).num_glyphs]], glyphs.uniq
+  end
+
+  def test_interrupts_during_rendering
+    f = face
+    worker = Thread.new { loop { render_all(f) } }
+    worker.report_on_exception = false
+    sleep 0.05
+    worker.raise Interrupt
+    assert_raises(Interrupt) { worker.join }
+
+    # the face lock was released
+    assert_equal render_all(face), render_all(f)
+  end
+
+  def test_shared_glyph_conversion
+    f = face
+    f.load_char 'A'.ord, FT2::Load::DEFAULT
+    glyph = f.glyph.glyph
+
+    threads = 4.times.map do |i|
+      Thread.new do
+        50.times do
+          if i.zero?
+            glyph.to_bmap FT2::RenderMode::NORMAL, [0, 0], true
+          else
+            glyph.dup
+            glyph.cbox 0
+          end
+        end
+      end
+    end
+    threads.each(&:join)
+
+    assert_equal FT2::GlyphFormat::BITMAP, glyph.format
+  end
+end
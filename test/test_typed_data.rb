@@ -0,0 +1,24 @@
+require_relative 'test_helper'
+
+class TestTypedData < Minitest::Test
+  include FT2Test
+
+  WRAPPERS = %w[Bitmap CharMap Face Glyph GlyphClass GlyphMetrics GlyphSlot
+                Outline Size SizeMetrics BitmapGlyph OutlineGlyph]
+
+  def test_wrappers_cannot_be_allocated
+    WRAPPERS.each do |name|
+      assert_raises(TypeError, name) { FT2.const_get(name).allocate }
+    end
+  end
+
+  def test_wrapping_does_not_warn
+    assert_silent do
+      f = face
+      f.load_char 'A'.ord, FT2::Load::RENDER
+      f.glyph.bitmap
+      f.glyph.metrics
+      f.size.metrics
+    end
+  end
+end
@@ -0,0 +1,62 @@
+require_relative 'test_helper'
+
+class TestViews < Minitest::Test
+  include FT2Test
+
+  CALLS = 1_000_000
+
+  def rss_kb
+    File.read('/proc/self/status')[/^VmRSS:\s+(\d+)/, 1].to_i
+  end
+
+  def test_views_are_cached
+    f = face
+    f.load_char 'A'.ord, FT2::Load::DEFAULT
+    slot, size = f.glyph, f.size
+
+    assert_same slot, f.glyph
+    assert_same size, f.size
+    assert_same slot.metrics, slot.metrics
+    assert_same slot.bitmap, slot.bitmap
+    assert_same slot.outline, slot.outline
+    assert_same size.metrics, size.metrics
+  end
+
+  def test_views_follow_their_owner
+    f = face
+    f.load_char 'A'.ord, FT2::Load::DEFAULT
+    metrics = f.glyph.metrics
+    width = metrics.width
+
+    f.load_char 'i'.ord, FT2::Load::DEFAULT
+    refute_equal width, metrics.width
+  end
+
+  def test_rss_stays_flat
+    skip 'needs /proc/self/status' unless File.exist?('/proc/self/status')
+
+    f = face
+    f.load_char 'A'.ord, FT2::Load::DEFAULT
+    slot, size = f.glyph, f.size
+    calls = lambda do |n|
+      n.times do
+        slot.metrics
+        slot.bitmap
+        slot.outline
+        size.metrics
+        size.face
+      end
+    end
+
+    calls.call 10_000
+    GC.start
+    rss = rss_kb
+    objects = GC.stat(:total_allocated_objects)
+
+    calls.call CALLS
+    GC.start
+
+    assert_operator GC.stat(:total_allocated_objects) - objects, :<, 1000
+    assert_operator rss_kb - rss, :<, 4096
+  end
+end